@@ -13,10 +13,19 @@
 #include <string.h>
 #include <math.h>
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #include "bt_app_core.h"
 #include "bt_app_av.h"
 #include "bt_app_volume_control.h"
+#include "bt_app_dac_output.h"
+#include "bt_app_bass_protect.h"
+#include "bt_app_jitter.h"
+#include "bt_app_xrun.h"
+#include "bt_app_latency.h"
+#include "bt_app_delay.h"
+#include "bt_app_output.h"
+#include "bt_app_event_stats.h"
 #include "esp_bt_main.h"
 #include "esp_bt_device.h"
 #include "esp_gap_bt_api.h"
@@ -25,12 +34,6 @@
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#ifdef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_INTERNAL_DAC
-// DAC DMA mode is only supported by the legacy I2S driver, it will be replaced once DAC has its own DMA dirver
-#include "driver/i2s.h"
-#else
-#include "driver/i2s_std.h"
-#endif
 
 #include "sys/lock.h"
 
@@ -42,8 +45,10 @@
 #define APP_RC_CT_TL_RN_PLAY_POS_CHANGE  (4)
 #define APP_RC_CT_TL_RN_VOLUME_CHANGE    (5)
 
+#ifndef CONFIG_EXAMPLE_A2DP_SINK_DELAY_REPORT
 /* Application layer causes delay value */
 #define APP_DELAY_VALUE                  50  // 5ms
+#endif
 
 /*******************************
  * STATIC FUNCTION DECLARATIONS
@@ -59,16 +64,26 @@ static void bt_av_playback_changed(void);
 static void bt_av_play_pos_changed(void);
 /* notification event handler */
 static void bt_av_notify_evt_handler(uint8_t event_id, esp_avrc_rn_param_t *event_parameter);
-/* installation for i2s */
+/* installation of the output backend */
 static void bt_i2s_driver_install(void);
-/* uninstallation for i2s */
+/* uninstallation of the output backend */
 static void bt_i2s_driver_uninstall(void);
+/* reinstall the output backend if the latency profile changed */
+static void bt_i2s_driver_apply_profile(void);
+/* reconfigure the output for a new stream format */
+static void bt_i2s_driver_set_format(uint32_t sample_rate, uint8_t ch_count);
 /* set volume by remote controller */
 static void volume_set_by_controller(uint8_t volume);
 /* set volume by local host */
 static void volume_set_by_local_host(uint8_t volume);
 /* simulation volume change */
 static void volume_change_simulation(void *arg);
+/* log how the bass protection engaged during the last stream */
+static void bt_av_log_bass_protect_stats(void);
+/* log jitter buffer statistics */
+static void bt_av_log_jitter_stats(void);
+/* log usage of the work dispatch */
+static void bt_av_log_dispatch_stats(void);
 /* a2dp event handler */
 static void bt_av_hdl_a2d_evt(uint16_t event, void *p_param);
 /* avrc controller event handler */
@@ -82,6 +97,12 @@ static void bt_av_hdl_avrc_tg_evt(uint16_t event, void *p_param);
 
 static uint32_t s_pkt_cnt = 0;               /* count for audio packet */
 static esp_a2d_audio_state_t s_audio_state = ESP_A2D_AUDIO_STATE_STOPPED;
+static const bt_app_output_t *s_output = NULL; /* output backend */
+static bool s_i2s_installed = false;         /* output backend installed */
+static uint32_t s_i2s_sample_rate = 0;       /* stream format the output is configured for */
+static uint8_t s_i2s_ch_count = 0;
+static uint8_t s_i2s_dma_desc_num = 0;       /* DMA descriptors of the installed output */
+static uint16_t s_i2s_dma_frame_num = 0;
                                              /* audio stream datapath state */
 static const char *s_a2d_conn_state_str[] = {"Disconnected", "Connecting", "Connected", "Disconnecting"};
                                              /* connection state in string */
@@ -91,9 +112,6 @@ static esp_avrc_rn_evt_cap_mask_t s_avrc_peer_rn_cap;
                                              /* AVRC target notification capability bit mask */
 static TaskHandle_t s_vcs_task_hdl = NULL;   /* handle for volume change simulation task */
 static bool s_volume_notify;                 /* notify volume change or not */
-#ifndef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_INTERNAL_DAC
-i2s_chan_handle_t tx_chan = NULL;
-#endif
 
 /********************************
  * STATIC FUNCTION DEFINITIONS
@@ -202,62 +220,47 @@ static void bt_av_notify_evt_handler(uint8_t event_id, esp_avrc_rn_param_t *even
 
 void bt_i2s_driver_install(void)
 {
-#ifdef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_INTERNAL_DAC
-    /* I2S configuration parameters */
-    i2s_config_t i2s_config = {
-        .mode = I2S_MODE_MASTER | I2S_MODE_TX | I2S_MODE_DAC_BUILT_IN,
-        .sample_rate = 44100,
-        .bits_per_sample = 16,
-        .channel_format = I2S_CHANNEL_FMT_RIGHT_LEFT,       /* 2-channels */
-        .communication_format = I2S_COMM_FORMAT_STAND_MSB,
-        .dma_buf_count = 6,
-        .dma_buf_len = 60,
-        .intr_alloc_flags = 0,                              /* default interrupt priority */
-        .tx_desc_auto_clear = true                          /* auto clear tx descriptor on underflow */
-    };
-
-    /* enable I2S */
-    ESP_ERROR_CHECK(i2s_driver_install(0, &i2s_config, 0, NULL));
-    ESP_ERROR_CHECK(i2s_set_dac_mode(I2S_DAC_CHANNEL_BOTH_EN));
-    ESP_ERROR_CHECK(i2s_set_pin(0, NULL));
-#else
-    i2s_chan_config_t chan_cfg = I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_0, I2S_ROLE_MASTER);
-    chan_cfg.auto_clear = true;
-    i2s_std_config_t std_cfg = {
-        .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(44100),
-        .slot_cfg = I2S_STD_MSB_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT, I2S_SLOT_MODE_STEREO),
-        .gpio_cfg = {
-            .mclk = I2S_GPIO_UNUSED,
-            .bclk = CONFIG_EXAMPLE_I2S_BCK_PIN,
-            .ws = CONFIG_EXAMPLE_I2S_LRCK_PIN,
-            .dout = CONFIG_EXAMPLE_I2S_DATA_PIN,
-            .din = I2S_GPIO_UNUSED,
-            .invert_flags = {
-                .mclk_inv = false,
-                .bclk_inv = false,
-                .ws_inv = false,
-            },
-        },
-    };
-#ifdef CONFIG_SOC_I2S_SUPPORTS_APLL
-    /* use APLL for high precision clock */
-    std_cfg.clk_cfg.clk_src = I2S_CLK_SRC_APLL;
-#endif
-    /* enable I2S */
-    ESP_ERROR_CHECK(i2s_new_channel(&chan_cfg, &tx_chan, NULL));
-    ESP_ERROR_CHECK(i2s_channel_init_std_mode(tx_chan, &std_cfg));
-    ESP_ERROR_CHECK(i2s_channel_enable(tx_chan));
-#endif
+    /* DMA buffering is set by the latency profile */
+    const bt_app_latency_params_t *latency = bt_app_latency_get_params();
+
+    s_output = bt_app_output_get();
+    ESP_ERROR_CHECK(s_output->install(latency));
+    /* the DMA sends silence until the I2S task is started */
+    s_i2s_installed = true;
+    s_i2s_sample_rate = 44100;
+    s_i2s_ch_count = 2;
+    s_i2s_dma_desc_num = latency->dma_desc_num;
+    s_i2s_dma_frame_num = latency->dma_frame_num;
 }
 
 void bt_i2s_driver_uninstall(void)
 {
-#ifdef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_INTERNAL_DAC
-    i2s_driver_uninstall(0);
-#else
-    ESP_ERROR_CHECK(i2s_channel_disable(tx_chan));
-    ESP_ERROR_CHECK(i2s_del_channel(tx_chan));
-#endif
+    s_output->uninstall();
+    s_i2s_installed = false;
+}
+
+void bt_i2s_driver_apply_profile(void)
+{
+    const bt_app_latency_params_t *latency = bt_app_latency_get_params();
+
+    if (s_i2s_installed && latency->dma_desc_num == s_i2s_dma_desc_num &&
+        latency->dma_frame_num == s_i2s_dma_frame_num) {
+        return;
+    }
+    if (s_i2s_installed) {
+        bt_i2s_driver_uninstall();
+    }
+    const int64_t start = esp_timer_get_time();
+    bt_i2s_driver_install();
+    ESP_LOGI(BT_AV_TAG, "%s output installed for the %s latency profile in %u us", s_output->name,
+             latency->name, (uint32_t)(esp_timer_get_time() - start));
+}
+
+void bt_i2s_driver_set_format(uint32_t sample_rate, uint8_t ch_count)
+{
+    s_output->set_format(sample_rate, ch_count);
+    s_i2s_sample_rate = sample_rate;
+    s_i2s_ch_count = ch_count;
 }
 
 static void volume_set_by_controller(uint8_t volume)
@@ -291,6 +294,66 @@ static void volume_change_simulation(void *arg)
     }
 }
 
+static void bt_av_log_bass_protect_stats(void)
+{
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_BASS_PROTECT
+    bt_app_bass_protect_stats_t stats;
+    bt_app_bass_protect_get_stats(&stats, true);
+    if (stats.engage_count > 0) {
+        const int reduction_cb = (int)(-200.0 * log10(stats.min_gain / 32768.0));
+        ESP_LOGI(BT_AV_TAG, "Bass protection engaged %u times for %u frames, max reduction %d.%d dB",
+                 stats.engage_count, stats.engaged_frames, reduction_cb / 10, reduction_cb % 10);
+    }
+#endif
+}
+
+static void bt_av_log_jitter_stats(void)
+{
+    bt_app_jitter_stats_t stats;
+    bt_app_jitter_get_stats(&stats, true);
+    ESP_LOGI(BT_AV_TAG, "Jitter buffer: fill %u..%u ms, pre-fill %u ms, %u underruns, %u low, %u high, %u bytes dropped",
+             stats.min_fill_ms, stats.max_fill_ms, stats.prefill_ms, stats.underrun_count,
+             stats.low_count, stats.high_count, stats.dropped_bytes);
+    bt_i2s_overflow_stats_t overflow;
+    bt_i2s_task_get_overflow_stats(&overflow, true);
+    if (overflow.dropped_oldest || overflow.dropped_newest || overflow.stretched) {
+        ESP_LOGW(BT_AV_TAG, "Ringbuffer overflow: %u bytes dropped oldest, %u bytes dropped newest, %u bytes stretched",
+                 overflow.dropped_oldest, overflow.dropped_newest, overflow.stretched);
+    }
+    if (stats.max_fill_ms > 0) {
+        /* buffered audio plus the DMA descriptors, excluding the codec and the link */
+        const uint32_t dma_ms = s_output->latency() / 10;
+        ESP_LOGI(BT_AV_TAG, "Output latency (%s): %u..%u ms",
+                 bt_app_latency_get_params()->name, stats.min_fill_ms + dma_ms, stats.max_fill_ms + dma_ms);
+    }
+}
+
+static void bt_av_log_dispatch_stats(void)
+{
+    static const char *lane_str[BT_APP_LANE_NUM] = {"control", "info"};
+    for (int lane = 0; lane < BT_APP_LANE_NUM; lane++) {
+        bt_app_lane_stats_t stats;
+        bt_app_work_get_lane_stats(lane, &stats, true);
+        if (stats.dropped) {
+            ESP_LOGW(BT_AV_TAG, "Dispatch %s lane: %u events, %u coalesced, depth %u max %u, %u dropped",
+                     lane_str[lane], stats.dispatched, stats.coalesced, stats.depth, stats.max_depth,
+                     stats.dropped);
+        } else {
+            ESP_LOGI(BT_AV_TAG, "Dispatch %s lane: %u events, %u coalesced, depth %u max %u",
+                     lane_str[lane], stats.dispatched, stats.coalesced, stats.depth, stats.max_depth);
+        }
+    }
+    bt_app_param_pool_stats_t pool;
+    bt_app_work_get_pool_stats(&pool, true);
+    if (pool.exhausted || pool.heap) {
+        ESP_LOGW(BT_AV_TAG, "Dispatch pool: %u blocks high-water, %u dispatches failed, %u from heap",
+                 pool.high_water, pool.exhausted, pool.heap);
+    } else {
+        ESP_LOGI(BT_AV_TAG, "Dispatch pool: %u blocks high-water", pool.high_water);
+    }
+    bt_app_event_stats_log();
+}
+
 static void bt_av_hdl_a2d_evt(uint16_t event, void *p_param)
 {
     ESP_LOGD(BT_AV_TAG, "%s event: %d", __func__, event);
@@ -306,13 +369,19 @@ static void bt_av_hdl_a2d_evt(uint16_t event, void *p_param)
             s_a2d_conn_state_str[a2d->conn_stat.state], bda[0], bda[1], bda[2], bda[3], bda[4], bda[5]);
         if (a2d->conn_stat.state == ESP_A2D_CONNECTION_STATE_DISCONNECTED) {
             esp_bt_gap_set_scan_mode(ESP_BT_CONNECTABLE, ESP_BT_GENERAL_DISCOVERABLE);
+            /* the output stays installed and idles silently until the next connection */
             bt_i2s_task_shut_down();
-            bt_i2s_driver_uninstall();
+            bt_app_latency_lock(false);
+        #ifdef CONFIG_EXAMPLE_A2DP_SINK_DELAY_REPORT
+            bt_app_delay_set_peer_support(false);
+        #endif
         } else if (a2d->conn_stat.state == ESP_A2D_CONNECTION_STATE_CONNECTED){
             esp_bt_gap_set_scan_mode(ESP_BT_NON_CONNECTABLE, ESP_BT_NON_DISCOVERABLE);
             bt_i2s_task_start_up();
         } else if (a2d->conn_stat.state == ESP_A2D_CONNECTION_STATE_CONNECTING) {
-            bt_i2s_driver_install();
+            /* DMA buffering is set by the latency profile, locked until disconnected */
+            bt_app_latency_lock(true);
+            bt_i2s_driver_apply_profile();
         }
         break;
     }
@@ -323,6 +392,16 @@ static void bt_av_hdl_a2d_evt(uint16_t event, void *p_param)
         s_audio_state = a2d->audio_stat.state;
         if (ESP_A2D_AUDIO_STATE_STARTED == a2d->audio_stat.state) {
             s_pkt_cnt = 0;
+        #ifdef CONFIG_EXAMPLE_A2DP_SINK_DELAY_REPORT
+            bt_app_delay_start();
+        #endif
+            bt_i2s_task_fade_in();
+        } else {
+            /* fades out what is left in the ringbuffer */
+            bt_i2s_task_fade_out();
+            bt_av_log_bass_protect_stats();
+            bt_av_log_jitter_stats();
+            bt_av_log_dispatch_stats();
         }
         break;
     }
@@ -352,25 +431,39 @@ static void bt_av_hdl_a2d_evt(uint16_t event, void *p_param)
             if (oct0 & (0x01 << 3)) {
                 ch_count = 1;
             }
+            /* a SBC frame holds block length times subbands samples per channel */
+            char oct1 = a2d->audio_cfg.mcc.cie.sbc[1];
+            int block_len = 16;
+            if (oct1 & (0x01 << 7)) {
+                block_len = 4;
+            } else if (oct1 & (0x01 << 6)) {
+                block_len = 8;
+            } else if (oct1 & (0x01 << 5)) {
+                block_len = 12;
+            }
+            int codec_frame_len = block_len * ((oct1 & (0x01 << 3)) ? 4 : 8);
+            /* silence the output before touching the clock configuration, which
+               is only changed if the stream format differs from the current one */
+            bt_i2s_task_drain();
+            if ((uint32_t)sample_rate != s_i2s_sample_rate || ch_count != s_i2s_ch_count) {
+                bt_i2s_driver_set_format(sample_rate, ch_count);
+            }
         #ifdef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_INTERNAL_DAC
-            i2s_set_clk(0, sample_rate, 16, ch_count);
-        #else
-            i2s_channel_disable(tx_chan);
-            i2s_std_clk_config_t clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(sample_rate);
-#ifdef CONFIG_SOC_I2S_SUPPORTS_APLL
-            clk_cfg.clk_src = I2S_CLK_SRC_APLL;
-#endif
-            i2s_std_slot_config_t slot_cfg = I2S_STD_MSB_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT, ch_count);
-            i2s_channel_reconfig_std_clock(tx_chan, &clk_cfg);
-            i2s_channel_reconfig_std_slot(tx_chan, &slot_cfg);
-            i2s_channel_enable(tx_chan);
+            bt_app_dac_output_set_format(ch_count);
         #endif
             ESP_LOGD(BT_AV_TAG, "Configure audio player: %x-%x-%x-%x",
                      a2d->audio_cfg.mcc.cie.sbc[0],
                      a2d->audio_cfg.mcc.cie.sbc[1],
                      a2d->audio_cfg.mcc.cie.sbc[2],
                      a2d->audio_cfg.mcc.cie.sbc[3]);
+            bt_app_vc_set_format(sample_rate, ch_count);
+            bt_i2s_task_set_format(sample_rate, ch_count, codec_frame_len);
+            bt_i2s_task_resume();
+            if (s_audio_state == ESP_A2D_AUDIO_STATE_STARTED) {
+                bt_i2s_task_fade_in();
+            }
             ESP_LOGI(BT_AV_TAG, "Audio player configured, sample rate: %d", sample_rate);
+            bt_app_latency_log(s_output->latency());
         }
         break;
     }
@@ -379,6 +472,10 @@ static void bt_av_hdl_a2d_evt(uint16_t event, void *p_param)
         a2d = (esp_a2d_cb_param_t *)(p_param);
         if (ESP_A2D_INIT_SUCCESS == a2d->a2d_prof_stat.init_state) {
             ESP_LOGD(BT_AV_TAG, "A2DP PROF STATE: Init Complete");
+            /* install the output once, it is kept across connections */
+            if (!s_i2s_installed) {
+                bt_i2s_driver_install();
+            }
         } else {
             ESP_LOGD(BT_AV_TAG, "A2DP PROF STATE: Deinit Complete");
         }
@@ -393,6 +490,9 @@ static void bt_av_hdl_a2d_evt(uint16_t event, void *p_param)
         } else {
             ESP_LOGI(BT_AV_TAG, "Peer device unsupport delay reporting");
         }
+    #ifdef CONFIG_EXAMPLE_A2DP_SINK_DELAY_REPORT
+        bt_app_delay_set_peer_support(a2d->a2d_psc_cfg_stat.psc_mask & ESP_A2D_PSC_DELAY_RPT);
+    #endif
         break;
     }
     /* when set delay value completed, this event comes */
@@ -409,8 +509,13 @@ static void bt_av_hdl_a2d_evt(uint16_t event, void *p_param)
     case ESP_A2D_SNK_GET_DELAY_VALUE_EVT: {
         a2d = (esp_a2d_cb_param_t *)(p_param);
         ESP_LOGI(BT_AV_TAG, "Get delay report value: delay_value: %u * 1/10 ms", a2d->a2d_get_delay_value_stat.delay_value);
+    #ifdef CONFIG_EXAMPLE_A2DP_SINK_DELAY_REPORT
+        /* Default delay value plus the delay of the output path, updated while playing */
+        bt_app_delay_set_base(a2d->a2d_get_delay_value_stat.delay_value);
+    #else
         /* Default delay value plus delay caused by application layer */
         esp_a2d_sink_set_delay_value(a2d->a2d_get_delay_value_stat.delay_value + APP_DELAY_VALUE);
+    #endif
         break;
     }
     /* others */
@@ -557,6 +662,13 @@ static void bt_av_hdl_avrc_tg_evt(uint16_t event, void *p_param)
  * EXTERNAL FUNCTION DEFINITIONS
  *******************************/
 
+void bt_app_av_name_handlers(void)
+{
+    bt_app_event_stats_set_name(bt_av_hdl_a2d_evt, "a2d");
+    bt_app_event_stats_set_name(bt_av_hdl_avrc_ct_evt, "avrc_ct");
+    bt_app_event_stats_set_name(bt_av_hdl_avrc_tg_evt, "avrc_tg");
+}
+
 void bt_app_a2d_cb(esp_a2d_cb_event_t event, esp_a2d_cb_param_t *param)
 {
     switch (event) {
@@ -592,17 +704,35 @@ void bt_app_a2d_data_cb(const uint8_t *data, uint32_t len)
 void bt_app_rc_ct_cb(esp_avrc_ct_cb_event_t event, esp_avrc_ct_cb_param_t *param)
 {
     switch (event) {
-    case ESP_AVRC_CT_METADATA_RSP_EVT:
+    case ESP_AVRC_CT_CONNECTION_STATE_EVT: {
+        bt_app_work_dispatch(bt_av_hdl_avrc_ct_evt, event, param, sizeof(esp_avrc_ct_cb_param_t), NULL);
+        break;
+    }
+    case ESP_AVRC_CT_METADATA_RSP_EVT: {
+        /* informational, must not hold up connection and volume events */
         bt_app_alloc_meta_buffer(param);
+        if (!bt_app_work_dispatch_lane(BT_APP_LANE_INFO, bt_av_hdl_avrc_ct_evt, event, param,
+                                       sizeof(esp_avrc_ct_cb_param_t), NULL)) {
+            free(param->meta_rsp.attr_text);
+        }
+        break;
+    }
+    case ESP_AVRC_CT_CHANGE_NOTIFY_EVT:
+        /* only the latest play position is of interest; a notification is
+           one-shot and its handler registers for the next one, so the
+           position falls back to the control lane rather than being dropped */
+        if (param->change_ntf.event_id == ESP_AVRC_RN_PLAY_POS_CHANGED &&
+            bt_app_work_dispatch_coalesced(BT_APP_LANE_INFO, bt_av_hdl_avrc_ct_evt, event,
+                                           param->change_ntf.event_id, param, sizeof(esp_avrc_ct_cb_param_t))) {
+            break;
+        }
         /* fall through */
-    case ESP_AVRC_CT_CONNECTION_STATE_EVT:
     case ESP_AVRC_CT_PASSTHROUGH_RSP_EVT:
-    case ESP_AVRC_CT_CHANGE_NOTIFY_EVT:
     case ESP_AVRC_CT_REMOTE_FEATURES_EVT:
-    case ESP_AVRC_CT_GET_RN_CAPABILITIES_RSP_EVT: {
+    case ESP_AVRC_CT_GET_RN_CAPABILITIES_RSP_EVT:
+        /* each of these leads to a registration or a command and is sent once */
         bt_app_work_dispatch(bt_av_hdl_avrc_ct_evt, event, param, sizeof(esp_avrc_ct_cb_param_t), NULL);
         break;
-    }
     default:
         ESP_LOGW(BT_RC_CT_TAG, "Invalid AVRC event: %d", event);
         break;
@@ -612,11 +742,15 @@ void bt_app_rc_ct_cb(esp_avrc_ct_cb_event_t event, esp_avrc_ct_cb_param_t *param
 void bt_app_rc_tg_cb(esp_avrc_tg_cb_event_t event, esp_avrc_tg_cb_param_t *param)
 {
     switch (event) {
+    case ESP_AVRC_TG_SET_ABSOLUTE_VOLUME_CMD_EVT:
+        /* a volume slider sends a burst of commands, only the latest is applied */
+        bt_app_work_dispatch_coalesced(BT_APP_LANE_CONTROL, bt_av_hdl_avrc_tg_evt, event, 0, param,
+                                       sizeof(esp_avrc_tg_cb_param_t));
+        break;
     case ESP_AVRC_TG_CONNECTION_STATE_EVT:
-    case ESP_AVRC_TG_REMOTE_FEATURES_EVT:
     case ESP_AVRC_TG_PASSTHROUGH_CMD_EVT:
-    case ESP_AVRC_TG_SET_ABSOLUTE_VOLUME_CMD_EVT:
     case ESP_AVRC_TG_REGISTER_NOTIFICATION_EVT:
+    case ESP_AVRC_TG_REMOTE_FEATURES_EVT:
     case ESP_AVRC_TG_SET_PLAYER_APP_VALUE_EVT:
         bt_app_work_dispatch(bt_av_hdl_avrc_tg_evt, event, param, sizeof(esp_avrc_tg_cb_param_t), NULL);
         break;
@@ -16,6 +16,11 @@
 #define BT_RC_TG_TAG    "RC_TG"
 #define BT_RC_CT_TAG    "RC_CT"
 
+/**
+ * @brief  names the event handlers in the event timing statistics
+ */
+void bt_app_av_name_handlers(void);
+
 /**
  * @brief  callback function for A2DP sink
  *
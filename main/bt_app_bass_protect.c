@@ -0,0 +1,217 @@
+/*
+ * Dynamic bass excursion protection.
+ *
+ * The input is split by a lowpass (two cascaded one-pole sections) into a
+ * low band and the remainder. When the peak envelope of the low band
+ * exceeds the threshold, only the low band is attenuated:
+ *
+ * output = input - (1 - gain) * low
+ *
+ * With unity gain the output is bit-identical to the input, so the stage
+ * is transparent until it engages.
+ *
+ * The threshold is defined at the output (after volume adjustment) where
+ * it corresponds to a cone excursion. It is precomputed at the input scale
+ * for each volume level, so no volume-dependent math is needed per sample.
+ * At volume levels where the low band cannot reach the threshold, the
+ * stage is skipped entirely.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "sdkconfig.h"
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_BASS_PROTECT
+
+#include "bt_app_bass_protect.h"
+#include "esp_log.h"
+
+#define MAX_LEVELS 128
+#define MAX_CHANNELS 2
+
+/* filter state and envelope carry extra fractional bits */
+#define EXTRA_BITS 8
+#define COEF_BITS 30
+#define GAIN_BITS 15
+#define GAIN_UNITY (1 << GAIN_BITS)
+/* the gain is updated every CONTROL_FRAMES and ramped in between */
+#define CONTROL_FRAMES 32
+/* envelope release time constant is 2^RELEASE_SHIFT frames (~93 ms at 44.1 kHz) */
+#define RELEASE_SHIFT 12
+#define THRESHOLD_DISABLED INT32_MAX
+
+static const char TAG[] = "BASSPROT";
+
+/* input thresholds per volume level, in sample units << EXTRA_BITS */
+static int32_t thresholds[MAX_LEVELS];
+static volatile int32_t threshold = THRESHOLD_DISABLED;
+
+static uint8_t channels = 2;
+static int32_t lp_coef = 0;
+
+/* processing state, only touched by the audio task */
+static bool active = false;
+static int32_t lp1[MAX_CHANNELS];
+static int32_t lp2[MAX_CHANNELS];
+static int32_t envelope = 0;
+static int32_t gain = GAIN_UNITY;
+static int32_t gain_step = 0;
+static unsigned int control_left = 0;
+
+static bt_app_bass_protect_stats_t stats = { .min_gain = GAIN_UNITY };
+
+
+static void reset_state(void)
+{
+    memset(lp1, 0, sizeof(lp1));
+    memset(lp2, 0, sizeof(lp2));
+    envelope = 0;
+    gain = GAIN_UNITY;
+    gain_step = 0;
+    control_left = 0;
+}
+
+void bt_app_bass_protect_init(const uint16_t *gains, unsigned int levels, unsigned int scale_bits)
+{
+    const double out_threshold =
+        pow(10.0, CONFIG_EXAMPLE_A2DP_SINK_BASS_PROTECT_THRESHOLD_DB / 20.0) * INT16_MAX;
+    for (unsigned int level = 0; level < levels && level < MAX_LEVELS; level++)
+    {
+        /* input level which reaches the output threshold at this volume */
+        const double in_threshold = (gains[level] > 0) ?
+            out_threshold * (1 << scale_bits) / gains[level] : INFINITY;
+        thresholds[level] = (in_threshold < INT16_MAX) ?
+            (int32_t)(in_threshold * (1 << EXTRA_BITS)) : THRESHOLD_DISABLED;
+        ESP_LOGD(TAG, "threshold[%d] = %d\n", level, thresholds[level]);
+    }
+}
+
+void bt_app_bass_protect_set_format(uint32_t sample_rate, uint8_t ch_count)
+{
+    channels = (ch_count > 0 && ch_count <= MAX_CHANNELS) ? ch_count : MAX_CHANNELS;
+    const double coef =
+        1.0 - exp(-2.0 * M_PI * CONFIG_EXAMPLE_A2DP_SINK_BASS_PROTECT_FREQ / sample_rate);
+    lp_coef = (int32_t)(coef * (1 << COEF_BITS));
+    reset_state();
+}
+
+void bt_app_bass_protect_set_level(unsigned int level)
+{
+    threshold = thresholds[(level < MAX_LEVELS) ? level : (MAX_LEVELS - 1)];
+}
+
+static inline int32_t lowpass(int32_t *state, int32_t in)
+{
+    *state += (int32_t)(((int64_t)lp_coef * (in - *state)) >> COEF_BITS);
+    return *state;
+}
+
+/* compute the gain ramp for the next CONTROL_FRAMES frames */
+static void update_gain(int32_t thr)
+{
+    int32_t target = GAIN_UNITY;
+    if (envelope > thr)
+    {
+        target = ((thr >> EXTRA_BITS) << GAIN_BITS) / (envelope >> EXTRA_BITS);
+        if (gain == GAIN_UNITY)
+        {
+            stats.engage_count++;
+        }
+        if (target < stats.min_gain)
+        {
+            stats.min_gain = target;
+        }
+    }
+    gain_step = (target - gain) / CONTROL_FRAMES;
+    control_left = CONTROL_FRAMES;
+    if (gain_step == 0)
+    {
+        gain = target;
+    }
+}
+
+bool bt_app_bass_protect_process(const int16_t *in, int16_t *out, size_t frame_cnt)
+{
+    const int32_t thr = threshold;
+
+    if (thr == THRESHOLD_DISABLED)
+    {
+        active = false;
+        return false;
+    }
+    if (!active)
+    {
+        /* output equals input at unity gain, so starting from scratch is seamless */
+        reset_state();
+        active = true;
+    }
+
+    while (frame_cnt)
+    {
+        int32_t low[MAX_CHANNELS];
+        int32_t peak = 0;
+        for (unsigned int ch = 0; ch < channels; ch++)
+        {
+            const int32_t sample = (int32_t)in[ch] * (1 << EXTRA_BITS);
+            low[ch] = lowpass(&lp2[ch], lowpass(&lp1[ch], sample));
+            const int32_t mag = (low[ch] < 0) ? -low[ch] : low[ch];
+            peak = (mag > peak) ? mag : peak;
+        }
+
+        /* instant attack, exponential release */
+        if (peak > envelope)
+        {
+            envelope = peak;
+        }
+        else
+        {
+            envelope -= envelope >> RELEASE_SHIFT;
+        }
+
+        if (control_left == 0)
+        {
+            update_gain(thr);
+        }
+        control_left -= 1;
+        if (control_left > 0)
+        {
+            gain += gain_step;
+        }
+
+        if (gain < GAIN_UNITY)
+        {
+            stats.engaged_frames++;
+            for (unsigned int ch = 0; ch < channels; ch++)
+            {
+                const int32_t reduction = (int32_t)(((int64_t)(GAIN_UNITY - gain) * low[ch])
+                                                    >> (GAIN_BITS + EXTRA_BITS));
+                int32_t sample = (int32_t)in[ch] - reduction;
+                sample = (sample > INT16_MAX) ? INT16_MAX : ((sample < INT16_MIN) ? INT16_MIN : sample);
+                out[ch] = (int16_t)sample;
+            }
+        }
+        else
+        {
+            for (unsigned int ch = 0; ch < channels; ch++)
+            {
+                out[ch] = in[ch];
+            }
+        }
+        in += channels;
+        out += channels;
+        frame_cnt -= 1;
+    }
+    return true;
+}
+
+void bt_app_bass_protect_get_stats(bt_app_bass_protect_stats_t *out, bool reset)
+{
+    *out = stats;
+    if (reset)
+    {
+        memset(&stats, 0, sizeof(stats));
+        stats.min_gain = GAIN_UNITY;
+    }
+}
+
+#endif /* CONFIG_EXAMPLE_A2DP_SINK_BASS_PROTECT */
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+* Statistics on how often and how hard the bass protection engaged.
+*/
+typedef struct {
+    uint32_t engage_count;      /* number of times the low band reduction kicked in */
+    uint32_t engaged_frames;    /* number of frames processed with reduced low band */
+    uint16_t min_gain;          /* lowest low band gain applied, 1 << 15 is unity */
+} bt_app_bass_protect_stats_t;
+
+/*
+* Precomputes the input level thresholds for all volume levels. gains holds
+* the volume gain per level, scaled by 1 << scale_bits.
+*/
+void bt_app_bass_protect_init(const uint16_t *gains, unsigned int levels, unsigned int scale_bits);
+
+/*
+* Sets the stream format, recomputes the crossover filter and resets the state.
+*/
+void bt_app_bass_protect_set_format(uint32_t sample_rate, uint8_t channels);
+
+/*
+* Selects the threshold for the given volume level.
+*/
+void bt_app_bass_protect_set_level(unsigned int level);
+
+/*
+* Reduces the low band of 16 bit input samples (before volume adjustment)
+* where its envelope exceeds the threshold at the current volume level.
+* Input and output may be the same buffer. Returns false without touching
+* the output if the stage is inactive at the current volume level.
+*/
+bool bt_app_bass_protect_process(const int16_t *in, int16_t *out, size_t frame_cnt);
+
+/*
+* Gets and optionally resets the statistics.
+*/
+void bt_app_bass_protect_get_stats(bt_app_bass_protect_stats_t *stats, bool reset);
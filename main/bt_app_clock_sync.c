@@ -0,0 +1,174 @@
+/*
+ * Clock drift compensation.
+ *
+ * The jitter buffer fill level rises by 1 us of audio per second for each
+ * ppm the source runs faster than the output. The deviation of the fill
+ * level from its target is averaged over each update interval and smoothed
+ * further by an exponential average, then a PI controller computes the
+ * rate correction:
+ *
+ * correction = KP * error + KI * integral(error)
+ *
+ * With the plant being a pure integrator, the loop has a natural frequency
+ * of sqrt(KI) and a damping of KP / (2 * sqrt(KI)). It is tuned slow
+ * (about 0.05 rad/s) so that packet jitter hardly modulates the output
+ * rate. In the steady state the integral term equals the clock offset,
+ * which is what gets reported as the estimate.
+ *
+ * The correction is applied by retuning the APLL for I2S output. The
+ * internal DAC runs from a fixed clock, so the resampling step of the DAC
+ * output stage is adjusted instead. The WAV file and null outputs follow
+ * the source already, only the estimate is kept for them.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sdkconfig.h"
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_CLOCK_SYNC
+
+#include "bt_app_clock_sync.h"
+#include "esp_log.h"
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_INTERNAL_DAC
+#include "bt_app_dac_output.h"
+#elif defined(CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_EXTERNAL_I2S) && defined(CONFIG_SOC_I2S_SUPPORTS_APLL)
+#include "soc/soc_caps.h"
+#include "clk_ctrl_os.h"
+#define CLOCK_SYNC_APLL
+#endif
+
+/* averaging interval of the fill level, in ms of audio played */
+#define UPDATE_MS 100
+/* exponential smoothing of the averaged error, time constant UPDATE_MS << EMA_SHIFT */
+#define EMA_SHIFT 3
+/* KP = 0.07 ppm/us, KI = 2.5e-3 ppm/(us s), scaled to uppm and per update */
+#define KP_UPPM_PER_US 70000
+#define KI_UPPM_PER_US (2500 * UPDATE_MS / 1000)
+#define MAX_UPPM ((int64_t)CONFIG_EXAMPLE_A2DP_SINK_CLOCK_SYNC_MAX_PPM * BT_APP_CLOCK_SYNC_UPPM_PER_PPM)
+#define LOG_INTERVAL_MS 30000
+
+static const char TAG[] = "CLKSYNC";
+
+static uint32_t bytes_per_ms = 176;
+static int64_t error_sum = 0;       /* error in us weighted by bytes consumed */
+static size_t consumed_sum = 0;
+static int32_t error_filt = 0;      /* smoothed error in us */
+static int32_t integral = 0;        /* integral term in uppm */
+static int32_t correction = 0;      /* applied correction in uppm */
+static uint32_t log_countdown = 0;
+
+#ifdef CLOCK_SYNC_APLL
+static uint32_t apll_nominal = 0;
+static uint32_t apll_freq = 0;
+
+/* APLL frequency chosen by the I2S driver for the default MCLK multiple of 256 */
+static uint32_t apll_freq_for_rate(uint32_t sample_rate)
+{
+    const uint32_t mclk = sample_rate * 256;
+    uint32_t mclk_div = SOC_APLL_MIN_HZ / mclk + 1;
+    mclk_div = (mclk_div < 2) ? 2 : mclk_div;
+    return mclk * mclk_div;
+}
+#endif
+
+static int32_t clamp_uppm(int64_t value)
+{
+    if (value > MAX_UPPM)
+    {
+        return (int32_t)MAX_UPPM;
+    }
+    if (value < -MAX_UPPM)
+    {
+        return (int32_t)-MAX_UPPM;
+    }
+    return (int32_t)value;
+}
+
+static void apply_correction(int32_t uppm)
+{
+#ifdef CLOCK_SYNC_APLL
+    if (apll_nominal == 0)
+    {
+        return;
+    }
+    const uint32_t freq = apll_nominal + (int32_t)(((int64_t)apll_nominal * uppm) /
+                                                   ((int64_t)BT_APP_CLOCK_SYNC_UPPM_PER_PPM * 1000000));
+    if (freq != apll_freq)
+    {
+        uint32_t real_freq = 0;
+        if (periph_rtc_apll_freq_set(freq, &real_freq) == ESP_OK)
+        {
+            apll_freq = freq;
+        }
+    }
+#elif defined(CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_INTERNAL_DAC)
+    bt_app_dac_output_set_correction(uppm);
+#endif
+    correction = uppm;
+}
+
+void bt_app_clock_sync_reset(void)
+{
+    error_sum = 0;
+    consumed_sum = 0;
+    error_filt = 0;
+    integral = 0;
+    log_countdown = 0;
+    apply_correction(0);
+}
+
+void bt_app_clock_sync_set_format(uint32_t sample_rate, uint8_t channels)
+{
+    bytes_per_ms = sample_rate * channels * sizeof(int16_t) / 1000;
+    if (bytes_per_ms == 0)
+    {
+        bytes_per_ms = 1;
+    }
+    error_sum = 0;
+    consumed_sum = 0;
+    error_filt = 0;
+#ifdef CLOCK_SYNC_APLL
+    apll_nominal = apll_freq_for_rate(sample_rate);
+    apll_freq = apll_nominal;
+#endif
+    /* the drift is a property of the two clocks, keep compensating it */
+    apply_correction(integral);
+}
+
+void bt_app_clock_sync_update(size_t fill, size_t target, size_t consumed)
+{
+    const int32_t error_us = (int32_t)(((int64_t)fill - (int64_t)target) * 1000 / bytes_per_ms);
+    error_sum += (int64_t)error_us * consumed;
+    consumed_sum += consumed;
+    if (consumed_sum < UPDATE_MS * bytes_per_ms)
+    {
+        return;
+    }
+
+    const int32_t error_avg = (int32_t)(error_sum / (int64_t)consumed_sum);
+    error_sum = 0;
+    consumed_sum = 0;
+    error_filt += (error_avg - error_filt) / (1 << EMA_SHIFT);
+
+    integral = clamp_uppm((int64_t)integral + (int64_t)error_filt * KI_UPPM_PER_US);
+    apply_correction(clamp_uppm((int64_t)integral + (int64_t)error_filt * KP_UPPM_PER_US));
+
+    if (log_countdown == 0)
+    {
+        /* in hundredths of a ppm */
+        const int32_t offset = integral / (BT_APP_CLOCK_SYNC_UPPM_PER_PPM / 100);
+        const int32_t applied = correction / (BT_APP_CLOCK_SYNC_UPPM_PER_PPM / 100);
+        log_countdown = LOG_INTERVAL_MS / UPDATE_MS;
+        ESP_LOGI(TAG, "clock offset %c%d.%02d ppm, correction %c%d.%02d ppm, fill error %d us",
+                 (offset < 0) ? '-' : '+', abs(offset) / 100, abs(offset) % 100,
+                 (applied < 0) ? '-' : '+', abs(applied) / 100, abs(applied) % 100, error_filt);
+    }
+    log_countdown--;
+}
+
+int32_t bt_app_clock_sync_get_offset(void)
+{
+    return integral;
+}
+
+#endif /* CONFIG_EXAMPLE_A2DP_SINK_CLOCK_SYNC */
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+* Compensates the drift between the sample clock of the source and the
+* output clock. The fill level of the jitter buffer is filtered and fed
+* to a PI controller, whose output is a rate correction in ppm applied to
+* the APLL feeding the I2S peripheral, or to a fractional resampler in
+* front of the internal DAC.
+*/
+
+/* rate corrections are handled in millionths of a ppm */
+#define BT_APP_CLOCK_SYNC_UPPM_PER_PPM 1000000
+
+/*
+* Clears the controller state including the drift estimate, to be called
+* for a new connection.
+*/
+void bt_app_clock_sync_reset(void);
+
+/*
+* Sets the stream format after the output clock has been configured.
+* Keeps the drift estimate and applies it to the new clock.
+*/
+void bt_app_clock_sync_set_format(uint32_t sample_rate, uint8_t channels);
+
+/*
+* Feeds the jitter buffer fill level and its target after consuming
+* consumed bytes. Updates the correction periodically.
+*/
+void bt_app_clock_sync_update(size_t fill, size_t target, size_t consumed);
+
+/*
+* Returns the estimated clock offset of the source relative to the output
+* in millionths of a ppm, positive if the source is faster.
+*/
+int32_t bt_app_clock_sync_get_offset(void);
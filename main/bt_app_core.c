@@ -10,21 +10,28 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 #include "freertos/xtensa_api.h"
 #include "freertos/FreeRTOSConfig.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_a2dp_api.h"
+#include "esp_avrc_api.h"
 #include "bt_app_core.h"
-#ifdef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_INTERNAL_DAC
-// DAC DMA mode is only supported by the legacy I2S driver, it will be replaced once DAC has its own DMA dirver
-#include "driver/i2s.h"
-#else
-#include "driver/i2s_std.h"
-#endif
-#include "freertos/ringbuf.h"
+#include "esp_cpu.h"
 #include "bt_app_volume_control.h"
+#include "bt_app_output.h"
+#include "bt_app_jitter.h"
+#include "bt_app_clock_sync.h"
+#include "bt_app_xrun.h"
+#include "bt_app_ringbuf.h"
+#include "bt_app_latency.h"
+#include "bt_app_delay.h"
+#include "bt_app_event_stats.h"
 
 /*******************************
  * STATIC FUNCTION DECLARATIONS
@@ -34,8 +41,18 @@
 static void bt_app_task_handler(void *arg);
 /* handler for I2S task */
 static void bt_i2s_task_handler(void *arg);
+/* handler for DSP task */
+static void bt_i2s_dsp_task_handler(void *arg);
 /* message sender */
-static bool bt_app_send_msg(bt_app_msg_t *msg);
+static bool bt_app_send_msg(bt_app_lane_t lane, bt_app_msg_t *msg);
+/* message receiver, from the first lane holding one */
+static bool bt_app_receive_msg(bt_app_msg_t *msg, TickType_t wait);
+/* allocate a block for the parameters of dispatched work */
+static void *bt_app_param_alloc(int len);
+/* release the parameters of dispatched work */
+static void bt_app_param_free(void *param);
+/* stop merging work into a message that is about to be handled */
+static void bt_app_coalesce_release(void *param);
 /* handle dispatched messages */
 static void bt_app_work_dispatched(bt_app_msg_t *msg);
 
@@ -43,36 +60,179 @@ static void bt_app_work_dispatched(bt_app_msg_t *msg);
  * STATIC VARIABLE DEFINITIONS
  ******************************/
 
-static QueueHandle_t s_bt_app_task_queue = NULL;  /* handle of work queue */
+/* parameters of the Bluetooth callbacks, the largest items dispatched */
+typedef union {
+    esp_a2d_cb_param_t a2d;
+    esp_avrc_ct_cb_param_t avrc_ct;
+    esp_avrc_tg_cb_param_t avrc_tg;
+} bt_app_param_block_t;
+
+/* queued work that can be merged with later work of the same kind */
+typedef struct {
+    bt_app_cb_t cb;
+    uint16_t event;
+    uint32_t key;
+    void *param;                /* parameter block of the queued message, NULL if unused */
+} bt_app_coalesce_slot_t;
+
+#define BT_APP_COALESCE_SLOTS       (4)
+
+/* one block for each message queued in any lane and the one being handled */
+#define BT_APP_PARAM_BLOCKS         (BT_APP_TASK_QUEUE_LEN + 1)
+_Static_assert(BT_APP_PARAM_BLOCKS <= 32, "free blocks are tracked in a 32 bit mask");
+
+/* longest the application task sleeps between publishing the event statistics */
+#if CONFIG_EXAMPLE_A2DP_SINK_EVENT_STATS_INTERVAL_MS > 0
+#define BT_APP_STATS_WAIT_TICKS     pdMS_TO_TICKS(CONFIG_EXAMPLE_A2DP_SINK_EVENT_STATS_INTERVAL_MS)
+#else
+#define BT_APP_STATS_WAIT_TICKS     portMAX_DELAY
+#endif
+
+static QueueHandle_t s_bt_app_task_queue[BT_APP_LANE_NUM] = {NULL}; /* lanes of the work queue */
+static SemaphoreHandle_t s_bt_app_task_pending = NULL; /* counts the messages in all lanes */
+static bt_app_lane_stats_t s_lane_stats[BT_APP_LANE_NUM] = {0};
 static TaskHandle_t s_bt_app_task_handle = NULL;  /* handle of application task  */
 static TaskHandle_t s_bt_i2s_task_handle = NULL;  /* handle of I2S task */
-static RingbufHandle_t s_ringbuf_i2s = NULL;     /* handle of ringbuffer for I2S */
-#ifndef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_INTERNAL_DAC
-extern i2s_chan_handle_t tx_chan;
+static TaskHandle_t s_bt_dsp_task_handle = NULL;  /* handle of DSP task */
+static TaskHandle_t s_dsp_stop_waiter = NULL;    /* task waiting for the DSP task to stop */
+static bt_app_ringbuf_handle_t s_ringbuf_i2s = NULL; /* handle of ringbuffer for I2S, processed in place by the DSP task */
+static size_t s_ringbuf_size = 0;                /* size of the ringbuffer in bytes */
+static size_t s_ringbuf_block_size = 0;          /* size of the blocks in the ringbuffer */
+static uint8_t *s_ringbuf_block = NULL;          /* block being filled by the data callback */
+static atomic_bool s_ringbuf_open = false;       /* the data callback may use the ringbuffer */
+static atomic_uint s_ringbuf_writers = 0;        /* data callbacks in write_ringbuf() */
+static size_t s_ringbuf_block_fill = 0;          /* bytes written to the block being filled */
+static size_t s_ringbuf_frame_size = 4;          /* bytes per frame of the stream */
+static uint32_t s_stream_sample_rate = 44100;    /* stream format of the last codec configuration */
+static uint8_t s_stream_ch_count = 2;
+static uint16_t s_stream_frame_len = BT_I2S_BLOCK_FRAMES;
+static atomic_uint s_overflow_dropped_oldest = 0; /* overflow statistics, see bt_i2s_overflow_stats_t */
+static atomic_uint s_overflow_dropped_newest = 0;
+static atomic_uint s_overflow_stretched = 0;
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_OVERFLOW_TIME_STRETCH
+static uint32_t s_stretch_phase = 0;             /* frames copied since the last merge */
 #endif
+static const bt_app_output_t *s_output = NULL;   /* output backend */
+static volatile bool s_i2s_paused = false;       /* I2S task holds off writing to the output */
+static volatile bool s_i2s_prefilling = true;    /* I2S task waits for the jitter buffer pre-fill */
+static bool s_i2s_rebuffering = false;           /* buffering up again after an underrun */
+static TaskHandle_t s_i2s_drain_waiter = NULL;   /* task waiting for a fade to be played out */
+static TaskHandle_t s_i2s_stop_waiter = NULL;    /* task waiting for the I2S task to stop */
+static uint8_t s_i2s_hold_buf[BT_I2S_HOLD_BYTES]; /* fade hold after the stream ran dry */
+static int64_t s_i2s_start_time = 0;             /* start up time, until the first audio is played */
+static SemaphoreHandle_t s_dsp_mutex = NULL;     /* guards the processing chain state */
+static bt_app_param_block_t s_param_pool[BT_APP_PARAM_BLOCKS]; /* parameters of dispatched work */
+static uint32_t s_param_free = (1ULL << BT_APP_PARAM_BLOCKS) - 1; /* bit mask of free blocks */
+static bt_app_param_pool_stats_t s_param_stats = {0};
+static bt_app_coalesce_slot_t s_coalesce[BT_APP_COALESCE_SLOTS] = {0}; /* coalescable work in the queue */
+static portMUX_TYPE s_dispatch_lock = portMUX_INITIALIZER_UNLOCKED; /* work is dispatched from several tasks */
 
 /*******************************
  * STATIC FUNCTION DEFINITIONS
  ******************************/
 
-static bool bt_app_send_msg(bt_app_msg_t *msg)
+static void *bt_app_param_alloc(int len)
+{
+    void *param = NULL;
+
+    if (len > (int)sizeof(bt_app_param_block_t)) {
+        /* not one of the Bluetooth callback parameters */
+        taskENTER_CRITICAL(&s_dispatch_lock);
+        s_param_stats.heap++;
+        taskEXIT_CRITICAL(&s_dispatch_lock);
+        return malloc(len);
+    }
+    taskENTER_CRITICAL(&s_dispatch_lock);
+    if (s_param_free) {
+        const int index = __builtin_ctz(s_param_free);
+        s_param_free &= ~(1U << index);
+        param = &s_param_pool[index];
+        s_param_stats.in_use++;
+        if (s_param_stats.in_use > s_param_stats.high_water) {
+            s_param_stats.high_water = s_param_stats.in_use;
+        }
+    } else {
+        s_param_stats.exhausted++;
+    }
+    taskEXIT_CRITICAL(&s_dispatch_lock);
+    return param;
+}
+
+static void bt_app_param_free(void *param)
 {
-    if (msg == NULL) {
+    const bt_app_param_block_t *block = param;
+
+    if (block < s_param_pool || block >= s_param_pool + BT_APP_PARAM_BLOCKS) {
+        free(param);
+        return;
+    }
+    taskENTER_CRITICAL(&s_dispatch_lock);
+    s_param_free |= 1U << (block - s_param_pool);
+    s_param_stats.in_use--;
+    taskEXIT_CRITICAL(&s_dispatch_lock);
+}
+
+static void bt_app_coalesce_release(void *param)
+{
+    taskENTER_CRITICAL(&s_dispatch_lock);
+    for (int i = 0; i < BT_APP_COALESCE_SLOTS; i++) {
+        if (s_coalesce[i].param == param) {
+            s_coalesce[i].param = NULL;
+        }
+    }
+    taskEXIT_CRITICAL(&s_dispatch_lock);
+}
+
+static bool bt_app_send_msg(bt_app_lane_t lane, bt_app_msg_t *msg)
+{
+    if (msg == NULL || lane >= BT_APP_LANE_NUM) {
         return false;
     }
 
-    /* send the message to work queue */
-    if (xQueueSend(s_bt_app_task_queue, msg, 10 / portTICK_PERIOD_MS) != pdTRUE) {
-        ESP_LOGE(BT_APP_CORE_TAG, "%s xQueue send failed", __func__);
+    /* send the message to work queue, informational work is not worth
+       holding up the Bluetooth stack */
+    const TickType_t wait = (lane == BT_APP_LANE_CONTROL) ? 10 / portTICK_PERIOD_MS : 0;
+    msg->time_us = (uint32_t)esp_timer_get_time();
+    if (xQueueSend(s_bt_app_task_queue[lane], msg, wait) != pdTRUE) {
+        taskENTER_CRITICAL(&s_dispatch_lock);
+        s_lane_stats[lane].dropped++;
+        taskEXIT_CRITICAL(&s_dispatch_lock);
+        ESP_LOGE(BT_APP_CORE_TAG, "%s xQueue send failed, lane %d", __func__, lane);
         return false;
     }
+    const uint32_t depth = uxQueueMessagesWaiting(s_bt_app_task_queue[lane]);
+    taskENTER_CRITICAL(&s_dispatch_lock);
+    s_lane_stats[lane].dispatched++;
+    if (depth > s_lane_stats[lane].max_depth) {
+        s_lane_stats[lane].max_depth = depth;
+    }
+    taskEXIT_CRITICAL(&s_dispatch_lock);
+    xSemaphoreGive(s_bt_app_task_pending);
     return true;
 }
 
+static bool bt_app_receive_msg(bt_app_msg_t *msg, TickType_t wait)
+{
+    /* each message has been counted once, so one of the lanes holds it */
+    if (xSemaphoreTake(s_bt_app_task_pending, wait) != pdTRUE) {
+        return false;
+    }
+    for (int lane = 0; lane < BT_APP_LANE_NUM; lane++) {
+        if (xQueueReceive(s_bt_app_task_queue[lane], msg, 0) == pdTRUE) {
+            return true;
+        }
+    }
+    return false;
+}
+
 static void bt_app_work_dispatched(bt_app_msg_t *msg)
 {
     if (msg->cb) {
+        /* a coalesced message keeps the time of its first dispatch */
+        const uint32_t start = (uint32_t)esp_timer_get_time();
         msg->cb(msg->event, msg->param);
+        bt_app_event_stats_record(msg->cb, msg->event, start - msg->time_us,
+                                  (uint32_t)esp_timer_get_time() - start);
     }
 }
 
@@ -81,10 +241,15 @@ static void bt_app_task_handler(void *arg)
     bt_app_msg_t msg;
 
     for (;;) {
-        /* receive message from work queue and handle it */
-        if (pdTRUE == xQueueReceive(s_bt_app_task_queue, &msg, (TickType_t)portMAX_DELAY)) {
+        /* receive message from work queue and handle it, waking up for
+           the periodic statistics */
+        if (bt_app_receive_msg(&msg, BT_APP_STATS_WAIT_TICKS)) {
             ESP_LOGD(BT_APP_CORE_TAG, "%s, signal: 0x%x, event: 0x%x", __func__, msg.sig, msg.event);
 
+            if (msg.param) {
+                /* later work of the same kind is queued anew from here on */
+                bt_app_coalesce_release(msg.param);
+            }
             switch (msg.sig) {
             case BT_APP_SIG_WORK_DISPATCH:
                 bt_app_work_dispatched(&msg);
@@ -95,23 +260,189 @@ static void bt_app_task_handler(void *arg)
             } /* switch (msg.sig) */
 
             if (msg.param) {
-                free(msg.param);
+                bt_app_param_free(msg.param);
             }
         }
+        bt_app_event_stats_publish();
+    }
+}
+
+/* wait for room in the ringbuffer, rounded up to whole ticks */
+#define BT_I2S_OVERFLOW_WAIT_TICKS \
+    ((TickType_t)((CONFIG_EXAMPLE_A2DP_SINK_OVERFLOW_WAIT_MS * configTICK_RATE_HZ + 999) / 1000))
+
+/* steps of the I2S task waiting for room in the output; when dropping the
+   oldest audio on overflow, short enough to make room within a wait of the
+   data callback */
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_OVERFLOW_DROP_OLDEST
+#define BT_I2S_WRITE_WAIT_TICKS     (BT_I2S_OVERFLOW_WAIT_TICKS ? BT_I2S_OVERFLOW_WAIT_TICKS : 1)
+#else
+#define BT_I2S_WRITE_WAIT_TICKS     pdMS_TO_TICKS(BT_I2S_IDLE_WAIT_MS)
+#endif
+
+/* core affinity from the configuration */
+#if defined(CONFIG_FREERTOS_UNICORE)
+#define BT_TASK_CORE(core) (0)
+#else
+#define BT_TASK_CORE(core) (((core) < 0) ? tskNO_AFFINITY : (core))
+#endif
+
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_PROFILE_DSP
+/* bytes written by the I2S task, by the output copy and fade hold */
+static uint32_t s_prof_i2s_copied = 0;
+#define BT_I2S_COUNT_COPY(bytes) (s_prof_i2s_copied += (bytes))
+
+/* accumulate processing cycles and audio data copies, size is the number of
+   input bytes; called in the context of the DSP task */
+static void bt_i2s_profile_dsp(uint32_t cycles, size_t size)
+{
+    static uint32_t s_cycles = 0;
+    static uint32_t s_bytes = 0;
+    static uint32_t s_i2s_copied_base = 0;
+    static TickType_t s_last_log = 0;
+
+    s_cycles += cycles;
+    s_bytes += size;
+    const TickType_t now = xTaskGetTickCount();
+    if ((now - s_last_log) >= pdMS_TO_TICKS(CONFIG_EXAMPLE_A2DP_SINK_PROFILE_DSP_INTERVAL_MS)) {
+        const uint32_t samples = s_bytes / sizeof(int16_t);
+        /* the data callback copies each byte once and the processing pass works in place,
+           with the output copy that is 2 bytes per audio byte, as with processing in the
+           data callback */
+        const uint32_t copied = s_bytes + (s_prof_i2s_copied - s_i2s_copied_base);
+        if (samples > 0) {
+            ESP_LOGI(BT_APP_CORE_TAG, "DSP: %u samples, %u.%02u cycles/sample, %u.%02u bytes copied per audio byte",
+                     samples, s_cycles / samples, (s_cycles % samples) * 100 / samples,
+                     copied / s_bytes, (copied % s_bytes) * 100 / s_bytes);
+        }
+        s_cycles = 0;
+        s_bytes = 0;
+        s_i2s_copied_base = s_prof_i2s_copied;
+        s_last_log = now;
+    }
+}
+
+/* wakeups of the I2S task in its loop; the output backend counts the
+   wakeups on room in the output and their delay from the interrupt */
+static uint32_t s_prof_wakeups = 0;
+#define BT_I2S_COUNT_WAKEUP() (s_prof_wakeups++)
+
+/* log the wakeup statistics of the I2S task; called in its context */
+static void bt_i2s_profile_writer(void)
+{
+    static TickType_t s_last_log = 0;
+
+    const TickType_t now = xTaskGetTickCount();
+    const uint32_t elapsed_ms = (now - s_last_log) * portTICK_PERIOD_MS;
+    if (elapsed_ms >= CONFIG_EXAMPLE_A2DP_SINK_PROFILE_DSP_INTERVAL_MS) {
+        bt_app_output_wakeups_t dma = {0};
+        if (s_output->get_wakeups) {
+            s_output->get_wakeups(&dma, true);
+        }
+        const uint32_t avg = dma.count ? dma.latency_sum_us / dma.count : 0;
+        ESP_LOGI(BT_APP_CORE_TAG, "I2S task: %u wakeups/s, %u on DMA sent, latency avg %u us, max %u us",
+                 (s_prof_wakeups + dma.count) * 1000 / elapsed_ms, dma.count * 1000 / elapsed_ms,
+                 avg, dma.latency_max_us);
+        s_prof_wakeups = 0;
+        s_last_log = now;
+    }
+}
+#else
+#define BT_I2S_COUNT_COPY(bytes)
+#define BT_I2S_COUNT_WAKEUP()
+#endif
+
+/* run the processing chain, the processing state is shared between the DSP
+   task and the I2S task (fades after the stream ran dry) */
+static void bt_i2s_process(const uint8_t *in, uint8_t *out, size_t size)
+{
+    xSemaphoreTake(s_dsp_mutex, portMAX_DELAY);
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_PROFILE_DSP
+    const uint32_t start = esp_cpu_get_cycle_count();
+    bt_app_adjust_volume(in, out, size);
+    bt_i2s_profile_dsp(esp_cpu_get_cycle_count() - start, size);
+#else
+    bt_app_adjust_volume(in, out, size);
+#endif
+    xSemaphoreGive(s_dsp_mutex);
+}
+
+/* write processed data to the output, waiting for room in steps so that a
+   pause is noticed; when dropping the oldest audio on overflow, it also
+   gives up while the ringbuffer is about full, the caller then drops the
+   rest to make room for the data callback */
+static size_t bt_i2s_write(const uint8_t *data, size_t size)
+{
+    size_t bytes_written = 0;
+
+    while (bytes_written < size && !s_i2s_paused) {
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_OVERFLOW_DROP_OLDEST
+        if (bt_app_ringbuf_level(s_ringbuf_i2s) + 1 >= bt_app_ringbuf_block_cnt(s_ringbuf_i2s)) {
+            break;
+        }
+#endif
+        bytes_written += s_output->write(data + bytes_written, size - bytes_written, BT_I2S_WRITE_WAIT_TICKS);
     }
+    BT_I2S_COUNT_COPY(bytes_written);
+    return bytes_written;
 }
 
-#ifdef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_INTERNAL_DAC
-/* not sure if this is still needed as of ESP-IDF 5.0 */
-static void bt_i2s_convert_for_internal_dac(int16_t *data, size_t len)
+/* write the fade hold to the output; it does not come from the ringbuffer,
+   so it never gives up to make room for the data callback */
+static size_t bt_i2s_write_hold(const uint8_t *data, size_t size)
 {
-    uint16_t *dt = (uint16_t *)data;
-    size_t count = len / 2;
-    while (count)
-    {
-        *dt += 0x8000U;
-        dt++;
-        count--;
+    size_t bytes_written = 0;
+
+    while (bytes_written < size && !s_i2s_paused) {
+        bytes_written += s_output->write(data + bytes_written, size - bytes_written,
+                                         pdMS_TO_TICKS(BT_I2S_IDLE_WAIT_MS));
+    }
+    BT_I2S_COUNT_COPY(bytes_written);
+    return bytes_written;
+}
+
+/* start the output with its DMA descriptors loaded from the ringbuffer, so
+   that it starts with full descriptors rather than one block ahead of the
+   DMA; only the first start after install or set_format can preload, later
+   the audio is written as usual */
+static void bt_i2s_preload(void)
+{
+    uint8_t *data = NULL;
+    uint32_t count = 0;
+    size_t size = 0;
+    size_t loaded = 0;
+
+    while ((data = bt_app_ringbuf_read_acquire(s_ringbuf_i2s, &count, 0)) != NULL) {
+        count = (count < BT_I2S_MAX_SPAN_BLOCKS) ? count : BT_I2S_MAX_SPAN_BLOCKS;
+        size = count * s_ringbuf_block_size;
+        bt_app_vc_apply_output_fade(data, size);
+        loaded = s_output->preload(data, size);
+        BT_I2S_COUNT_COPY(loaded);
+        if (loaded < size) {
+            break;
+        }
+        bt_app_ringbuf_read_release(s_ringbuf_i2s, count);
+        bt_app_jitter_consumed(size);
+    }
+    if (data != NULL) {
+        /* the descriptors are full, the output starts with the rest of the span */
+        bt_i2s_write(data + loaded, size - loaded);
+        bt_app_ringbuf_read_release(s_ringbuf_i2s, count);
+        bt_app_jitter_consumed(size);
+    }
+}
+
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_JITTER_DROP_ON_HIGH
+/* drop the oldest blocks to bring the fill level back to the pre-fill target */
+static void bt_i2s_drop_excess(void)
+{
+    uint32_t count = 0;
+
+    while (bt_app_jitter_excess() > 0 &&
+           bt_app_ringbuf_read_acquire(s_ringbuf_i2s, &count, 0) != NULL) {
+        bt_app_ringbuf_read_release(s_ringbuf_i2s, 1);
+        bt_app_jitter_consumed(s_ringbuf_block_size);
+        bt_app_jitter_dropped(s_ringbuf_block_size);
     }
 }
 #endif
@@ -119,24 +450,236 @@ static void bt_i2s_convert_for_internal_dac(int16_t *data, size_t len)
 static void bt_i2s_task_handler(void *arg)
 {
     uint8_t *data = NULL;
+    uint32_t count = 0;
     size_t item_size = 0;
     size_t bytes_written = 0;
+    size_t drain_tail = 0;
 
     for (;;) {
-        /* receive data from ringbuffer and write it to I2S DMA transmit buffer */
-        data = (uint8_t *)xRingbufferReceive(s_ringbuf_i2s, &item_size, (TickType_t)portMAX_DELAY);
-        if (item_size != 0){
-            bt_app_adjust_volume(data, item_size);
-#ifdef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_INTERNAL_DAC
-            /* not sure if this is still needed as of ESP-IDF 5.0 */
-            bt_i2s_convert_for_internal_dac(data, item_size);
-            i2s_write(0, data, item_size, &bytes_written, portMAX_DELAY);
-#else
-            i2s_channel_write(tx_chan, data, item_size, &bytes_written, portMAX_DELAY);
+        /* exit only here, where the task neither holds the processing chain
+           nor waits on the output */
+        TaskHandle_t stop_waiter = s_i2s_stop_waiter;
+        if (stop_waiter) {
+            bt_app_xrun_set_active(false);
+            s_i2s_stop_waiter = NULL;
+            xTaskNotifyGive(stop_waiter);
+            vTaskDelete(NULL);
+        }
+
+        bt_app_xrun_publish();
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_PROFILE_DSP
+        bt_i2s_profile_writer();
+#endif
+        BT_I2S_COUNT_WAKEUP();
+        if (s_i2s_paused) {
+            bt_app_xrun_set_active(false);
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        TaskHandle_t drain_waiter = s_i2s_drain_waiter;
+        const bool output_fading_out = bt_app_vc_output_fading_out();
+        const bool fading_out = bt_app_vc_fading_out() || output_fading_out;
+        const bool hold = fading_out || drain_waiter;
+
+        if (s_i2s_prefilling && !output_fading_out && bt_app_jitter_prefilled()) {
+            ESP_LOGD(BT_APP_CORE_TAG, "pre-fill reached");
+            s_i2s_prefilling = false;
+            if (s_i2s_start_time) {
+                ESP_LOGI(BT_APP_CORE_TAG, "first audio %u ms after connection",
+                         (uint32_t)((esp_timer_get_time() - s_i2s_start_time) / 1000));
+                s_i2s_start_time = 0;
+            }
+            if (s_i2s_rebuffering) {
+                /* the audio buffered up was processed at the stream level,
+                   fade it in where the underrun faded out; the output kept
+                   running and is not restarted */
+                s_i2s_rebuffering = false;
+                bt_app_vc_start_output_fade(true, CONFIG_EXAMPLE_A2DP_SINK_FADE_MS);
+            } else if (!hold && s_output->preload) {
+                bt_i2s_preload();
+            }
+            bt_app_xrun_set_active(true);
+        }
+
+        /* receive processed data from ringbuffer and write it to the output */
+        data = NULL;
+        if (!s_i2s_prefilling) {
+            data = bt_app_ringbuf_read_acquire(s_ringbuf_i2s, &count,
+                                               hold ? 0 : pdMS_TO_TICKS(BT_I2S_IDLE_WAIT_MS));
+        }
+        if (data != NULL) {
+            /* write contiguous blocks at once, but release them soon enough
+               for the data callback not to run out of space */
+            count = (count < BT_I2S_MAX_SPAN_BLOCKS) ? count : BT_I2S_MAX_SPAN_BLOCKS;
+            item_size = count * s_ringbuf_block_size;
+            bt_app_vc_apply_output_fade(data, item_size);
+            bytes_written = bt_i2s_write(data, item_size);
+            bt_app_ringbuf_read_release(s_ringbuf_i2s, count);
+            bt_app_jitter_consumed(item_size);
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_OVERFLOW_DROP_OLDEST
+            if (bytes_written < item_size && !s_i2s_paused) {
+                /* the output stalled, the oldest audio made room for the data callback */
+                atomic_fetch_add(&s_overflow_dropped_oldest, item_size - bytes_written);
+            }
+#endif
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_CLOCK_SYNC
+            bt_app_clock_sync_update(bt_app_jitter_fill(), bt_app_jitter_target(), item_size);
+#endif
+            if (bt_app_jitter_check() == BT_APP_JITTER_HIGH) {
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_JITTER_DROP_ON_HIGH
+                bt_i2s_drop_excess();
+#endif
+            }
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_DELAY_REPORT
+            bt_app_delay_update();
 #endif
-            vRingbufferReturnItem(s_ringbuf_i2s, (void *)data);
+        } else if (hold) {
+            /* stream ran dry, keep the fade going on the last frame received */
+            item_size = sizeof(s_i2s_hold_buf);
+            bt_app_vc_fill_hold(s_i2s_hold_buf, item_size);
+            BT_I2S_COUNT_COPY(item_size);
+            bt_i2s_process(s_i2s_hold_buf, s_i2s_hold_buf, item_size);
+            bt_app_vc_apply_output_fade(s_i2s_hold_buf, item_size);
+            bytes_written = bt_i2s_write_hold(s_i2s_hold_buf, item_size);
+        } else if (s_i2s_prefilling) {
+            /* woken up by the data callback once the pre-fill is reached */
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(BT_I2S_IDLE_WAIT_MS));
+            continue;
+        } else {
+            if (!bt_app_vc_muted()) {
+                /* underrun while playing, fade out on the last frame and buffer
+                   up again; the fade is applied at the output so that the
+                   audio processed meanwhile keeps its level */
+                ESP_LOGW(BT_APP_CORE_TAG, "underrun, fill level %d", bt_app_jitter_fill());
+                bt_app_xrun_record(BT_APP_XRUN_RING_EMPTY);
+                bt_app_jitter_underrun();
+                bt_app_vc_start_output_fade(false, CONFIG_EXAMPLE_A2DP_SINK_FADE_MS);
+                s_i2s_rebuffering = true;
+            }
+            s_i2s_prefilling = true;
+            bt_app_xrun_set_active(false);
+            continue;
+        }
+
+        if (drain_waiter && !fading_out) {
+            /* fade is complete, push it out of the DMA buffers with silence */
+            drain_tail += bytes_written;
+            if (drain_tail >= BT_I2S_DMA_BUF_BYTES(bt_app_latency_get_params())) {
+                drain_tail = 0;
+                s_i2s_paused = true;
+                s_i2s_drain_waiter = NULL;
+                xTaskNotifyGive(drain_waiter);
+            }
+        }
+    }
+}
+
+static void bt_i2s_dsp_task_handler(void *arg)
+{
+    uint8_t *data = NULL;
+    uint32_t count = 0;
+
+    for (;;) {
+        TaskHandle_t stop_waiter = s_dsp_stop_waiter;
+        if (stop_waiter) {
+            s_dsp_stop_waiter = NULL;
+            xTaskNotifyGive(stop_waiter);
+            vTaskDelete(NULL);
+        }
+
+        /* process the blocks from the data callback in place and pass them on to the I2S task */
+        if ((data = bt_app_ringbuf_process_acquire(s_ringbuf_i2s, &count, pdMS_TO_TICKS(BT_I2S_IDLE_WAIT_MS))) == NULL) {
+            continue;
+        }
+        bt_i2s_process(data, data, count * s_ringbuf_block_size);
+        bt_app_ringbuf_process_commit(s_ringbuf_i2s, count);
+    }
+}
+
+static void bt_i2s_dsp_task_start(void)
+{
+    xTaskCreatePinnedToCore(bt_i2s_dsp_task_handler, "BtDspTask", CONFIG_EXAMPLE_A2DP_SINK_DSP_TASK_STACK, NULL,
+                            CONFIG_EXAMPLE_A2DP_SINK_DSP_TASK_PRIORITY, &s_bt_dsp_task_handle,
+                            BT_TASK_CORE(CONFIG_EXAMPLE_A2DP_SINK_DSP_TASK_CORE));
+}
+
+/* stop the DSP task once it is not holding the processing chain or the ringbuffer */
+static void bt_i2s_dsp_task_stop(void)
+{
+    if (!s_bt_dsp_task_handle) {
+        return;
+    }
+    s_dsp_stop_waiter = xTaskGetCurrentTaskHandle();
+    while (s_dsp_stop_waiter) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(BT_I2S_IDLE_WAIT_MS));
+    }
+    s_bt_dsp_task_handle = NULL;
+}
+
+/* let the data callback into the ringbuffer */
+static void bt_i2s_ringbuf_open(void)
+{
+    atomic_store(&s_ringbuf_open, true);
+}
+
+/* keep the data callback out of the ringbuffer, once a call in progress
+   returned the application task may reset, reallocate or delete it; the
+   callback registers before checking the gate, so that either it sees the
+   gate closed or it is waited for */
+static void bt_i2s_ringbuf_close(void)
+{
+    atomic_store(&s_ringbuf_open, false);
+    while (atomic_load(&s_ringbuf_writers) > 0) {
+        vTaskDelay(1);
+    }
+    s_ringbuf_block = NULL;
+}
+
+_Static_assert(CONFIG_EXAMPLE_A2DP_SINK_RINGBUF_MIN_KB <= CONFIG_EXAMPLE_A2DP_SINK_RINGBUF_MAX_KB,
+               "the minimum ringbuffer size exceeds the maximum");
+
+/* size the ringbuffer for the latency profile's amount of audio in
+   the given format, holding blocks of whole codec frames which the DSP task
+   processes in place; neither the I2S task nor the DSP task may be accessing
+   the ringbuffer */
+static bool bt_i2s_ringbuf_alloc(uint32_t sample_rate, uint8_t ch_count, uint16_t codec_frame_len)
+{
+    const size_t frame_bytes = ch_count * sizeof(int16_t);
+    size_t size = sample_rate * frame_bytes / 1000 * bt_app_latency_get_params()->ringbuf_ms;
+    if (size < CONFIG_EXAMPLE_A2DP_SINK_RINGBUF_MIN_KB * 1024) {
+        size = CONFIG_EXAMPLE_A2DP_SINK_RINGBUF_MIN_KB * 1024;
+    } else if (size > CONFIG_EXAMPLE_A2DP_SINK_RINGBUF_MAX_KB * 1024) {
+        size = CONFIG_EXAMPLE_A2DP_SINK_RINGBUF_MAX_KB * 1024;
+    }
+    size = (size + 3) & ~3U;
+
+    /* combine short codec frames into blocks of at least BT_I2S_BLOCK_FRAMES */
+    codec_frame_len = (codec_frame_len > 0) ? codec_frame_len : BT_I2S_BLOCK_FRAMES;
+    const size_t block_frames = codec_frame_len * ((BT_I2S_BLOCK_FRAMES + codec_frame_len - 1) / codec_frame_len);
+    s_ringbuf_block_size = block_frames * frame_bytes;
+    s_ringbuf_frame_size = frame_bytes;
+
+    /* at least a few blocks so that all three tasks can work at the same time */
+    uint32_t block_cnt = size / s_ringbuf_block_size;
+    block_cnt = (block_cnt < 4) ? 4 : block_cnt;
+    size = block_cnt * s_ringbuf_block_size;
+
+    if (!s_ringbuf_i2s || size != s_ringbuf_size || s_ringbuf_block_size != bt_app_ringbuf_block_size(s_ringbuf_i2s)) {
+        if (s_ringbuf_i2s) {
+            bt_app_ringbuf_delete(s_ringbuf_i2s);
+            s_ringbuf_i2s = NULL;
         }
+        if ((s_ringbuf_i2s = bt_app_ringbuf_create_staged(s_ringbuf_block_size, block_cnt)) == NULL) {
+            ESP_LOGE(BT_APP_CORE_TAG, "%s failed to allocate %u bytes", __func__, size);
+            s_ringbuf_size = 0;
+            return false;
+        }
+        s_ringbuf_size = size;
     }
+    ESP_LOGI(BT_APP_CORE_TAG, "ringbuffer: %u bytes, %u ms at %u Hz with %d channel(s), blocks of %u bytes",
+             size, size * 1000 / (sample_rate * frame_bytes), sample_rate, ch_count, s_ringbuf_block_size);
+    return true;
 }
 
 /********************************
@@ -145,7 +688,13 @@ static void bt_i2s_task_handler(void *arg)
 
 bool bt_app_work_dispatch(bt_app_cb_t p_cback, uint16_t event, void *p_params, int param_len, bt_app_copy_cb_t p_copy_cback)
 {
-    ESP_LOGD(BT_APP_CORE_TAG, "%s event: 0x%x, param len: %d", __func__, event, param_len);
+    return bt_app_work_dispatch_lane(BT_APP_LANE_CONTROL, p_cback, event, p_params, param_len, p_copy_cback);
+}
+
+bool bt_app_work_dispatch_lane(bt_app_lane_t lane, bt_app_cb_t p_cback, uint16_t event, void *p_params,
+                               int param_len, bt_app_copy_cb_t p_copy_cback)
+{
+    ESP_LOGD(BT_APP_CORE_TAG, "%s event: 0x%x, lane: %d, param len: %d", __func__, event, lane, param_len);
 
     bt_app_msg_t msg;
     memset(&msg, 0, sizeof(bt_app_msg_t));
@@ -155,24 +704,113 @@ bool bt_app_work_dispatch(bt_app_cb_t p_cback, uint16_t event, void *p_params, i
     msg.cb = p_cback;
 
     if (param_len == 0) {
-        return bt_app_send_msg(&msg);
+        return bt_app_send_msg(lane, &msg);
     } else if (p_params && param_len > 0) {
-        if ((msg.param = malloc(param_len)) != NULL) {
+        if ((msg.param = bt_app_param_alloc(param_len)) != NULL) {
             memcpy(msg.param, p_params, param_len);
             /* check if caller has provided a copy callback to do the deep copy */
             if (p_copy_cback) {
                 p_copy_cback(msg.param, p_params, param_len);
             }
-            return bt_app_send_msg(&msg);
+            if (bt_app_send_msg(lane, &msg)) {
+                return true;
+            }
+            bt_app_param_free(msg.param);
+        }
+    }
+
+    return false;
+}
+
+void bt_app_work_get_pool_stats(bt_app_param_pool_stats_t *stats, bool reset)
+{
+    taskENTER_CRITICAL(&s_dispatch_lock);
+    *stats = s_param_stats;
+    if (reset) {
+        s_param_stats.high_water = s_param_stats.in_use;
+        s_param_stats.exhausted = 0;
+        s_param_stats.heap = 0;
+    }
+    taskEXIT_CRITICAL(&s_dispatch_lock);
+}
+
+bool bt_app_work_dispatch_coalesced(bt_app_lane_t lane, bt_app_cb_t p_cback, uint16_t event, uint32_t key,
+                                    void *p_params, int param_len)
+{
+    bt_app_coalesce_slot_t *slot = NULL;
+
+    if (p_params == NULL || param_len <= 0 || lane >= BT_APP_LANE_NUM) {
+        return false;
+    }
+
+    /* replace the parameters of queued work of the same kind, the task
+       releases the slot under the lock before handling the work */
+    taskENTER_CRITICAL(&s_dispatch_lock);
+    for (int i = 0; i < BT_APP_COALESCE_SLOTS; i++) {
+        if (s_coalesce[i].param && s_coalesce[i].cb == p_cback && s_coalesce[i].event == event &&
+            s_coalesce[i].key == key) {
+            memcpy(s_coalesce[i].param, p_params, param_len);
+            s_lane_stats[lane].coalesced++;
+            taskEXIT_CRITICAL(&s_dispatch_lock);
+            return true;
         }
     }
+    taskEXIT_CRITICAL(&s_dispatch_lock);
 
+    bt_app_msg_t msg;
+    memset(&msg, 0, sizeof(bt_app_msg_t));
+    msg.sig = BT_APP_SIG_WORK_DISPATCH;
+    msg.event = event;
+    msg.cb = p_cback;
+    if ((msg.param = bt_app_param_alloc(param_len)) == NULL) {
+        return false;
+    }
+    memcpy(msg.param, p_params, param_len);
+
+    /* registered before sending, so that it is never released before */
+    taskENTER_CRITICAL(&s_dispatch_lock);
+    for (int i = 0; i < BT_APP_COALESCE_SLOTS && slot == NULL; i++) {
+        if (s_coalesce[i].param == NULL) {
+            slot = &s_coalesce[i];
+            slot->cb = p_cback;
+            slot->event = event;
+            slot->key = key;
+            slot->param = msg.param;
+        }
+    }
+    taskEXIT_CRITICAL(&s_dispatch_lock);
+
+    if (bt_app_send_msg(lane, &msg)) {
+        return true;
+    }
+    if (slot) {
+        bt_app_coalesce_release(msg.param);
+    }
+    bt_app_param_free(msg.param);
     return false;
 }
 
+void bt_app_work_get_lane_stats(bt_app_lane_t lane, bt_app_lane_stats_t *stats, bool reset)
+{
+    const uint32_t depth = s_bt_app_task_queue[lane] ? uxQueueMessagesWaiting(s_bt_app_task_queue[lane]) : 0;
+
+    taskENTER_CRITICAL(&s_dispatch_lock);
+    *stats = s_lane_stats[lane];
+    stats->depth = depth;
+    if (reset) {
+        s_lane_stats[lane].max_depth = depth;
+        s_lane_stats[lane].dispatched = 0;
+        s_lane_stats[lane].dropped = 0;
+        s_lane_stats[lane].coalesced = 0;
+    }
+    taskEXIT_CRITICAL(&s_dispatch_lock);
+}
+
 void bt_app_task_start_up(void)
 {
-    s_bt_app_task_queue = xQueueCreate(10, sizeof(bt_app_msg_t));
+    s_bt_app_task_queue[BT_APP_LANE_CONTROL] = xQueueCreate(BT_APP_LANE_CONTROL_LEN, sizeof(bt_app_msg_t));
+    s_bt_app_task_queue[BT_APP_LANE_INFO] = xQueueCreate(BT_APP_LANE_INFO_LEN, sizeof(bt_app_msg_t));
+    s_bt_app_task_pending = xSemaphoreCreateCounting(BT_APP_TASK_QUEUE_LEN, 0);
     xTaskCreate(bt_app_task_handler, "BtAppTask", 3072, NULL, 10, &s_bt_app_task_handle);
 }
 
@@ -182,9 +820,23 @@ void bt_app_task_shut_down(void)
         vTaskDelete(s_bt_app_task_handle);
         s_bt_app_task_handle = NULL;
     }
-    if (s_bt_app_task_queue) {
-        vQueueDelete(s_bt_app_task_queue);
-        s_bt_app_task_queue = NULL;
+    for (int lane = 0; lane < BT_APP_LANE_NUM; lane++) {
+        if (s_bt_app_task_queue[lane]) {
+            /* return the parameters of work that is left to the pool */
+            bt_app_msg_t msg;
+            while (xQueueReceive(s_bt_app_task_queue[lane], &msg, 0) == pdTRUE) {
+                if (msg.param) {
+                    bt_app_param_free(msg.param);
+                }
+            }
+            vQueueDelete(s_bt_app_task_queue[lane]);
+            s_bt_app_task_queue[lane] = NULL;
+        }
+    }
+    memset(s_coalesce, 0, sizeof(s_coalesce));
+    if (s_bt_app_task_pending) {
+        vSemaphoreDelete(s_bt_app_task_pending);
+        s_bt_app_task_pending = NULL;
     }
 }
 
@@ -192,31 +844,243 @@ void bt_i2s_task_start_up(void)
 {
     /*status_led_playing(true);*/
 
-    if ((s_ringbuf_i2s = xRingbufferCreate(8 * 1024, RINGBUF_TYPE_BYTEBUF)) == NULL) {
+    if (s_dsp_mutex == NULL && (s_dsp_mutex = xSemaphoreCreateMutex()) == NULL) {
+        return;
+    }
+    /* Bluedroid configures the codec while the connection is being opened,
+       before the task is started up, so the stored format is the stream's */
+    if (!bt_i2s_ringbuf_alloc(s_stream_sample_rate, s_stream_ch_count, s_stream_frame_len)) {
         return;
     }
-    xTaskCreate(bt_i2s_task_handler, "BtI2STask", 1024, NULL, configMAX_PRIORITIES - 3, &s_bt_i2s_task_handle);
+    /* start muted, the stream fades in once audio is started */
+    bt_app_vc_start_fade(false, 0);
+    bt_app_vc_start_output_fade(true, 0);
+    s_output = bt_app_output_get();
+    bt_app_jitter_set_format(s_stream_sample_rate, s_stream_ch_count, s_ringbuf_size - s_ringbuf_block_size);
+    bt_app_jitter_set_output_latency(s_output->latency());
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_CLOCK_SYNC
+    /* a new source comes with its own clock */
+    bt_app_clock_sync_set_format(s_stream_sample_rate, s_stream_ch_count);
+    bt_app_clock_sync_reset();
+#endif
+    s_i2s_paused = false;
+    s_i2s_prefilling = true;
+    s_i2s_rebuffering = false;
+    s_i2s_start_time = esp_timer_get_time();
+    bt_i2s_ringbuf_open();
+    bt_i2s_dsp_task_start();
+    xTaskCreatePinnedToCore(bt_i2s_task_handler, "BtI2STask", CONFIG_EXAMPLE_A2DP_SINK_I2S_TASK_STACK, NULL,
+                            CONFIG_EXAMPLE_A2DP_SINK_I2S_TASK_PRIORITY, &s_bt_i2s_task_handle,
+                            BT_TASK_CORE(CONFIG_EXAMPLE_A2DP_SINK_I2S_TASK_CORE));
 }
 
 void bt_i2s_task_shut_down(void)
 {
     if (s_bt_i2s_task_handle) {
-        vTaskDelete(s_bt_i2s_task_handle);
+        /* avoid a pop by fading out before the output stops */
+        bt_i2s_task_drain();
+        /* the output stays installed, let the task exit by itself once it is
+           out of the output and the processing chain; the notification wakes
+           it up if it is parked */
+        s_i2s_stop_waiter = xTaskGetCurrentTaskHandle();
+        xTaskNotifyGive(s_bt_i2s_task_handle);
+        while (s_i2s_stop_waiter) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(BT_I2S_IDLE_WAIT_MS));
+        }
         s_bt_i2s_task_handle = NULL;
     }
+    bt_i2s_ringbuf_close();
+    bt_i2s_dsp_task_stop();
     if (s_ringbuf_i2s) {
-        vRingbufferDelete(s_ringbuf_i2s);
+        bt_app_ringbuf_delete(s_ringbuf_i2s);
         s_ringbuf_i2s = NULL;
+        s_ringbuf_size = 0;
     }
 
     /*status_led_playing(false);*/
 }
 
+void bt_i2s_task_fade_in(void)
+{
+    bt_app_vc_start_fade(true, CONFIG_EXAMPLE_A2DP_SINK_FADE_MS);
+}
+
+void bt_i2s_task_fade_out(void)
+{
+    bt_app_vc_start_fade(false, CONFIG_EXAMPLE_A2DP_SINK_FADE_MS);
+}
+
+void bt_i2s_task_drain(void)
+{
+    if (!s_bt_i2s_task_handle || s_i2s_paused) {
+        return;
+    }
+
+    /* request the fade first so the I2S task never sees a waiter without it */
+    bt_app_vc_start_fade(false, CONFIG_EXAMPLE_A2DP_SINK_FADE_MS);
+    s_i2s_drain_waiter = xTaskGetCurrentTaskHandle();
+    if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(BT_I2S_DRAIN_TIMEOUT_MS)) == 0) {
+        ESP_LOGW(BT_APP_CORE_TAG, "%s timed out", __func__);
+        s_i2s_drain_waiter = NULL;
+        s_i2s_paused = true;
+    }
+}
+
+void bt_i2s_task_resume(void)
+{
+    /* stays paused without ringbuffers, after a failed reconfiguration */
+    if (s_bt_i2s_task_handle && s_i2s_paused && s_ringbuf_i2s) {
+        s_i2s_paused = false;
+        xTaskNotifyGive(s_bt_i2s_task_handle);
+    }
+}
+
+void bt_i2s_task_get_overflow_stats(bt_i2s_overflow_stats_t *stats, bool reset)
+{
+    if (reset) {
+        stats->dropped_oldest = atomic_exchange(&s_overflow_dropped_oldest, 0);
+        stats->dropped_newest = atomic_exchange(&s_overflow_dropped_newest, 0);
+        stats->stretched = atomic_exchange(&s_overflow_stretched, 0);
+    } else {
+        stats->dropped_oldest = atomic_load(&s_overflow_dropped_oldest);
+        stats->dropped_newest = atomic_load(&s_overflow_dropped_newest);
+        stats->stretched = atomic_load(&s_overflow_stretched);
+    }
+}
+
+void bt_i2s_task_set_format(uint32_t sample_rate, uint8_t ch_count, uint16_t codec_frame_len)
+{
+    s_stream_sample_rate = sample_rate;
+    s_stream_ch_count = ch_count;
+    s_stream_frame_len = codec_frame_len;
+    if (!s_bt_i2s_task_handle || !s_i2s_paused) {
+        return;
+    }
+    /* discard what is left of the previous stream, it has been faded out; the
+       I2S task only touches the ringbuffer while it is not paused, the data
+       callback is kept out of it while it is reconfigured */
+    bt_i2s_ringbuf_close();
+    bt_i2s_dsp_task_stop();
+    if (s_ringbuf_i2s) {
+        bt_app_ringbuf_reset(s_ringbuf_i2s);
+    }
+    if (!bt_i2s_ringbuf_alloc(sample_rate, ch_count, codec_frame_len)) {
+        /* without a ringbuffer the DSP task stays stopped and the I2S task
+           paused, the stream is dropped and stays muted */
+        bt_app_vc_start_fade(false, 0);
+        return;
+    }
+    bt_app_jitter_set_format(sample_rate, ch_count, s_ringbuf_size - s_ringbuf_block_size);
+    bt_app_jitter_set_output_latency(s_output->latency());
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_CLOCK_SYNC
+    bt_app_clock_sync_set_format(sample_rate, ch_count);
+#endif
+    s_i2s_prefilling = true;
+    bt_i2s_dsp_task_start();
+    bt_i2s_ringbuf_open();
+}
+
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_OVERFLOW_TIME_STRETCH
+/* copy whole frames, merging two frames into their average once in every
+   BT_I2S_STRETCH_FRAMES to shorten the audio by about 1.5 %; returns the
+   number of input bytes consumed and stores the bytes written in produced */
+static size_t bt_i2s_copy_stretched(uint8_t *dst, size_t space, const uint8_t *src, size_t size, size_t *produced)
+{
+    const size_t frame = s_ringbuf_frame_size;
+    const size_t samples = frame / sizeof(int16_t);
+    size_t in = 0;
+    size_t out = 0;
+
+    while (in + frame <= size && out + frame <= space) {
+        if (++s_stretch_phase >= BT_I2S_STRETCH_FRAMES && in + 2 * frame <= size) {
+            const int16_t *a = (const int16_t *)(src + in);
+            int16_t *d = (int16_t *)(dst + out);
+            for (size_t i = 0; i < samples; i++) {
+                d[i] = (int16_t)(((int32_t)a[i] + a[i + samples]) >> 1);
+            }
+            s_stretch_phase = 0;
+            in += 2 * frame;
+        } else {
+            memcpy(dst + out, src + in, frame);
+            in += frame;
+        }
+        out += frame;
+    }
+    *produced = out;
+    return in;
+}
+#endif
+
 size_t write_ringbuf(const uint8_t *data, size_t size)
 {
-    BaseType_t done = xRingbufferSend(s_ringbuf_i2s, (void *)data, size, (TickType_t)portMAX_DELAY);
+    size_t written = 0;
+
+    atomic_fetch_add(&s_ringbuf_writers, 1);
+    if (!atomic_load(&s_ringbuf_open)) {
+        /* not started up, being reconfigured, or the last reconfiguration failed */
+        atomic_fetch_sub(&s_ringbuf_writers, 1);
+        return 0;
+    }
+
+    while (written < size) {
+        if (s_ringbuf_block == NULL) {
+            uint32_t count = 0;
+            if ((s_ringbuf_block = bt_app_ringbuf_write_acquire(s_ringbuf_i2s, &count, 0)) == NULL) {
+                /* the DSP and I2S tasks are behind, wait a bounded time for them to make room */
+                bt_app_xrun_record(BT_APP_XRUN_RING_FULL);
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_OVERFLOW_DROP_OLDEST
+                /* the I2S task drops the oldest blocks within one of its own waits */
+                const TickType_t wait = 2 * BT_I2S_OVERFLOW_WAIT_TICKS + 1;
+#else
+                const TickType_t wait = BT_I2S_OVERFLOW_WAIT_TICKS;
+#endif
+                s_ringbuf_block = bt_app_ringbuf_write_acquire(s_ringbuf_i2s, &count, wait);
+                if (s_ringbuf_block == NULL) {
+                    /* never stall the Bluetooth stack, drop the rest of the packet */
+                    atomic_fetch_add(&s_overflow_dropped_newest, size - written);
+                    break;
+                }
+            }
+            s_ringbuf_block_fill = 0;
+        }
+
+        /* only copy in the data callback, the block is handed to the DSP
+           task once it is complete and processed in place there */
+        const size_t space = s_ringbuf_block_size - s_ringbuf_block_fill;
+        size_t chunk = (size - written < space) ? (size - written) : space;
+        size_t produced = chunk;
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_OVERFLOW_TIME_STRETCH
+        if (bt_app_ringbuf_level(s_ringbuf_i2s) + BT_I2S_STRETCH_FREE_BLOCKS >= bt_app_ringbuf_block_cnt(s_ringbuf_i2s)) {
+            chunk = bt_i2s_copy_stretched(s_ringbuf_block + s_ringbuf_block_fill, space,
+                                          data + written, size - written, &produced);
+            atomic_fetch_add(&s_overflow_stretched, chunk - produced);
+            if (chunk == 0) {
+                break;
+            }
+        } else
+#endif
+        {
+            memcpy(s_ringbuf_block + s_ringbuf_block_fill, data + written, chunk);
+        }
+        s_ringbuf_block_fill += produced;
+        written += chunk;
+
+        if (s_ringbuf_block_fill == s_ringbuf_block_size) {
+            /* counted before the block becomes visible to the consumer,
+               which may take it out of the count right away */
+            bt_app_jitter_produced(s_ringbuf_block_size);
+            bt_app_ringbuf_write_commit(s_ringbuf_i2s, 1);
+            s_ringbuf_block = NULL;
+        }
+    }
+
+    TaskHandle_t task = s_bt_i2s_task_handle;
+    if (task && s_i2s_prefilling && bt_app_jitter_prefilled()) {
+        xTaskNotifyGive(task);
+    }
+    atomic_fetch_sub(&s_ringbuf_writers, 1);
 
-    return done ? size : 0;
+    return written;
 }
 
 #endif /* CONFIG_EXAMPLE_BUILD_FACTORY_IMAGE */
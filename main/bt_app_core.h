@@ -17,8 +17,40 @@
 /* log tag */
 #define BT_APP_CORE_TAG    "BT_APP_CORE"
 
+/* minimum number of frames in a block passed from the data callback through
+   the DSP task to the I2S task, blocks hold whole codec frames and all have
+   the same size */
+#define BT_I2S_BLOCK_FRAMES         (128)
+/* maximum number of contiguous blocks the I2S task writes at once */
+#define BT_I2S_MAX_SPAN_BLOCKS      (2)
+/* with CONFIG_EXAMPLE_A2DP_SINK_OVERFLOW_TIME_STRETCH, two frames in this
+   many are merged into one while the ringbuffer has at most
+   BT_I2S_STRETCH_FREE_BLOCKS free blocks */
+#define BT_I2S_STRETCH_FRAMES       (64)
+#define BT_I2S_STRETCH_FREE_BLOCKS  (2)
+/* size of the buffer the fade hold is processed in */
+#define BT_I2S_HOLD_BYTES           (512)
+/* time the I2S task waits for data before checking for pending fades */
+#define BT_I2S_IDLE_WAIT_MS         (20)
+/* upper bound for playing out a fade before the output is stopped */
+#define BT_I2S_DRAIN_TIMEOUT_MS     (CONFIG_EXAMPLE_A2DP_SINK_FADE_MS + 200)
+/* silence written after a fade to flush it through the DMA descriptors of
+   the latency profile, see `bt_app_output_t` */
+#define BT_I2S_DMA_BUF_BYTES(params) ((params)->dma_desc_num * (params)->dma_frame_num * 4)
+
 /* signal for `bt_app_work_dispatch` */
 #define BT_APP_SIG_WORK_DISPATCH    (0x01)
+/* depth of the lanes of the application task queue */
+#define BT_APP_LANE_CONTROL_LEN     (10)
+#define BT_APP_LANE_INFO_LEN        (10)
+#define BT_APP_TASK_QUEUE_LEN       (BT_APP_LANE_CONTROL_LEN + BT_APP_LANE_INFO_LEN)
+
+/* lanes of the application task queue, served in this order */
+typedef enum {
+    BT_APP_LANE_CONTROL = 0,    /*!< connection, audio configuration, volume and anything sent once */
+    BT_APP_LANE_INFO,           /*!< metadata and play position, dropped when full */
+    BT_APP_LANE_NUM,
+} bt_app_lane_t;
 
 /**
  * @brief  handler for the dispatched work
@@ -33,6 +65,7 @@ typedef struct {
     uint16_t       sig;      /*!< signal to bt_app_task */
     uint16_t       event;    /*!< message event id */
     bt_app_cb_t    cb;       /*!< context switch callback */
+    uint32_t       time_us;  /*!< time of dispatch, for the event statistics */
     void           *param;   /*!< parameter area needs to be last */
 } bt_app_msg_t;
 
@@ -46,7 +79,7 @@ typedef struct {
 typedef void (* bt_app_copy_cb_t) (void *p_dest, void *p_src, int len);
 
 /**
- * @brief  work dispatcher for the application task
+ * @brief  work dispatcher for the application task, to the control lane
  *
  * @param [in] p_cback       callback function
  * @param [in] event         event id
@@ -58,6 +91,83 @@ typedef void (* bt_app_copy_cb_t) (void *p_dest, void *p_src, int len);
  */
 bool bt_app_work_dispatch(bt_app_cb_t p_cback, uint16_t event, void *p_params, int param_len, bt_app_copy_cb_t p_copy_cback);
 
+/**
+ * @brief  work dispatcher for the application task, to the given lane;
+ *         queued work of a lane is handled before that of the lanes
+ *         following it, the info lane drops work when full instead of
+ *         waiting for room
+ *
+ * @param [in] lane          queue lane
+ * @param [in] p_cback       callback function
+ * @param [in] event         event id
+ * @param [in] p_params      callback paramters
+ * @param [in] param_len     parameter length in byte
+ * @param [in] p_copy_cback  parameter deep-copy function
+ *
+ * @return  true if work dispatch successfully, false otherwise
+ */
+bool bt_app_work_dispatch_lane(bt_app_lane_t lane, bt_app_cb_t p_cback, uint16_t event, void *p_params,
+                               int param_len, bt_app_copy_cb_t p_copy_cback);
+
+/**
+ * @brief  work dispatcher for work superseded by later work of the same
+ *         kind, such as absolute volume commands; while work of the same
+ *         callback, event and key is queued, its parameters are replaced
+ *         instead of queueing the work again. The parameters are copied as
+ *         they are, without a deep-copy function
+ *
+ * @param [in] lane       queue lane
+ * @param [in] p_cback    callback function
+ * @param [in] event      event id
+ * @param [in] key        distinguishes kinds of work sharing an event id
+ * @param [in] p_params   callback paramters
+ * @param [in] param_len  parameter length in byte
+ *
+ * @return  true if work dispatch successfully, false otherwise
+ */
+bool bt_app_work_dispatch_coalesced(bt_app_lane_t lane, bt_app_cb_t p_cback, uint16_t event, uint32_t key,
+                                    void *p_params, int param_len);
+
+/**
+ * @brief  usage of a lane of the application task queue
+ */
+typedef struct {
+    uint32_t depth;             /*!< messages queued */
+    uint32_t max_depth;         /*!< most messages queued at once */
+    uint32_t dispatched;        /*!< messages queued since the last reset */
+    uint32_t dropped;           /*!< messages dropped because the lane was full */
+    uint32_t coalesced;         /*!< work merged into queued work of the same kind */
+} bt_app_lane_stats_t;
+
+/**
+ * @brief  get and optionally reset the statistics of a lane; a reset sets
+ *         the maximum depth to the current depth
+ *
+ * @param [in]  lane   queue lane
+ * @param [out] stats  statistics
+ * @param [in]  reset  reset the statistics
+ */
+void bt_app_work_get_lane_stats(bt_app_lane_t lane, bt_app_lane_stats_t *stats, bool reset);
+
+/**
+ * @brief  usage of the pool holding the parameters of dispatched work
+ */
+typedef struct {
+    uint32_t in_use;            /*!< blocks allocated */
+    uint32_t high_water;        /*!< most blocks allocated at once */
+    uint32_t exhausted;         /*!< dispatches failed for lack of a block */
+    uint32_t heap;              /*!< parameters too large for a block, allocated from the heap */
+} bt_app_param_pool_stats_t;
+
+/**
+ * @brief  get and optionally reset the parameter pool statistics; a reset
+ *         sets the high-water mark to the blocks in use
+ *
+ * @param [out] stats  statistics
+ * @param [in]  reset  reset the statistics
+ */
+void bt_app_work_get_pool_stats(bt_app_param_pool_stats_t *stats, bool reset);
+
 /**
  * @brief  start up the application task
  */
@@ -79,12 +189,70 @@ void bt_i2s_task_start_up(void);
 void bt_i2s_task_shut_down(void);
 
 /**
- * @brief  write data to ringbuffer
+ * @brief  fade in the audio output
+ */
+void bt_i2s_task_fade_in(void);
+
+/**
+ * @brief  fade out the audio output without waiting for the fade to finish
+ */
+void bt_i2s_task_fade_out(void);
+
+/**
+ * @brief  fade out the audio output and wait until the fade has been handed
+ *         to the I2S driver; the I2S task then stays idle until resumed
+ */
+void bt_i2s_task_drain(void);
+
+/**
+ * @brief  resume the I2S task after `bt_i2s_task_drain()`
+ */
+void bt_i2s_task_resume(void);
+
+/**
+ * @brief  set the stream format, resizing the ringbuffer for the target
+ *         latency; discards buffered data, to be called while the I2S task
+ *         is drained. Before the I2S task is started up, the format is only
+ *         stored for the start up. If the ringbuffer cannot be allocated,
+ *         the stream stays muted and `bt_i2s_task_resume()` has no effect
+ *         until the next successful call.
+ *
+ * @param [in] sample_rate      sample rate in Hz
+ * @param [in] ch_count         number of channels
+ * @param [in] codec_frame_len  samples per channel in a codec frame
+ */
+void bt_i2s_task_set_format(uint32_t sample_rate, uint8_t ch_count, uint16_t codec_frame_len);
+
+/**
+ * @brief  audio left out by the data callback because the ringbuffer was full
+ */
+typedef struct {
+    uint32_t dropped_oldest;    /*!< bytes discarded from the ringbuffer to make room */
+    uint32_t dropped_newest;    /*!< bytes of incoming audio discarded */
+    uint32_t stretched;         /*!< bytes saved by merging frames */
+} bt_i2s_overflow_stats_t;
+
+/**
+ * @brief  get and optionally reset the overflow statistics
+ *
+ * @param [out] stats  statistics in bytes
+ * @param [in]  reset  reset the statistics
+ */
+void bt_i2s_task_get_overflow_stats(bt_i2s_overflow_stats_t *stats, bool reset);
+
+/**
+ * @brief  copy data to the ringbuffer for the DSP task; the ringbuffer is
+ *         filled in blocks of whole codec frames, a partial block is
+ *         completed by the next call; waits at most
+ *         CONFIG_EXAMPLE_A2DP_SINK_OVERFLOW_WAIT_MS for room and applies the
+ *         overflow policy, so it never blocks the Bluetooth stack for long;
+ *         the data is dropped while the ringbuffer is reconfigured or shut
+ *         down, which waits for a call in progress to return
  *
  * @param [in] data  pointer to data stream
  * @param [in] size  data length in byte
  *
- * @return size if writteen ringbuffer successfully, 0 others
+ * @return size if writteen ringbuffer successfully, less than size others
  */
 size_t write_ringbuf(const uint8_t *data, size_t size);
 
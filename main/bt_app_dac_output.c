@@ -0,0 +1,142 @@
+/*
+ * Noise shaping for the internal DAC.
+ *
+ * The quantization error of each sample is filtered and subtracted from the
+ * following samples, giving a noise transfer function of
+ * NTF(z) = 1 - sum(coef[k] * z^-(k+1)).
+ *
+ * At the stream rate, the 5 tap F-weighted filter by Wannamaker/Lipshitz
+ * moves noise from the most sensitive range of hearing (below ~6 kHz, about
+ * 15 dB less noise) towards the upper end of the audio band, where it adds
+ * about 10 dB to the unweighted noise.
+ *
+ * At twice the stream rate, a 3rd order filter with zeros at DC and 14 kHz
+ * is used, NTF(z) = (1 - z^-1) * (1 - 2cos(w0) z^-1 + z^-2), which lowers
+ * the unweighted noise below 20 kHz by about 12 dB compared to rounding at
+ * the stream rate, the 3 dB gained by spreading it over twice the band
+ * included.
+ *
+ * The figures are from test/host/test_dac_shaper.c, a -6 dBFS sine at 1 kHz.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "sdkconfig.h"
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_INTERNAL_DAC
+
+#include "bt_app_dac_output.h"
+#include "esp_log.h"
+
+#define MAX_CHANNELS 2
+
+static const char TAG[] = "DACOUT";
+
+static uint8_t channels = 2;
+
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_DAC_NOISE_SHAPING
+
+bt_app_dac_shaper_t bt_app_dac_shaper[DAC_SHAPER_MAX_CHANNELS];
+
+#define COEF(x) ((int32_t)((x) * (1 << DAC_SHAPER_COEF_BITS) + ((x) < 0 ? -0.5 : 0.5)))
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_DAC_OVERSAMPLE_2X
+/* 2cos(2 * pi * 14000 / 88200) = 1.0862 */
+const int32_t bt_app_dac_shaper_coef[DAC_SHAPER_ORDER] = {
+    COEF(2.0862), COEF(-2.0862), COEF(1.0), 0, 0
+};
+#else
+const int32_t bt_app_dac_shaper_coef[DAC_SHAPER_ORDER] = {
+    COEF(2.033), COEF(-2.165), COEF(1.959), COEF(-1.590), COEF(0.6149)
+};
+#endif
+
+#define REQUANTIZE(s, ch) bt_app_dac_requantize((s), (ch))
+#else
+#define REQUANTIZE(s, ch) ((int16_t)((uint16_t)(s) + 0x8000U))
+#endif /* CONFIG_EXAMPLE_A2DP_SINK_DAC_NOISE_SHAPING */
+
+#ifdef BT_APP_DAC_RESAMPLE
+/* position between history[1] and history[2] as 32 bit fraction, step per output frame */
+#define PHASE_ONE (1ULL << 32)
+#define PHASE_STEP_NOMINAL (PHASE_ONE / BT_APP_DAC_RATE_FACTOR)
+
+/* last four input samples per channel, oldest first */
+static int32_t history[MAX_CHANNELS][4];
+static uint64_t phase = 0;
+static volatile uint64_t phase_step = PHASE_STEP_NOMINAL;
+#endif
+
+void bt_app_dac_output_set_format(uint8_t ch_count)
+{
+    channels = (ch_count > 0 && ch_count <= MAX_CHANNELS) ? ch_count : MAX_CHANNELS;
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_DAC_NOISE_SHAPING
+    memset(bt_app_dac_shaper, 0, sizeof(bt_app_dac_shaper));
+#endif
+#ifdef BT_APP_DAC_RESAMPLE
+    memset(history, 0, sizeof(history));
+    phase = 0;
+#endif
+    ESP_LOGD(TAG, "format: %d channel(s), rate factor %d", channels, BT_APP_DAC_RATE_FACTOR);
+}
+
+#ifdef BT_APP_DAC_RESAMPLE
+void bt_app_dac_output_set_correction(int32_t uppm)
+{
+    phase_step = PHASE_STEP_NOMINAL + (int64_t)PHASE_STEP_NOMINAL * uppm / 1000000000000LL;
+}
+
+/* 4 tap cubic (Catmull-Rom) interpolation between h[1] and h[2], t is a 15 bit fraction;
+   at t = 1/2 this is (9 * (h[1] + h[2]) - h[0] - h[3]) / 16 */
+static inline int32_t interpolate(const int32_t *h, int32_t t)
+{
+    const int64_t a = -h[0] + 3 * h[1] - 3 * h[2] + h[3];
+    const int64_t b = 2 * h[0] - 5 * h[1] + 4 * h[2] - h[3];
+    const int64_t c = h[2] - h[0];
+    int64_t v = (a * t) >> 15;
+    v = ((v + b) * t) >> 15;
+    v = ((v + c) * t) >> 16;
+    v += h[1];
+    /* the cubic may overshoot between full scale samples */
+    return (v > INT16_MAX) ? INT16_MAX : (v < INT16_MIN) ? INT16_MIN : (int32_t)v;
+}
+
+size_t bt_app_dac_resample(const uint8_t *in, size_t size, uint8_t *out)
+{
+    const int16_t *in_ptr = (const int16_t *)in;
+    int16_t *out_ptr = (int16_t *)out;
+    size_t frame_cnt = size / (channels * sizeof(int16_t));
+    const uint64_t step = phase_step;
+
+    /* the output is delayed by two input samples */
+    for (;;)
+    {
+        while (phase >= PHASE_ONE)
+        {
+            if (frame_cnt == 0)
+            {
+                return (uint8_t *)out_ptr - out;
+            }
+            for (unsigned int ch = 0; ch < channels; ch++)
+            {
+                int32_t *h = history[ch];
+                h[0] = h[1];
+                h[1] = h[2];
+                h[2] = h[3];
+                h[3] = *in_ptr++;
+            }
+            frame_cnt -= 1;
+            phase -= PHASE_ONE;
+        }
+
+        const int32_t t = (int32_t)(phase >> 17);
+        for (unsigned int ch = 0; ch < channels; ch++)
+        {
+            const int32_t *h = history[ch];
+            out_ptr[ch] = REQUANTIZE((t == 0) ? h[1] : interpolate(h, t), ch);
+        }
+        out_ptr += channels;
+        phase += step;
+    }
+}
+#endif
+
+#endif /* CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_INTERNAL_DAC */
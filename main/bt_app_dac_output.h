@@ -0,0 +1,109 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+
+/*
+* Output stage for the internal DAC, which only uses the upper 8 bits of
+* each 16 bit sample. Samples are requantized to 8 bits with error feedback
+* noise shaping, optionally after interpolating to twice the sample rate
+* so that most of the shaped noise ends up above the audio band. The
+* interpolation also takes a small rate correction to follow the clock of
+* the source, as the DAC clock cannot be tuned.
+*/
+
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_DAC_OVERSAMPLE_2X
+#define BT_APP_DAC_RATE_FACTOR 2
+#else
+#define BT_APP_DAC_RATE_FACTOR 1
+#endif
+
+/* samples stay 16 bit signed until they are resampled in the I2S task */
+#if defined(CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_INTERNAL_DAC) && \
+    (defined(CONFIG_EXAMPLE_A2DP_SINK_DAC_OVERSAMPLE_2X) || defined(CONFIG_EXAMPLE_A2DP_SINK_CLOCK_SYNC))
+#define BT_APP_DAC_RESAMPLE 1
+#endif
+
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_DAC_NOISE_SHAPING
+
+#define DAC_SHAPER_ORDER 5
+#define DAC_SHAPER_COEF_BITS 12
+#define DAC_SHAPER_MAX_CHANNELS 2
+/* one step of the 8 bit DAC in 16 bit sample units */
+#define DAC_LSB 256
+
+typedef struct {
+    int32_t err[DAC_SHAPER_ORDER];   /* past quantization errors, most recent first */
+} bt_app_dac_shaper_t;
+
+extern bt_app_dac_shaper_t bt_app_dac_shaper[DAC_SHAPER_MAX_CHANNELS];
+extern const int32_t bt_app_dac_shaper_coef[DAC_SHAPER_ORDER];
+
+/*
+* Requantizes a sample of the given channel to 8 bits and returns it as
+* offset binary 16 bit value as expected by the internal DAC.
+*/
+static inline int16_t bt_app_dac_requantize(int32_t sample, unsigned int ch)
+{
+    int32_t *err = bt_app_dac_shaper[ch].err;
+    int32_t feedback = 0;
+    for (unsigned int k = 0; k < DAC_SHAPER_ORDER; k++)
+    {
+        feedback += bt_app_dac_shaper_coef[k] * err[k];
+    }
+    const int32_t wanted = sample - (feedback >> DAC_SHAPER_COEF_BITS);
+
+    /* round to the nearest DAC step, keeping within the 16 bit range */
+    int32_t quantized = ((wanted + DAC_LSB / 2) >> 8) * DAC_LSB;
+    if (quantized > INT16_MAX - (DAC_LSB - 1))
+    {
+        quantized = INT16_MAX - (DAC_LSB - 1);
+    }
+    else if (quantized < INT16_MIN)
+    {
+        quantized = INT16_MIN;
+    }
+
+    /* limit the error fed back after clipping to keep the loop stable */
+    int32_t error = quantized - wanted;
+    if (error > DAC_LSB)
+    {
+        error = DAC_LSB;
+    }
+    else if (error < -DAC_LSB)
+    {
+        error = -DAC_LSB;
+    }
+    for (unsigned int k = DAC_SHAPER_ORDER - 1; k > 0; k--)
+    {
+        err[k] = err[k - 1];
+    }
+    err[0] = error;
+
+    return (int16_t)((uint16_t)quantized + 0x8000U);
+}
+
+#endif /* CONFIG_EXAMPLE_A2DP_SINK_DAC_NOISE_SHAPING */
+
+/*
+* Sets the number of channels and clears the output stage state.
+*/
+void bt_app_dac_output_set_format(uint8_t channels);
+
+#ifdef BT_APP_DAC_RESAMPLE
+/*
+* Sets the rate correction in millionths of a ppm, positive values consume
+* the input faster.
+*/
+void bt_app_dac_output_set_correction(int32_t uppm);
+
+/*
+* Resamples 16 bit samples by BT_APP_DAC_RATE_FACTOR and the rate correction,
+* and requantizes them for the internal DAC. The output buffer must hold
+* BT_APP_DAC_RATE_FACTOR times the input size plus two frames. Returns the
+* number of bytes written to out.
+*/
+size_t bt_app_dac_resample(const uint8_t *in, size_t size, uint8_t *out);
+#endif
@@ -0,0 +1,130 @@
+/*
+ * A2DP delay reporting.
+ *
+ * At stream start the reported delay is based on the pre-fill target and a
+ * full output, as the buffer is still empty. While playing, the I2S task
+ * measures the occupancy of the output path after each write: the
+ * ringbuffer fill level plus the audio queued in the output, as tracked by
+ * the backend from its DMA events. The estimate of the start is replaced
+ * by the first settled average, and a new delay is reported when the
+ * average drifts beyond the threshold, e.g. after the adaptive pre-fill
+ * was raised. Updates are rate limited, as each one is a
+ * signalling message to the source.
+ *
+ * The block the data callback is filling is not counted, nor is the DAC
+ * resampler history; both are below 3 ms.
+ */
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include "sdkconfig.h"
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_DELAY_REPORT
+
+#include "bt_app_delay.h"
+#include "bt_app_jitter.h"
+#include "bt_app_output.h"
+#include "esp_a2dp_api.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#define UPDATE_INTERVAL_MS 1000
+/* averaging of the measured occupancy, over about 256 writes */
+#define AVG_SHIFT 8
+
+static const char TAG[] = "DELAY";
+
+static uint16_t base_delay = 0;
+static atomic_bool peer_support = false;
+
+/* last reported delay, only touched by the I2S task while playing */
+static uint32_t reported = 0;
+static uint32_t last_update_ms = 0;
+static uint32_t avg_occupancy_q = 0;    /* AVG_SHIFT fractional bits */
+static uint32_t avg_samples = 0;        /* up to 1 << AVG_SHIFT */
+static bool settled = false;            /* a settled average was compared */
+
+
+static uint32_t output_delay(void)
+{
+    return bt_app_output_get()->latency();
+}
+
+/* audio queued in the output, taken as full if the backend cannot tell */
+static uint32_t output_queued(void)
+{
+    const bt_app_output_t *output = bt_app_output_get();
+    return output->queued ? output->queued() : output->latency();
+}
+
+/* report to the source, if it advertised delay reporting */
+static void report(uint32_t delay)
+{
+    if (!atomic_load(&peer_support))
+    {
+        return;
+    }
+    reported = delay;
+    last_update_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    esp_a2d_sink_set_delay_value((delay < UINT16_MAX) ? delay : UINT16_MAX);
+}
+
+void bt_app_delay_set_base(uint16_t delay)
+{
+    base_delay = delay;
+    report(base_delay + bt_app_jitter_target_delay() + output_delay());
+}
+
+void bt_app_delay_set_peer_support(bool supported)
+{
+    atomic_store(&peer_support, supported);
+}
+
+void bt_app_delay_start(void)
+{
+    if (!atomic_load(&peer_support))
+    {
+        return;
+    }
+    const uint32_t delay = base_delay + bt_app_jitter_target_delay() + output_delay();
+    avg_occupancy_q = 0;
+    avg_samples = 0;
+    settled = false;
+    if (delay != reported)
+    {
+        ESP_LOGI(TAG, "expected delay %u.%u ms", delay / 10, delay % 10);
+        report(delay);
+    }
+}
+
+void bt_app_delay_update(void)
+{
+    if (!atomic_load(&peer_support))
+    {
+        return;
+    }
+    const uint32_t occupancy = bt_app_jitter_fill_delay() + output_queued();
+    avg_occupancy_q = (avg_occupancy_q == 0) ? (occupancy << AVG_SHIFT) :
+                      (avg_occupancy_q + occupancy - (avg_occupancy_q >> AVG_SHIFT));
+    if (avg_samples < (1u << AVG_SHIFT))
+    {
+        avg_samples++;
+    }
+
+    const uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    if (now_ms - last_update_ms < UPDATE_INTERVAL_MS || avg_samples < (1u << AVG_SHIFT))
+    {
+        return;
+    }
+    /* the first settled average replaces the estimate unless within 1 ms */
+    const uint32_t threshold = settled ? CONFIG_EXAMPLE_A2DP_SINK_DELAY_REPORT_THRESHOLD_MS * 10 : 10;
+    const uint32_t delay = base_delay + (avg_occupancy_q >> AVG_SHIFT);
+    const uint32_t drift = (delay > reported) ? (delay - reported) : (reported - delay);
+    settled = true;
+    if (drift > threshold)
+    {
+        ESP_LOGI(TAG, "measured delay %u.%u ms", delay / 10, delay % 10);
+        report(delay);
+    }
+}
+
+#endif /* CONFIG_EXAMPLE_A2DP_SINK_DELAY_REPORT */
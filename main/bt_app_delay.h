@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+* A2DP delay reporting. The sink reports the delay from the reception of
+* the audio to its output, so that the source can keep video in sync. It
+* is made up of the delay of the Bluetooth stack and the output path: the
+* audio buffered between the data callback and the I2S task, and the DMA
+* descriptors. Delays are in units of 0.1 ms, as in the A2DP API.
+*/
+
+/*
+* Sets the delay of the Bluetooth stack, as read with
+* esp_a2d_sink_get_delay_value(), and reports the total delay expected
+* from the latency profile.
+*/
+void bt_app_delay_set_base(uint16_t delay);
+
+/*
+* Enables delay reports, if the source supports delay reporting. Without
+* it, the functions here only track the delay and report nothing.
+*/
+void bt_app_delay_set_peer_support(bool supported);
+
+/*
+* Reports the delay expected from the pre-fill target, at stream start.
+*/
+void bt_app_delay_start(void);
+
+/*
+* Measures the audio buffered in the ringbuffer and queued in the output,
+* and reports the averaged delay once it differs from the reported one by
+* more than CONFIG_EXAMPLE_A2DP_SINK_DELAY_REPORT_THRESHOLD_MS. Called by
+* the I2S task after each write to the output.
+*/
+void bt_app_delay_update(void);
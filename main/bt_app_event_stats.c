@@ -0,0 +1,226 @@
+/*
+ * Queue wait and handler runtime histograms of the dispatched work.
+ *
+ * Recording costs a lookup in a small table and a few increments under a
+ * spinlock, cheap enough to stay enabled in production builds. Types are
+ * added on first use and never removed, a reset only clears the counts.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "sdkconfig.h"
+#ifndef CONFIG_EXAMPLE_BUILD_FACTORY_IMAGE
+
+#include "bt_app_event_stats.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+#define NAMES 8
+
+typedef struct {
+    bt_app_cb_t cb;
+    const char *name;
+} handler_name_t;
+
+static const char TAG[] = "EVENT_STATS";
+
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+static bt_app_event_stats_t types[BT_APP_EVENT_STATS_TYPES];
+static size_t type_count = 0;
+static uint32_t overflow = 0;
+static handler_name_t names[NAMES];
+
+#if CONFIG_EXAMPLE_A2DP_SINK_EVENT_STATS_INTERVAL_MS > 0
+/* state of the last publication, only touched by the publishing task */
+static uint32_t published = 0;
+static uint32_t last_publish_ms = 0;
+#endif
+
+
+static inline unsigned int bucket(uint32_t us)
+{
+    /* log2, with everything below the first bound in bucket 0 */
+    const unsigned int b = 31 - __builtin_clz(us | (BT_APP_EVENT_STATS_BUCKET0_US - 1)) -
+                           (31 - __builtin_clz(BT_APP_EVENT_STATS_BUCKET0_US - 1));
+    return (b < BT_APP_EVENT_STATS_BUCKETS) ? b : BT_APP_EVENT_STATS_BUCKETS - 1;
+}
+
+static inline void add(bt_app_event_hist_t *hist, uint32_t us)
+{
+    hist->count++;
+    hist->hist[bucket(us)]++;
+    if (us > hist->max_us)
+    {
+        hist->max_us = us;
+    }
+}
+
+static const char *lookup_name(bt_app_cb_t cb)
+{
+    for (unsigned int i = 0; i < NAMES; i++)
+    {
+        if (names[i].cb == cb)
+        {
+            return names[i].name;
+        }
+    }
+    return NULL;
+}
+
+void bt_app_event_stats_record(bt_app_cb_t cb, uint16_t event, uint32_t wait_us, uint32_t run_us)
+{
+    taskENTER_CRITICAL(&lock);
+    size_t i = 0;
+    while (i < type_count && (types[i].cb != cb || types[i].event != event))
+    {
+        i++;
+    }
+    if (i == type_count)
+    {
+        if (type_count == BT_APP_EVENT_STATS_TYPES)
+        {
+            overflow++;
+            taskEXIT_CRITICAL(&lock);
+            return;
+        }
+        memset(&types[i], 0, sizeof(types[i]));
+        types[i].cb = cb;
+        types[i].event = event;
+        types[i].name = lookup_name(cb);
+        type_count++;
+    }
+    add(&types[i].wait, wait_us);
+    add(&types[i].run, run_us);
+    taskEXIT_CRITICAL(&lock);
+}
+
+void bt_app_event_stats_set_name(bt_app_cb_t cb, const char *name)
+{
+    taskENTER_CRITICAL(&lock);
+    for (unsigned int i = 0; i < NAMES; i++)
+    {
+        if (names[i].cb == NULL || names[i].cb == cb)
+        {
+            names[i].cb = cb;
+            names[i].name = name;
+            break;
+        }
+    }
+    for (size_t i = 0; i < type_count; i++)
+    {
+        if (types[i].cb == cb)
+        {
+            types[i].name = name;
+        }
+    }
+    taskEXIT_CRITICAL(&lock);
+}
+
+size_t bt_app_event_stats_get(bt_app_event_stats_t *stats, size_t max, bool reset)
+{
+    taskENTER_CRITICAL(&lock);
+    const size_t n = (type_count < max) ? type_count : max;
+    memcpy(stats, types, n * sizeof(*stats));
+    if (reset)
+    {
+        for (size_t i = 0; i < type_count; i++)
+        {
+            memset(&types[i].wait, 0, sizeof(types[i].wait));
+            memset(&types[i].run, 0, sizeof(types[i].run));
+        }
+        overflow = 0;
+    }
+    taskEXIT_CRITICAL(&lock);
+    return n;
+}
+
+uint32_t bt_app_event_stats_get_overflow(void)
+{
+    return overflow;
+}
+
+uint32_t bt_app_event_stats_percentile(const bt_app_event_hist_t *hist, unsigned int percent)
+{
+    const uint32_t target = (uint32_t)(((uint64_t)hist->count * percent + 99) / 100);
+    uint32_t sum = 0;
+
+    for (unsigned int i = 0; i < BT_APP_EVENT_STATS_BUCKETS - 1; i++)
+    {
+        sum += hist->hist[i];
+        if (sum >= target)
+        {
+            const uint32_t bound = (uint32_t)BT_APP_EVENT_STATS_BUCKET0_US << i;
+            return (bound < hist->max_us) ? bound : hist->max_us;
+        }
+    }
+    return hist->max_us;
+}
+
+void bt_app_event_stats_log(void)
+{
+    /* copied in turn, so the lock is not held while logging */
+    for (size_t i = 0;; i++)
+    {
+        bt_app_event_stats_t s;
+        taskENTER_CRITICAL(&lock);
+        const bool valid = (i < type_count);
+        if (valid)
+        {
+            s = types[i];
+        }
+        taskEXIT_CRITICAL(&lock);
+        if (!valid)
+        {
+            break;
+        }
+        if (s.run.count == 0)
+        {
+            continue;
+        }
+        char handler[16];
+        if (s.name == NULL)
+        {
+            snprintf(handler, sizeof(handler), "%p", s.cb);
+        }
+        ESP_LOGI(TAG, "%s evt %u: %u, wait p50 %u p99 %u max %u us, run p50 %u p99 %u max %u us",
+                 s.name ? s.name : handler, s.event, s.run.count,
+                 bt_app_event_stats_percentile(&s.wait, 50), bt_app_event_stats_percentile(&s.wait, 99),
+                 s.wait.max_us,
+                 bt_app_event_stats_percentile(&s.run, 50), bt_app_event_stats_percentile(&s.run, 99),
+                 s.run.max_us);
+    }
+    if (overflow)
+    {
+        ESP_LOGW(TAG, "%u events of untracked types", overflow);
+    }
+}
+
+void bt_app_event_stats_publish(void)
+{
+#if CONFIG_EXAMPLE_A2DP_SINK_EVENT_STATS_INTERVAL_MS > 0
+    const uint32_t now = (uint32_t)(esp_timer_get_time() / 1000);
+    if (now - last_publish_ms < CONFIG_EXAMPLE_A2DP_SINK_EVENT_STATS_INTERVAL_MS)
+    {
+        return;
+    }
+    last_publish_ms = now;
+
+    uint32_t total = overflow;
+    taskENTER_CRITICAL(&lock);
+    for (size_t i = 0; i < type_count; i++)
+    {
+        total += types[i].run.count;
+    }
+    taskEXIT_CRITICAL(&lock);
+    if (total == published)
+    {
+        return;
+    }
+    published = total;
+    bt_app_event_stats_log();
+#endif
+}
+
+#endif /* CONFIG_EXAMPLE_BUILD_FACTORY_IMAGE */
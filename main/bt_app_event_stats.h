@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "bt_app_core.h"
+
+/*
+* Timing of the work dispatched to the application task, per event type.
+* An event type is a handler together with an event id, since the ids of
+* the A2DP and AVRCP events overlap. For each type the time a message
+* waited in the queue and the time its handler ran are counted in
+* histograms with power of two buckets: bucket 0 holds times below
+* BT_APP_EVENT_STATS_BUCKET0_US, bucket i times below
+* BT_APP_EVENT_STATS_BUCKET0_US << i, and the last bucket everything above.
+*/
+
+#define BT_APP_EVENT_STATS_BUCKETS      14
+#define BT_APP_EVENT_STATS_BUCKET0_US   32
+#define BT_APP_EVENT_STATS_TYPES        24      /* event types tracked, later ones are counted as overflow */
+
+typedef struct {
+    uint32_t count;                             /* events recorded */
+    uint32_t max_us;
+    uint32_t hist[BT_APP_EVENT_STATS_BUCKETS];
+} bt_app_event_hist_t;
+
+typedef struct {
+    bt_app_cb_t cb;
+    const char *name;                           /* handler name, NULL if none was set */
+    uint16_t event;
+    bt_app_event_hist_t wait;                   /* dispatch to start of the handler */
+    bt_app_event_hist_t run;                    /* handler runtime */
+} bt_app_event_stats_t;
+
+/*
+* Records one handled event, called by the application task.
+*/
+void bt_app_event_stats_record(bt_app_cb_t cb, uint16_t event, uint32_t wait_us, uint32_t run_us);
+
+/*
+* Names a handler for the log output, handlers without a name are logged
+* by address.
+*/
+void bt_app_event_stats_set_name(bt_app_cb_t cb, const char *name);
+
+/*
+* Copies the statistics of up to max event types and returns the number
+* copied. Resets all statistics if reset is set.
+*/
+size_t bt_app_event_stats_get(bt_app_event_stats_t *stats, size_t max, bool reset);
+
+/*
+* Returns the number of events that found no free slot for their type.
+*/
+uint32_t bt_app_event_stats_get_overflow(void);
+
+/*
+* Returns the upper bound in us of the bucket holding the given percentile,
+* or the maximum if that lies in the last bucket.
+*/
+uint32_t bt_app_event_stats_percentile(const bt_app_event_hist_t *hist, unsigned int percent);
+
+/*
+* Logs a summary line per event type.
+*/
+void bt_app_event_stats_log(void);
+
+/*
+* Logs the summary if events were recorded since the last one, at most once
+* per CONFIG_EXAMPLE_A2DP_SINK_EVENT_STATS_INTERVAL_MS. Called periodically
+* by the application task.
+*/
+void bt_app_event_stats_publish(void);
@@ -0,0 +1,293 @@
+/*
+ * Jitter buffer fill level control.
+ *
+ * The fill level is counted in payload bytes, incremented by the producer
+ * and decremented by the consumer. Everything else is only touched by the
+ * consumer (the I2S task), except for the statistics which are read by the
+ * application task.
+ *
+ * Policies:
+ * - Low watermark or underrun: with EXAMPLE_A2DP_SINK_JITTER_ADAPTIVE the
+ *   pre-fill target is raised by one step (up to the high watermark), so
+ *   that the next (re)buffering keeps a larger reserve. It is lowered again
+ *   by one step after each period without low watermark crossing.
+ * - High watermark: with EXAMPLE_A2DP_SINK_JITTER_DROP_ON_HIGH the consumer
+ *   drops the oldest data to get back to the pre-fill target, keeping the
+ *   latency bounded.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "sdkconfig.h"
+#ifndef CONFIG_EXAMPLE_BUILD_FACTORY_IMAGE
+
+#include "bt_app_jitter.h"
+#include "bt_app_latency.h"
+#include "esp_log.h"
+
+#define ADAPT_STEP_MS 5
+#define ADAPT_STABLE_MS 10000
+/* averaging of the fill level for the delay, over about 64 checks */
+#define AVG_SHIFT 6
+
+static const char TAG[] = "JITTER";
+
+static atomic_size_t fill = 0;
+
+static uint32_t bytes_per_ms = 176;
+static uint32_t bytes_per_s = 176400;
+static size_t prefill_bytes = 0;
+static size_t configured_prefill_bytes = 0;
+static size_t low_bytes = 0;
+static size_t high_bytes = 0;
+static size_t max_prefill_bytes = 0;
+/* audio the output takes in ahead of playback, in 0.1 ms and bytes */
+static uint32_t output_latency = 0;
+static size_t output_bytes = 0;
+static bt_app_jitter_event_t last_event = BT_APP_JITTER_OK;
+static size_t avg_fill_q = 0;   /* averaged fill level, AVG_SHIFT fractional bits */
+
+/* bytes consumed since the last history sample and since the last low watermark crossing */
+static size_t history_consumed = 0;
+static size_t stable_consumed = 0;
+static uint16_t history[BT_APP_JITTER_HISTORY_LEN];
+static unsigned int history_head = 0;
+static unsigned int history_count = 0;
+
+static bt_app_jitter_stats_t stats;
+
+
+static inline uint16_t bytes_to_ms(size_t bytes)
+{
+    return (uint16_t)(bytes / bytes_per_ms);
+}
+
+static void reset_stats(void)
+{
+    memset(&stats, 0, sizeof(stats));
+    stats.prefill_ms = bytes_to_ms(prefill_bytes);
+    stats.min_fill_ms = UINT16_MAX;
+}
+
+void bt_app_jitter_set_format(uint32_t sample_rate, uint8_t channels, size_t capacity)
+{
+    bytes_per_s = sample_rate * channels * sizeof(int16_t);
+    bytes_per_ms = bytes_per_s / 1000;
+    if (bytes_per_ms == 0)
+    {
+        bytes_per_ms = 1;
+        bytes_per_s = 1000;
+    }
+    const bt_app_latency_params_t *profile = bt_app_latency_get_params();
+    high_bytes = profile->high_watermark_ms * bytes_per_ms;
+    high_bytes = (high_bytes < capacity) ? high_bytes : capacity;
+    low_bytes = profile->low_watermark_ms * bytes_per_ms;
+    low_bytes = (low_bytes < high_bytes) ? low_bytes : 0;
+    max_prefill_bytes = high_bytes - (high_bytes - low_bytes) / 4;
+    prefill_bytes = profile->prefill_ms * bytes_per_ms;
+    prefill_bytes = (prefill_bytes < max_prefill_bytes) ? prefill_bytes : max_prefill_bytes;
+    configured_prefill_bytes = prefill_bytes;
+    output_bytes = (size_t)((uint64_t)output_latency * bytes_per_s / 10000);
+
+    atomic_store(&fill, 0);
+    last_event = BT_APP_JITTER_OK;
+    avg_fill_q = 0;
+    history_consumed = 0;
+    stable_consumed = 0;
+    history_head = 0;
+    history_count = 0;
+    reset_stats();
+    ESP_LOGI(TAG, "pre-fill %d ms, watermarks %d/%d ms", bytes_to_ms(prefill_bytes),
+             bytes_to_ms(low_bytes), bytes_to_ms(high_bytes));
+}
+
+void bt_app_jitter_produced(size_t bytes)
+{
+    atomic_fetch_add(&fill, bytes);
+}
+
+void bt_app_jitter_consumed(size_t bytes)
+{
+    atomic_fetch_sub(&fill, bytes);
+    history_consumed += bytes;
+    stable_consumed += bytes;
+}
+
+size_t bt_app_jitter_fill(void)
+{
+    return atomic_load(&fill);
+}
+
+void bt_app_jitter_set_output_latency(uint32_t latency)
+{
+    output_latency = latency;
+    output_bytes = (size_t)((uint64_t)latency * bytes_per_s / 10000);
+}
+
+bool bt_app_jitter_prefilled(void)
+{
+    /* the output takes its share at once when started, what remains in the
+       buffer must still be the pre-fill target */
+    size_t start_bytes = prefill_bytes + output_bytes;
+    start_bytes = (start_bytes < high_bytes) ? start_bytes : high_bytes;
+    return atomic_load(&fill) >= start_bytes;
+}
+
+size_t bt_app_jitter_target(void)
+{
+    return prefill_bytes;
+}
+
+static void raise_prefill(void)
+{
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_JITTER_ADAPTIVE
+    prefill_bytes += ADAPT_STEP_MS * bytes_per_ms;
+    prefill_bytes = (prefill_bytes < max_prefill_bytes) ? prefill_bytes : max_prefill_bytes;
+    stats.prefill_ms = bytes_to_ms(prefill_bytes);
+#endif
+    stable_consumed = 0;
+}
+
+static void lower_prefill(void)
+{
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_JITTER_ADAPTIVE
+    const size_t step = ADAPT_STEP_MS * bytes_per_ms;
+    if (prefill_bytes >= configured_prefill_bytes + step)
+    {
+        prefill_bytes -= step;
+        stats.prefill_ms = bytes_to_ms(prefill_bytes);
+    }
+#endif
+    stable_consumed = 0;
+}
+
+bt_app_jitter_event_t bt_app_jitter_check(void)
+{
+    const size_t level = atomic_load(&fill);
+    const uint16_t level_ms = bytes_to_ms(level);
+    bt_app_jitter_event_t event = BT_APP_JITTER_OK;
+
+    if (level_ms < stats.min_fill_ms)
+    {
+        stats.min_fill_ms = level_ms;
+    }
+    if (level_ms > stats.max_fill_ms)
+    {
+        stats.max_fill_ms = level_ms;
+    }
+    /* start the average from the first level instead of ramping up from empty */
+    avg_fill_q = (avg_fill_q == 0) ? (level << AVG_SHIFT) : (avg_fill_q + level - (avg_fill_q >> AVG_SHIFT));
+
+    if (history_consumed >= BT_APP_JITTER_HISTORY_INTERVAL_MS * bytes_per_ms)
+    {
+        history_consumed = 0;
+        history[history_head] = level_ms;
+        history_head = (history_head + 1) % BT_APP_JITTER_HISTORY_LEN;
+        if (history_count < BT_APP_JITTER_HISTORY_LEN)
+        {
+            history_count++;
+        }
+    }
+
+    if (level < low_bytes)
+    {
+        event = BT_APP_JITTER_LOW;
+    }
+    else if (level > high_bytes)
+    {
+        event = BT_APP_JITTER_HIGH;
+    }
+    else if (stable_consumed >= ADAPT_STABLE_MS * bytes_per_ms)
+    {
+        lower_prefill();
+    }
+
+    /* report each crossing only once */
+    if (event == last_event)
+    {
+        return BT_APP_JITTER_OK;
+    }
+    last_event = event;
+    if (event == BT_APP_JITTER_LOW)
+    {
+        stats.low_count++;
+        raise_prefill();
+    }
+    else if (event == BT_APP_JITTER_HIGH)
+    {
+        stats.high_count++;
+    }
+    return event;
+}
+
+static inline uint32_t bytes_to_delay(size_t bytes)
+{
+    return (uint32_t)((uint64_t)bytes * 10000 / bytes_per_s);
+}
+
+uint32_t bt_app_jitter_fill_delay(void)
+{
+    return bytes_to_delay(atomic_load(&fill));
+}
+
+uint32_t bt_app_jitter_avg_delay(void)
+{
+    return bytes_to_delay(avg_fill_q >> AVG_SHIFT);
+}
+
+uint32_t bt_app_jitter_target_delay(void)
+{
+    return bytes_to_delay(prefill_bytes);
+}
+
+size_t bt_app_jitter_excess(void)
+{
+    const size_t level = atomic_load(&fill);
+    return (level > prefill_bytes) ? (level - prefill_bytes) : 0;
+}
+
+void bt_app_jitter_dropped(size_t bytes)
+{
+    stats.dropped_bytes += bytes;
+}
+
+void bt_app_jitter_discarded(size_t bytes)
+{
+    atomic_fetch_sub(&fill, bytes);
+}
+
+void bt_app_jitter_underrun(void)
+{
+    stats.underrun_count++;
+    last_event = BT_APP_JITTER_OK;
+    raise_prefill();
+}
+
+void bt_app_jitter_get_stats(bt_app_jitter_stats_t *out, bool reset)
+{
+    *out = stats;
+    if (out->min_fill_ms > out->max_fill_ms)
+    {
+        out->min_fill_ms = 0;
+    }
+    if (reset)
+    {
+        reset_stats();
+    }
+}
+
+size_t bt_app_jitter_get_history(uint16_t *fill_ms, size_t max_count)
+{
+    const size_t count = (history_count < max_count) ? history_count : max_count;
+    /* copy the most recent entries, oldest first */
+    unsigned int idx = (history_head + BT_APP_JITTER_HISTORY_LEN - count) % BT_APP_JITTER_HISTORY_LEN;
+    for (size_t i = 0; i < count; i++)
+    {
+        fill_ms[i] = history[idx];
+        idx = (idx + 1) % BT_APP_JITTER_HISTORY_LEN;
+    }
+    return count;
+}
+
+#endif /* CONFIG_EXAMPLE_BUILD_FACTORY_IMAGE */
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+* Fill level accounting and control for the buffer between the A2DP data
+* callback (producer) and the I2S task (consumer). Output only starts once
+* the buffer holds the pre-fill amount, and the policies below are applied
+* when the fill level crosses the low or high watermark.
+*/
+
+/* number of fill level samples kept for diagnostics */
+#define BT_APP_JITTER_HISTORY_LEN 64
+/* interval between two fill level samples, in ms of audio played */
+#define BT_APP_JITTER_HISTORY_INTERVAL_MS 100
+
+typedef enum {
+    BT_APP_JITTER_OK = 0,
+    BT_APP_JITTER_LOW,          /* fill level dropped below the low watermark */
+    BT_APP_JITTER_HIGH,         /* fill level rose above the high watermark */
+} bt_app_jitter_event_t;
+
+typedef struct {
+    uint32_t low_count;         /* low watermark crossings */
+    uint32_t high_count;        /* high watermark crossings */
+    uint32_t underrun_count;    /* buffer ran empty while playing */
+    uint32_t dropped_bytes;     /* bytes dropped to get back below the high watermark */
+    uint16_t prefill_ms;        /* current pre-fill target */
+    uint16_t min_fill_ms;       /* lowest fill level seen while playing */
+    uint16_t max_fill_ms;       /* highest fill level seen while playing */
+} bt_app_jitter_stats_t;
+
+/*
+* Sets the stream format and the usable buffer capacity in bytes, and
+* resets fill level, pre-fill target and statistics.
+*/
+void bt_app_jitter_set_format(uint32_t sample_rate, uint8_t channels, size_t capacity);
+
+/*
+* Accounts for data added by the producer or removed by the consumer.
+*/
+void bt_app_jitter_produced(size_t bytes);
+void bt_app_jitter_consumed(size_t bytes);
+
+/*
+* Returns the current fill level in bytes.
+*/
+size_t bt_app_jitter_fill(void);
+
+/*
+* Sets the latency of the output in units of 0.1 ms, the audio it takes in
+* ahead of playback (its DMA buffers). Kept across format changes.
+*/
+void bt_app_jitter_set_output_latency(uint32_t latency);
+
+/*
+* Returns true once the fill level reached the pre-fill target plus the
+* output latency, so that the pre-fill target remains buffered after the
+* output has been filled. Limited to the high watermark.
+*/
+bool bt_app_jitter_prefilled(void);
+
+/*
+* Returns the current pre-fill target in bytes, the fill level the buffer
+* is kept at.
+*/
+size_t bt_app_jitter_target(void);
+
+/*
+* Checks the fill level against the watermarks, to be called by the consumer
+* after each item. Reports each crossing once and records the fill level
+* history.
+*/
+bt_app_jitter_event_t bt_app_jitter_check(void);
+
+/*
+* Returns the current fill level, the fill level averaged over the recent
+* checks, and the pre-fill target, as a delay in units of 0.1 ms. The
+* average is only maintained by the consumer.
+*/
+uint32_t bt_app_jitter_fill_delay(void);
+uint32_t bt_app_jitter_avg_delay(void);
+uint32_t bt_app_jitter_target_delay(void);
+
+/*
+* Returns the number of bytes above the pre-fill target.
+*/
+size_t bt_app_jitter_excess(void);
+
+/*
+* Accounts for bytes dropped by the consumer.
+*/
+void bt_app_jitter_dropped(size_t bytes);
+
+/*
+* Accounts for bytes dropped before they reached the consumer, may be
+* called by any task.
+*/
+void bt_app_jitter_discarded(size_t bytes);
+
+/*
+* Records that the buffer ran empty while playing.
+*/
+void bt_app_jitter_underrun(void);
+
+/*
+* Gets and optionally resets the statistics.
+*/
+void bt_app_jitter_get_stats(bt_app_jitter_stats_t *stats, bool reset);
+
+/*
+* Copies the recorded fill levels in ms, oldest first. Returns the number
+* of entries copied.
+*/
+size_t bt_app_jitter_get_history(uint16_t *fill_ms, size_t max_count);
@@ -0,0 +1,155 @@
+/*
+ * Latency profiles for the output path.
+ *
+ * The balanced profile uses the values from menuconfig, the others scale
+ * the buffering down or up. The DMA descriptors are sized per output: the
+ * internal DAC runs at a multiple of the stream rate with short
+ * descriptors. For standard I2S the DMA holds about half of the pre-fill,
+ * so that the audio buffered at start-up is not handed to the DMA in full.
+ *
+ * The profile is read when the output driver is installed and when the
+ * ringbuffer and jitter buffer are set up, and locked in between.
+ */
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include "sdkconfig.h"
+#ifndef CONFIG_EXAMPLE_BUILD_FACTORY_IMAGE
+
+#include "bt_app_latency.h"
+#include "esp_log.h"
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_LATENCY_CONSOLE
+#include <stdio.h>
+#include <string.h>
+#include "esp_console.h"
+#endif
+
+static const char TAG[] = "LATENCY";
+
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_INTERNAL_DAC
+#define DMA_FRAMES_LOW 60
+#define DMA_FRAMES_BALANCED 60
+#define DMA_FRAMES_ROBUST 120
+#else
+#define DMA_FRAMES_LOW 60
+#define DMA_FRAMES_BALANCED 120
+#define DMA_FRAMES_ROBUST 240
+#endif
+
+static const bt_app_latency_params_t profiles[BT_APP_LATENCY_NUM] = {
+    [BT_APP_LATENCY_LOW] = {
+        .name = "low-latency",
+        .ringbuf_ms = 30,
+        .prefill_ms = 10,
+        .low_watermark_ms = 3,
+        .high_watermark_ms = 28,
+        .dma_desc_num = 4,
+        .dma_frame_num = DMA_FRAMES_LOW,
+    },
+    [BT_APP_LATENCY_BALANCED] = {
+        .name = "balanced",
+        .ringbuf_ms = CONFIG_EXAMPLE_A2DP_SINK_RINGBUF_LATENCY_MS,
+        .prefill_ms = CONFIG_EXAMPLE_A2DP_SINK_JITTER_PREFILL_MS,
+        .low_watermark_ms = CONFIG_EXAMPLE_A2DP_SINK_JITTER_LOW_WATERMARK_MS,
+        .high_watermark_ms = CONFIG_EXAMPLE_A2DP_SINK_JITTER_HIGH_WATERMARK_MS,
+        .dma_desc_num = 4,
+        .dma_frame_num = DMA_FRAMES_BALANCED,
+    },
+    [BT_APP_LATENCY_ROBUST] = {
+        .name = "robust",
+        .ringbuf_ms = 80,
+        .prefill_ms = 50,
+        .low_watermark_ms = 15,
+        .high_watermark_ms = 75,
+        .dma_desc_num = 6,
+        .dma_frame_num = DMA_FRAMES_ROBUST,
+    },
+};
+
+#if defined(CONFIG_EXAMPLE_A2DP_SINK_LATENCY_PROFILE_LOW)
+static atomic_int selected = BT_APP_LATENCY_LOW;
+#elif defined(CONFIG_EXAMPLE_A2DP_SINK_LATENCY_PROFILE_ROBUST)
+static atomic_int selected = BT_APP_LATENCY_ROBUST;
+#else
+static atomic_int selected = BT_APP_LATENCY_BALANCED;
+#endif
+static atomic_bool locked = false;
+
+
+bool bt_app_latency_set_profile(bt_app_latency_profile_t profile)
+{
+    if (profile >= BT_APP_LATENCY_NUM || atomic_load(&locked))
+    {
+        ESP_LOGW(TAG, "cannot select profile %d while connected", profile);
+        return false;
+    }
+    atomic_store(&selected, profile);
+    ESP_LOGI(TAG, "profile %s selected", profiles[profile].name);
+    return true;
+}
+
+bt_app_latency_profile_t bt_app_latency_get_profile(void)
+{
+    return (bt_app_latency_profile_t)atomic_load(&selected);
+}
+
+const bt_app_latency_params_t *bt_app_latency_get_params(void)
+{
+    return &profiles[atomic_load(&selected)];
+}
+
+void bt_app_latency_lock(bool value)
+{
+    atomic_store(&locked, value);
+}
+
+void bt_app_latency_log(uint32_t output_latency)
+{
+    const bt_app_latency_params_t *p = bt_app_latency_get_params();
+    const uint32_t dma_ms = output_latency / 10;
+    ESP_LOGI(TAG, "%s: pre-fill %u ms + DMA %u x %u frames %u ms = %u ms", p->name, p->prefill_ms,
+             p->dma_desc_num, p->dma_frame_num, dma_ms, p->prefill_ms + dma_ms);
+}
+
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_LATENCY_CONSOLE
+static int latency_cmd(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        printf("%s\n", bt_app_latency_get_params()->name);
+        return 0;
+    }
+    for (int i = 0; i < BT_APP_LATENCY_NUM; i++)
+    {
+        if (strncmp(argv[1], profiles[i].name, strlen(argv[1])) == 0)
+        {
+            return bt_app_latency_set_profile((bt_app_latency_profile_t)i) ? 0 : 1;
+        }
+    }
+    printf("unknown profile %s\n", argv[1]);
+    return 1;
+}
+
+void bt_app_latency_console_start(void)
+{
+    esp_console_repl_t *repl = NULL;
+    esp_console_repl_config_t repl_config = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
+    esp_console_dev_uart_config_t uart_config = ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
+    const esp_console_cmd_t cmd = {
+        .command = "latency",
+        .help = "Show or select the latency profile for the next connection",
+        .hint = "[low|balanced|robust]",
+        .func = &latency_cmd,
+    };
+
+    repl_config.prompt = "a2dp>";
+    if (esp_console_new_repl_uart(&uart_config, &repl_config, &repl) != ESP_OK ||
+        esp_console_cmd_register(&cmd) != ESP_OK ||
+        esp_console_start_repl(repl) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "console not started");
+    }
+}
+#endif
+
+#endif /* CONFIG_EXAMPLE_BUILD_FACTORY_IMAGE */
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+
+/*
+* Latency profiles for the output path. A profile sets the ringbuffer size,
+* the jitter buffer pre-fill and watermarks, and the DMA descriptors of the
+* output driver together. The profile can only be changed while no source
+* is connected, and takes effect with the next connection.
+*/
+
+typedef enum {
+    BT_APP_LATENCY_LOW = 0,         /* for video, accepts more glitches on a busy link */
+    BT_APP_LATENCY_BALANCED,        /* as configured in menuconfig */
+    BT_APP_LATENCY_ROBUST,          /* for music, rides out long gaps in the link */
+    BT_APP_LATENCY_NUM,
+} bt_app_latency_profile_t;
+
+typedef struct {
+    const char *name;
+    uint16_t ringbuf_ms;            /* ringbuffer size, in ms of audio */
+    uint16_t prefill_ms;            /* jitter buffer pre-fill */
+    uint16_t low_watermark_ms;
+    uint16_t high_watermark_ms;
+    uint8_t dma_desc_num;           /* number of DMA descriptors */
+    uint16_t dma_frame_num;         /* frames per DMA descriptor, at the output rate */
+} bt_app_latency_params_t;
+
+/*
+* Selects the profile for the next connection. Returns false while a source
+* is connected.
+*/
+bool bt_app_latency_set_profile(bt_app_latency_profile_t profile);
+
+/*
+* Returns the selected profile and its parameters.
+*/
+bt_app_latency_profile_t bt_app_latency_get_profile(void);
+const bt_app_latency_params_t *bt_app_latency_get_params(void);
+
+/*
+* Locks the profile while a source is connected, from the start of the
+* connection until the output has been shut down.
+*/
+void bt_app_latency_lock(bool locked);
+
+/*
+* Logs the latency of the output path expected from the profile: the
+* pre-fill plus the output latency in 0.1 ms, as reported by the output
+* backend for its DMA descriptors.
+*/
+void bt_app_latency_log(uint32_t output_latency);
+
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_LATENCY_CONSOLE
+/*
+* Starts a console on the UART with a "latency" command, which shows the
+* selected profile or selects one by (abbreviated) name while no source is
+* connected.
+*/
+void bt_app_latency_console_start(void);
+#endif
@@ -0,0 +1,132 @@
+/*
+ * Output backend selection and helpers shared by the backends.
+ *
+ * The emulated clock lets backends without a DMA (the WAV file and the null
+ * sink) consume audio in real time, so that the jitter buffer, the clock
+ * drift compensation and the delay reporting see the same flow as with a
+ * hardware output.
+ */
+
+#include <stdint.h>
+#include "sdkconfig.h"
+#ifndef CONFIG_EXAMPLE_BUILD_FACTORY_IMAGE
+
+#include "bt_app_output.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+
+const bt_app_output_t *bt_app_output_get(void)
+{
+#if defined(CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_INTERNAL_DAC)
+    return &bt_app_output_dac;
+#elif defined(CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_WAV_FILE)
+    return &bt_app_output_wav;
+#elif defined(CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_NULL)
+    return &bt_app_output_null;
+#else
+    return &bt_app_output_i2s_std;
+#endif
+}
+
+void bt_app_output_clock_reset(bt_app_output_clock_t *clock, uint32_t sample_rate, uint8_t ch_count,
+                               uint32_t ahead_frames)
+{
+    clock->running = false;
+    clock->start_us = esp_timer_get_time();
+    clock->bytes = 0;
+    clock->starved_bytes = 0;
+    clock->frame_size = ch_count * sizeof(int16_t);
+    clock->bytes_per_s = sample_rate * clock->frame_size;
+    /* the writer waits for room a tick at a time, less would starve the output */
+    const uint32_t min_frames = 2 * sample_rate / configTICK_RATE_HZ;
+    clock->ahead_bytes = ((ahead_frames > min_frames) ? ahead_frames : min_frames) * clock->frame_size;
+}
+
+/* bytes played since the clock started */
+static uint64_t played_bytes(const bt_app_output_clock_t *clock)
+{
+    if (!clock->running)
+    {
+        return 0;
+    }
+    return (uint64_t)(esp_timer_get_time() - clock->start_us) * clock->bytes_per_s / 1000000;
+}
+
+size_t bt_app_output_clock_wait(bt_app_output_clock_t *clock, size_t size, TickType_t wait)
+{
+    const TickType_t start = xTaskGetTickCount();
+
+    if (!clock->running)
+    {
+        clock->running = true;
+        clock->start_us = esp_timer_get_time();
+    }
+    for (;;)
+    {
+        const uint64_t played = played_bytes(clock);
+        if (played > clock->bytes)
+        {
+            /* not fed in time, the output ran empty */
+            clock->starved_bytes += played - clock->bytes;
+            clock->bytes = played;
+        }
+        uint64_t room = played + clock->ahead_bytes - clock->bytes;
+        room -= room % clock->frame_size;
+        if (room > 0)
+        {
+            return (room < size) ? (size_t)room : size;
+        }
+        if (xTaskGetTickCount() - start >= wait)
+        {
+            return 0;
+        }
+        vTaskDelay(1);
+    }
+}
+
+void bt_app_output_clock_advance(bt_app_output_clock_t *clock, size_t bytes)
+{
+    clock->bytes += bytes;
+}
+
+size_t bt_app_output_clock_preload(bt_app_output_clock_t *clock, size_t size)
+{
+    if (clock->running || clock->bytes >= clock->ahead_bytes)
+    {
+        return 0;
+    }
+    const size_t room = clock->ahead_bytes - (size_t)clock->bytes;
+    size = (room < size) ? room : size;
+    return size - size % clock->frame_size;
+}
+
+uint32_t bt_app_output_clock_latency(const bt_app_output_clock_t *clock)
+{
+    return (clock->bytes_per_s > 0) ? (uint32_t)((uint64_t)clock->ahead_bytes * 10000 / clock->bytes_per_s) : 0;
+}
+
+uint32_t bt_app_output_clock_queued(const bt_app_output_clock_t *clock)
+{
+    const uint64_t played = played_bytes(clock);
+    const uint64_t queued = (clock->bytes > played) ? (clock->bytes - played) : 0;
+    return (clock->bytes_per_s > 0) ? (uint32_t)(queued * 10000 / clock->bytes_per_s) : 0;
+}
+
+void bt_app_output_clock_report(const char *tag, const bt_app_output_clock_t *clock)
+{
+    const uint64_t elapsed_us = esp_timer_get_time() - clock->start_us;
+    const uint64_t expected = elapsed_us * clock->bytes_per_s / 1000000;
+    const uint64_t fed = clock->bytes - clock->starved_bytes;
+    const uint32_t latency = bt_app_output_clock_latency(clock);
+
+    if (!clock->running || clock->bytes_per_s == 0 || expected == 0)
+    {
+        return;
+    }
+    ESP_LOGI(tag, "%u ms: %llu bytes, %u%% of real time, starved %u ms, latency %u.%u ms",
+             (uint32_t)(elapsed_us / 1000), fed, (uint32_t)(fed * 100 / expected),
+             (uint32_t)(clock->starved_bytes * 1000 / clock->bytes_per_s), latency / 10, latency % 10);
+}
+
+#endif /* CONFIG_EXAMPLE_BUILD_FACTORY_IMAGE */
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "bt_app_latency.h"
+
+/*
+* Output backends. A backend takes the processed audio from the I2S task,
+* copied from the ringbuffer with write(). The audio is 16 bit PCM in the
+* stream format, except for the sample encoding of the internal DAC (see
+* bt_app_dac_output.h).
+*
+* The audio is not processed in a buffer of the output: the I2S drivers
+* copy into their DMA descriptors and expose none for writing, the DAC
+* resamples on the way, and the WAV and null outputs have no buffer of
+* their own. The processing runs in place in the ringbuffer instead, the
+* copy by write() is the only one after it.
+*
+* install, uninstall and set_format are called by the application task
+* while the I2S task is paused or not running, the others by the I2S task.
+*/
+
+typedef struct {
+    uint32_t count;             /* wakeups on room in the output */
+    uint32_t latency_sum_us;    /* from the interrupt to the writer running */
+    uint32_t latency_max_us;
+} bt_app_output_wakeups_t;
+
+typedef struct {
+    const char *name;
+
+    /* installs the output for 44.1 kHz stereo with the DMA buffering of the
+       latency profile, it starts with the first audio written */
+    esp_err_t (*install)(const bt_app_latency_params_t *latency);
+    void (*uninstall)(void);
+
+    /* configures the stream format, the output starts again with the
+       first audio written */
+    void (*set_format)(uint32_t sample_rate, uint8_t ch_count);
+
+    /* copies audio to the output, returns the number of bytes taken
+       within wait */
+    size_t (*write)(const uint8_t *data, size_t size, TickType_t wait);
+
+    /* optional, loads audio before the output starts after install or
+       set_format, it starts with the next write; returns the
+       number of bytes loaded, 0 once the output has started */
+    size_t (*preload)(const uint8_t *data, size_t size);
+
+    /* returns the delay of the audio the output holds when full, in 0.1 ms */
+    uint32_t (*latency)(void);
+
+    /* optional, returns the delay of the audio queued in the output right
+       now, in 0.1 ms; without it the output is taken to be full */
+    uint32_t (*queued)(void);
+
+    /* optional, gets and optionally resets the wakeup statistics, with
+       CONFIG_EXAMPLE_A2DP_SINK_PROFILE_DSP */
+    void (*get_wakeups)(bt_app_output_wakeups_t *wakeups, bool reset);
+} bt_app_output_t;
+
+extern const bt_app_output_t bt_app_output_i2s_std;
+extern const bt_app_output_t bt_app_output_dac;
+extern const bt_app_output_t bt_app_output_wav;
+extern const bt_app_output_t bt_app_output_null;
+
+/*
+* Returns the backend selected in menuconfig.
+*/
+const bt_app_output_t *bt_app_output_get(void);
+
+/*
+* Emulated DMA clock for backends without hardware pacing: audio is taken
+* at the sample rate from the first write after a reset, with up to
+* ahead_frames queued like in DMA descriptors. Time the output was not fed
+* is skipped, as the DMA would play silence. The writer is only woken per
+* tick rather than per DMA buffer, so at least two ticks of audio are
+* queued.
+*/
+typedef struct {
+    bool running;               /* written since the reset */
+    int64_t start_us;
+    uint64_t bytes;             /* taken since start_us */
+    uint64_t starved_bytes;     /* skipped because the output was not fed */
+    uint32_t bytes_per_s;
+    uint32_t frame_size;
+    uint32_t ahead_bytes;
+} bt_app_output_clock_t;
+
+void bt_app_output_clock_reset(bt_app_output_clock_t *clock, uint32_t sample_rate, uint8_t ch_count,
+                               uint32_t ahead_frames);
+
+/*
+* Returns how many whole frames of size bytes may be taken, waiting up to
+* wait for room. The caller advances the clock by the bytes it took.
+*/
+size_t bt_app_output_clock_wait(bt_app_output_clock_t *clock, size_t size, TickType_t wait);
+void bt_app_output_clock_advance(bt_app_output_clock_t *clock, size_t bytes);
+
+/*
+* Returns how many whole frames of size bytes may be loaded before the
+* clock runs, 0 once it does. The caller advances the clock by the bytes it
+* loaded.
+*/
+size_t bt_app_output_clock_preload(bt_app_output_clock_t *clock, size_t size);
+
+/*
+* Returns the delay of the audio the clock lets queue ahead, and of the
+* audio queued right now, in 0.1 ms.
+*/
+uint32_t bt_app_output_clock_latency(const bt_app_output_clock_t *clock);
+uint32_t bt_app_output_clock_queued(const bt_app_output_clock_t *clock);
+
+/*
+* Logs the audio taken since the clock was reset: the throughput relative to
+* the sample rate, the time the output was starved and the latency. Lets a
+* run on the WAV file or null output be checked without listening.
+*/
+void bt_app_output_clock_report(const char *tag, const bt_app_output_clock_t *clock);
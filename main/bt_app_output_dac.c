@@ -0,0 +1,173 @@
+/*
+ * Output backend for the internal DAC.
+ *
+ * DAC DMA mode is only supported by the legacy I2S driver, which reports
+ * DMA events through a queue instead of callbacks; they are collected after
+ * each write. The DAC runs at BT_APP_DAC_RATE_FACTOR times the stream rate,
+ * the resampler output goes through a buffer of its own. The resampler state
+ * moves on with each chunk, so what the driver did not take within the wait
+ * is kept there and written first by the next call.
+ */
+
+#include <stdint.h>
+#include "sdkconfig.h"
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_INTERNAL_DAC
+
+#include "bt_app_output.h"
+#include "bt_app_dac_output.h"
+#include "bt_app_xrun.h"
+#include "driver/i2s.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+static QueueHandle_t event_queue = NULL;    /* events of the legacy I2S driver */
+static uint32_t output_rate = 44100 * BT_APP_DAC_RATE_FACTOR;
+static uint32_t dma_frames = 0;             /* frames in all DMA buffers */
+static uint32_t frame_size = 4;             /* bytes per frame at the output */
+static uint32_t queued_bytes = 0;           /* written and not reported sent yet */
+#ifdef BT_APP_DAC_RESAMPLE
+static uint8_t resample_buf[1024];
+static size_t resample_len = 0;             /* resampled bytes in resample_buf */
+static size_t resample_pos = 0;             /* of which already written */
+#endif
+
+
+static esp_err_t install(const bt_app_latency_params_t *latency)
+{
+    i2s_config_t i2s_config = {
+        .mode = I2S_MODE_MASTER | I2S_MODE_TX | I2S_MODE_DAC_BUILT_IN,
+        .sample_rate = 44100 * BT_APP_DAC_RATE_FACTOR,
+        .bits_per_sample = 16,
+        .channel_format = I2S_CHANNEL_FMT_RIGHT_LEFT,       /* 2-channels */
+        .communication_format = I2S_COMM_FORMAT_STAND_MSB,
+        .dma_buf_count = latency->dma_desc_num,
+        .dma_buf_len = latency->dma_frame_num,
+        .intr_alloc_flags = 0,                              /* default interrupt priority */
+        .tx_desc_auto_clear = true                          /* auto clear tx descriptor on underflow */
+    };
+
+    esp_err_t err = i2s_driver_install(0, &i2s_config, i2s_config.dma_buf_count, &event_queue);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    if ((err = i2s_set_dac_mode(I2S_DAC_CHANNEL_BOTH_EN)) != ESP_OK ||
+        (err = i2s_set_pin(0, NULL)) != ESP_OK)
+    {
+        i2s_driver_uninstall(0);
+        event_queue = NULL;
+        return err;
+    }
+    output_rate = i2s_config.sample_rate;
+    frame_size = 2 * sizeof(int16_t);
+    dma_frames = latency->dma_desc_num * latency->dma_frame_num;
+    queued_bytes = 0;
+    return ESP_OK;
+}
+
+static void uninstall(void)
+{
+    i2s_driver_uninstall(0);
+    event_queue = NULL;
+#ifdef BT_APP_DAC_RESAMPLE
+    resample_len = resample_pos = 0;
+#endif
+}
+
+static void set_format(uint32_t sample_rate, uint8_t ch_count)
+{
+#ifdef BT_APP_DAC_RESAMPLE
+    resample_len = resample_pos = 0;
+#endif
+    output_rate = sample_rate * BT_APP_DAC_RATE_FACTOR;
+    frame_size = ch_count * sizeof(int16_t);
+    queued_bytes = 0;
+    i2s_set_clk(0, output_rate, 16, ch_count);
+}
+
+/* timestamps of the DMA events are taken here, they are queued from the ISR */
+static void collect_events(void)
+{
+    i2s_event_t event;
+
+    while (event_queue && xQueueReceive(event_queue, &event, 0) == pdTRUE)
+    {
+        if (event.type == I2S_EVENT_TX_DONE)
+        {
+            bt_app_xrun_record(BT_APP_XRUN_DMA_SENT);
+            queued_bytes = (queued_bytes > event.size) ? (queued_bytes - event.size) : 0;
+        }
+        else if (event.type == I2S_EVENT_TX_Q_OVF)
+        {
+            bt_app_xrun_record(BT_APP_XRUN_DMA_UNDERRUN);
+        }
+    }
+}
+
+static size_t write_data(const uint8_t *data, size_t size, TickType_t wait)
+{
+    size_t written = 0;
+
+#ifdef BT_APP_DAC_RESAMPLE
+    /* leave room for the two extra frames the resampler may produce; an input
+       chunk counts as written once it is resampled, its output is kept until
+       the driver took all of it */
+    const size_t max_chunk = (sizeof(resample_buf) - 2 * 2 * sizeof(int16_t)) / BT_APP_DAC_RATE_FACTOR & ~3U;
+    const TickType_t start = xTaskGetTickCount();
+    for (;;)
+    {
+        if (resample_pos < resample_len)
+        {
+            const TickType_t elapsed = xTaskGetTickCount() - start;
+            size_t chunk_written = 0;
+            i2s_write(0, resample_buf + resample_pos, resample_len - resample_pos, &chunk_written,
+                      (elapsed < wait) ? (wait - elapsed) : 0);
+            resample_pos += chunk_written;
+            queued_bytes += chunk_written;
+            if (resample_pos < resample_len)
+            {
+                break;
+            }
+        }
+        if (written == size)
+        {
+            break;
+        }
+        const size_t chunk = (size - written < max_chunk) ? (size - written) : max_chunk;
+        resample_len = bt_app_dac_resample(data + written, chunk, resample_buf);
+        resample_pos = 0;
+        written += chunk;
+    }
+#else
+    i2s_write(0, data, size, &written, wait);
+    queued_bytes += written;
+#endif
+    collect_events();
+    const uint32_t dma_bytes = dma_frames * frame_size;
+    queued_bytes = (queued_bytes < dma_bytes) ? queued_bytes : dma_bytes;
+    return written;
+}
+
+static uint32_t latency(void)
+{
+    return (uint32_t)((uint64_t)dma_frames * 10000 / output_rate);
+}
+
+/* lags by the DMA events not collected yet, at most the time since the
+   last write */
+static uint32_t queued(void)
+{
+    return (uint32_t)((uint64_t)queued_bytes * 10000 / (output_rate * frame_size));
+}
+
+const bt_app_output_t bt_app_output_dac = {
+    .name = "internal DAC",
+    .install = install,
+    .uninstall = uninstall,
+    .set_format = set_format,
+    .write = write_data,
+    .latency = latency,
+    .queued = queued,
+};
+
+#endif /* CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_INTERNAL_DAC */
@@ -0,0 +1,263 @@
+/*
+ * Output backend for an external codec on standard I2S.
+ *
+ * Writes only take what fits into the free DMA descriptors, the writer then
+ * sleeps until the DMA sent the next descriptor instead of blocking in the
+ * driver.
+ *
+ * The channel is left disabled after install and set_format and enabled by
+ * the first write, so that the descriptors can be preloaded once before. It
+ * is never disabled to preload again while playing: a rebuffer after an
+ * underrun keeps the channel running on the silence of auto_clear.
+ */
+
+#include <stdint.h>
+#include "sdkconfig.h"
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_EXTERNAL_I2S
+
+#include "bt_app_output.h"
+#include "bt_app_xrun.h"
+#include "driver/i2s_std.h"
+#include "esp_attr.h"
+#include "esp_idf_version.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 0)
+/* the DMA descriptors can be loaded before the channel is enabled */
+#define OUTPUT_PRELOAD
+#endif
+
+static i2s_chan_handle_t tx_chan = NULL;
+static uint32_t sample_rate = 44100;
+static uint32_t dma_frames = 0;             /* frames in all DMA descriptors */
+static uint32_t frame_size = 4;             /* bytes per frame at the output */
+static uint32_t queued_bytes = 0;           /* written and not sent yet, under waiter_lock */
+static bool stopped = true;                 /* disabled since install or set_format */
+static TaskHandle_t waiter = NULL;          /* task waiting for a free DMA descriptor */
+static portMUX_TYPE waiter_lock = portMUX_INITIALIZER_UNLOCKED;
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_PROFILE_DSP
+static volatile int64_t sent_time = 0;
+static bt_app_output_wakeups_t wakeups = {0};
+#endif
+
+
+/* a DMA buffer has been sent */
+static bool IRAM_ATTR on_sent(i2s_chan_handle_t handle, i2s_event_data_t *event, void *user_ctx)
+{
+    BaseType_t woken = pdFALSE;
+
+    bt_app_xrun_record(BT_APP_XRUN_DMA_SENT);
+    taskENTER_CRITICAL_ISR(&waiter_lock);
+    /* silence sent on an underrun was never written */
+    queued_bytes = (queued_bytes > event->size) ? (queued_bytes - event->size) : 0;
+    if (waiter)
+    {
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_PROFILE_DSP
+        sent_time = esp_timer_get_time();
+#endif
+        vTaskNotifyGiveFromISR(waiter, &woken);
+        waiter = NULL;
+    }
+    taskEXIT_CRITICAL_ISR(&waiter_lock);
+    return woken == pdTRUE;
+}
+
+/* the DMA sent a buffer that had not been refilled, i.e. the writer is late */
+static bool IRAM_ATTR on_send_q_ovf(i2s_chan_handle_t handle, i2s_event_data_t *event, void *user_ctx)
+{
+    bt_app_xrun_record(BT_APP_XRUN_DMA_UNDERRUN);
+    return false;
+}
+
+static void set_waiter(TaskHandle_t task)
+{
+    taskENTER_CRITICAL(&waiter_lock);
+    waiter = task;
+    taskEXIT_CRITICAL(&waiter_lock);
+}
+
+/* account for audio loaded into the DMA descriptors, or reset with 0 */
+static void set_queued(size_t added, bool reset)
+{
+    const uint32_t dma_bytes = dma_frames * frame_size;
+
+    taskENTER_CRITICAL(&waiter_lock);
+    queued_bytes = reset ? 0 : queued_bytes + added;
+    queued_bytes = (queued_bytes < dma_bytes) ? queued_bytes : dma_bytes;
+    taskEXIT_CRITICAL(&waiter_lock);
+}
+
+static esp_err_t install(const bt_app_latency_params_t *latency)
+{
+    i2s_chan_config_t chan_cfg = I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_0, I2S_ROLE_MASTER);
+    chan_cfg.auto_clear = true;
+    chan_cfg.dma_desc_num = latency->dma_desc_num;
+    chan_cfg.dma_frame_num = latency->dma_frame_num;
+    i2s_std_config_t std_cfg = {
+        .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(44100),
+        .slot_cfg = I2S_STD_MSB_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT, I2S_SLOT_MODE_STEREO),
+        .gpio_cfg = {
+            .mclk = I2S_GPIO_UNUSED,
+            .bclk = CONFIG_EXAMPLE_I2S_BCK_PIN,
+            .ws = CONFIG_EXAMPLE_I2S_LRCK_PIN,
+            .dout = CONFIG_EXAMPLE_I2S_DATA_PIN,
+            .din = I2S_GPIO_UNUSED,
+            .invert_flags = {
+                .mclk_inv = false,
+                .bclk_inv = false,
+                .ws_inv = false,
+            },
+        },
+    };
+#ifdef CONFIG_SOC_I2S_SUPPORTS_APLL
+    /* use APLL for high precision clock */
+    std_cfg.clk_cfg.clk_src = I2S_CLK_SRC_APLL;
+#endif
+    i2s_event_callbacks_t cbs = {
+        .on_sent = on_sent,
+        .on_send_q_ovf = on_send_q_ovf,
+    };
+
+    esp_err_t err = i2s_new_channel(&chan_cfg, &tx_chan, NULL);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    if ((err = i2s_channel_init_std_mode(tx_chan, &std_cfg)) != ESP_OK ||
+        (err = i2s_channel_register_event_callback(tx_chan, &cbs, NULL)) != ESP_OK)
+    {
+        i2s_del_channel(tx_chan);
+        tx_chan = NULL;
+        return err;
+    }
+    sample_rate = 44100;
+    frame_size = 2 * sizeof(int16_t);
+    dma_frames = latency->dma_desc_num * latency->dma_frame_num;
+    stopped = true;
+    set_queued(0, true);
+    return ESP_OK;
+}
+
+static void uninstall(void)
+{
+    if (!stopped)
+    {
+        i2s_channel_disable(tx_chan);
+    }
+    i2s_del_channel(tx_chan);
+    tx_chan = NULL;
+    stopped = true;
+}
+
+static void set_format(uint32_t rate, uint8_t ch_count)
+{
+    if (!stopped)
+    {
+        i2s_channel_disable(tx_chan);
+    }
+    i2s_std_clk_config_t clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(rate);
+#ifdef CONFIG_SOC_I2S_SUPPORTS_APLL
+    clk_cfg.clk_src = I2S_CLK_SRC_APLL;
+#endif
+    i2s_std_slot_config_t slot_cfg = I2S_STD_MSB_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT, ch_count);
+    i2s_channel_reconfig_std_clock(tx_chan, &clk_cfg);
+    i2s_channel_reconfig_std_slot(tx_chan, &slot_cfg);
+    stopped = true;
+    sample_rate = rate;
+    frame_size = ch_count * sizeof(int16_t);
+    set_queued(0, true);
+}
+
+static size_t write_data(const uint8_t *data, size_t size, TickType_t wait)
+{
+    const TickType_t start = xTaskGetTickCount();
+    size_t written = 0;
+
+    if (stopped)
+    {
+        i2s_channel_enable(tx_chan);
+        stopped = false;
+    }
+    for (;;)
+    {
+        /* armed before writing, so that a descriptor sent meanwhile is not missed */
+        set_waiter(xTaskGetCurrentTaskHandle());
+        size_t chunk = 0;
+        i2s_channel_write(tx_chan, data + written, size - written, &chunk, 0);
+        set_queued(chunk, false);
+        written += chunk;
+        const TickType_t elapsed = xTaskGetTickCount() - start;
+        if (written >= size || elapsed >= wait)
+        {
+            break;
+        }
+        /* the task notification is shared, a wakeup for something else only
+           costs another attempt */
+        if (ulTaskNotifyTake(pdTRUE, wait - elapsed) && waiter == NULL)
+        {
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_PROFILE_DSP
+            const uint32_t delay = (uint32_t)(esp_timer_get_time() - sent_time);
+            wakeups.count++;
+            wakeups.latency_sum_us += delay;
+            wakeups.latency_max_us = (delay > wakeups.latency_max_us) ? delay : wakeups.latency_max_us;
+#endif
+        }
+    }
+    set_waiter(NULL);
+    return written;
+}
+
+#ifdef OUTPUT_PRELOAD
+static size_t preload(const uint8_t *data, size_t size)
+{
+    size_t loaded = 0;
+
+    if (!stopped)
+    {
+        return 0;
+    }
+    i2s_channel_preload_data(tx_chan, data, size, &loaded);
+    set_queued(loaded, false);
+    return loaded;
+}
+#endif
+
+static uint32_t latency(void)
+{
+    return (uint32_t)((uint64_t)dma_frames * 10000 / sample_rate);
+}
+
+static uint32_t queued(void)
+{
+    return (uint32_t)((uint64_t)queued_bytes * 10000 / (sample_rate * frame_size));
+}
+
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_PROFILE_DSP
+static void get_wakeups(bt_app_output_wakeups_t *stats, bool reset)
+{
+    *stats = wakeups;
+    if (reset)
+    {
+        wakeups = (bt_app_output_wakeups_t){0};
+    }
+}
+#endif
+
+const bt_app_output_t bt_app_output_i2s_std = {
+    .name = "I2S",
+    .install = install,
+    .uninstall = uninstall,
+    .set_format = set_format,
+    .write = write_data,
+#ifdef OUTPUT_PRELOAD
+    .preload = preload,
+#endif
+    .latency = latency,
+    .queued = queued,
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_PROFILE_DSP
+    .get_wakeups = get_wakeups,
+#endif
+};
+
+#endif /* CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_EXTERNAL_I2S */
@@ -0,0 +1,80 @@
+/*
+ * Output backend discarding the audio, for measuring the processing chain
+ * and the Bluetooth link without an output. The audio is consumed at the
+ * sample rate by an emulated DMA clock.
+ */
+
+#include <stdint.h>
+#include "sdkconfig.h"
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_NULL
+
+#include "bt_app_output.h"
+#include "esp_log.h"
+
+static const char TAG[] = "OUTPUT_NULL";
+
+static uint32_t dma_frames = 0;             /* frames the emulated DMA holds */
+static uint64_t total_bytes = 0;            /* bytes discarded since install */
+static bt_app_output_clock_t out_clock;
+
+
+static esp_err_t install(const bt_app_latency_params_t *latency)
+{
+    dma_frames = latency->dma_desc_num * latency->dma_frame_num;
+    total_bytes = 0;
+    bt_app_output_clock_reset(&out_clock, 44100, 2, dma_frames);
+    return ESP_OK;
+}
+
+static void uninstall(void)
+{
+    ESP_LOGI(TAG, "%llu bytes discarded", total_bytes);
+    bt_app_output_clock_report(TAG, &out_clock);
+}
+
+static void set_format(uint32_t sample_rate, uint8_t ch_count)
+{
+    bt_app_output_clock_report(TAG, &out_clock);
+    bt_app_output_clock_reset(&out_clock, sample_rate, ch_count, dma_frames);
+}
+
+static size_t write_data(const uint8_t *data, size_t size, TickType_t wait)
+{
+    const size_t taken = bt_app_output_clock_wait(&out_clock, size, wait);
+
+    bt_app_output_clock_advance(&out_clock, taken);
+    total_bytes += taken;
+    return taken;
+}
+
+static size_t preload(const uint8_t *data, size_t size)
+{
+    const size_t loaded = bt_app_output_clock_preload(&out_clock, size);
+
+    bt_app_output_clock_advance(&out_clock, loaded);
+    total_bytes += loaded;
+    return loaded;
+}
+
+static uint32_t latency(void)
+{
+    return bt_app_output_clock_latency(&out_clock);
+}
+
+static uint32_t queued(void)
+{
+    return bt_app_output_clock_queued(&out_clock);
+}
+
+const bt_app_output_t bt_app_output_null = {
+    .name = "null",
+    .install = install,
+    .uninstall = uninstall,
+    .set_format = set_format,
+    .write = write_data,
+    .preload = preload,
+    .latency = latency,
+    .queued = queued,
+};
+
+#endif /* CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_NULL */
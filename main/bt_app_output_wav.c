@@ -0,0 +1,163 @@
+/*
+ * Output backend writing a WAV file, for checking the processing chain
+ * without an audio output. The file goes through the VFS, so a filesystem
+ * must be mounted at the configured path, e.g. with semihosting over JTAG
+ * at /host, which writes to the host running the debugger.
+ *
+ * The audio is paced by an emulated DMA clock, so that the buffering works
+ * as with a hardware output; the silence a DMA plays on underruns is not
+ * written to the file, the time is reported along with the throughput
+ * instead. A WAV file holds a single format, it is started anew when the
+ * format changes. The sizes in the header are filled in when the output
+ * is uninstalled.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include "sdkconfig.h"
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_WAV_FILE
+
+#include "bt_app_output.h"
+#include "esp_log.h"
+
+#define HEADER_SIZE 44
+
+static const char TAG[] = "OUTPUT_WAV";
+
+static FILE *file = NULL;
+static uint32_t sample_rate = 44100;
+static uint8_t channels = 2;
+static uint32_t data_size = 0;              /* bytes of audio in the file */
+static uint32_t dma_frames = 0;             /* frames the emulated DMA holds */
+static bt_app_output_clock_t out_clock;
+
+
+static void put_le(uint8_t *p, uint32_t value, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        p[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static void write_header(void)
+{
+    const uint32_t frame_size = channels * sizeof(int16_t);
+    uint8_t header[HEADER_SIZE] = {
+        'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V', 'E',
+        'f', 'm', 't', ' ', 16, 0, 0, 0,
+    };
+
+    put_le(header + 4, HEADER_SIZE - 8 + data_size, 4);
+    put_le(header + 20, 1, 2);                          /* PCM */
+    put_le(header + 22, channels, 2);
+    put_le(header + 24, sample_rate, 4);
+    put_le(header + 28, sample_rate * frame_size, 4);   /* byte rate */
+    put_le(header + 32, frame_size, 2);                 /* block align */
+    put_le(header + 34, 16, 2);                         /* bits per sample */
+    header[36] = 'd';
+    header[37] = 'a';
+    header[38] = 't';
+    header[39] = 'a';
+    put_le(header + 40, data_size, 4);
+
+    fseek(file, 0, SEEK_SET);
+    fwrite(header, 1, sizeof(header), file);
+    fseek(file, 0, SEEK_END);
+}
+
+static esp_err_t start_file(void)
+{
+    if ((file = fopen(CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_WAV_PATH, "wb")) == NULL)
+    {
+        ESP_LOGE(TAG, "cannot create %s", CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_WAV_PATH);
+        return ESP_FAIL;
+    }
+    data_size = 0;
+    write_header();
+    bt_app_output_clock_reset(&out_clock, sample_rate, channels, dma_frames);
+    return ESP_OK;
+}
+
+static void finish_file(void)
+{
+    write_header();
+    fclose(file);
+    file = NULL;
+    ESP_LOGI(TAG, "%u bytes written to %s", data_size, CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_WAV_PATH);
+    bt_app_output_clock_report(TAG, &out_clock);
+}
+
+static esp_err_t install(const bt_app_latency_params_t *latency)
+{
+    sample_rate = 44100;
+    channels = 2;
+    dma_frames = latency->dma_desc_num * latency->dma_frame_num;
+    return start_file();
+}
+
+static void uninstall(void)
+{
+    if (file)
+    {
+        finish_file();
+    }
+}
+
+static void set_format(uint32_t rate, uint8_t ch_count)
+{
+    sample_rate = rate;
+    channels = ch_count;
+    if (file)
+    {
+        finish_file();
+    }
+    start_file();
+}
+
+static size_t write_data(const uint8_t *data, size_t size, TickType_t wait)
+{
+    const size_t taken = bt_app_output_clock_wait(&out_clock, size, wait);
+
+    if (file && taken > 0)
+    {
+        data_size += fwrite(data, 1, taken, file);
+    }
+    bt_app_output_clock_advance(&out_clock, taken);
+    return taken;
+}
+
+static size_t preload(const uint8_t *data, size_t size)
+{
+    const size_t loaded = bt_app_output_clock_preload(&out_clock, size);
+
+    if (file && loaded > 0)
+    {
+        data_size += fwrite(data, 1, loaded, file);
+    }
+    bt_app_output_clock_advance(&out_clock, loaded);
+    return loaded;
+}
+
+static uint32_t latency(void)
+{
+    return bt_app_output_clock_latency(&out_clock);
+}
+
+static uint32_t queued(void)
+{
+    return bt_app_output_clock_queued(&out_clock);
+}
+
+const bt_app_output_t bt_app_output_wav = {
+    .name = "WAV file",
+    .install = install,
+    .uninstall = uninstall,
+    .set_format = set_format,
+    .write = write_data,
+    .preload = preload,
+    .latency = latency,
+    .queued = queued,
+};
+
+#endif /* CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_WAV_FILE */
@@ -0,0 +1,261 @@
+/*
+ * Single producer, single consumer block ring.
+ *
+ * head counts the blocks written and is only stored by the producer, tail
+ * counts the blocks read and is only stored by the consumer. Both wrap at
+ * twice the block count, so that a full ring can be told from an empty
+ * one for any block count, and their difference modulo that is the
+ * number of filled blocks.
+ * The producer publishes a block with a release store of head after
+ * writing it, the consumer picks up head with an acquire load before
+ * reading the block, and likewise for tail in the other direction. No
+ * locks are taken and no critical sections are entered.
+ *
+ * A staged ring has a third position between the two, mid, counting the
+ * blocks processed and only stored by the processing stage. It takes the
+ * place of head for the consumer and of tail for the processing stage, so
+ * that each of the three sides still stores a single position.
+ *
+ * A side that has to wait publishes its task handle, checks the ring once
+ * more (the other side may have moved in between) and then blocks on its
+ * task notification. The side it waits on swaps the handle out after each
+ * commit or release and only notifies if it found one.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include "sdkconfig.h"
+#ifndef CONFIG_EXAMPLE_BUILD_FACTORY_IMAGE
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "bt_app_ringbuf.h"
+
+struct bt_app_ringbuf {
+    uint8_t *buf;
+    size_t block_size;
+    uint32_t block_cnt;
+    atomic_uint head;                   /* blocks written, modulo 2 * block_cnt */
+    atomic_uint mid;                    /* blocks processed, modulo 2 * block_cnt */
+    atomic_uint tail;                   /* blocks read, modulo 2 * block_cnt */
+    bool staged;
+    _Atomic(TaskHandle_t) producer_waiter;
+    _Atomic(TaskHandle_t) stage_waiter;
+    _Atomic(TaskHandle_t) consumer_waiter;
+};
+
+
+static bt_app_ringbuf_handle_t create(size_t block_size, uint32_t block_cnt, bool staged)
+{
+    bt_app_ringbuf_handle_t rb = calloc(1, sizeof(struct bt_app_ringbuf));
+    if (rb == NULL)
+    {
+        return NULL;
+    }
+    /* word aligned blocks for the 16 bit sample kernels and DMA copies */
+    block_size = (block_size + 3) & ~(size_t)3;
+    if ((rb->buf = malloc(block_size * block_cnt)) == NULL)
+    {
+        free(rb);
+        return NULL;
+    }
+    rb->block_size = block_size;
+    rb->block_cnt = block_cnt;
+    rb->staged = staged;
+    atomic_init(&rb->head, 0);
+    atomic_init(&rb->mid, 0);
+    atomic_init(&rb->tail, 0);
+    atomic_init(&rb->producer_waiter, NULL);
+    atomic_init(&rb->stage_waiter, NULL);
+    atomic_init(&rb->consumer_waiter, NULL);
+    return rb;
+}
+
+bt_app_ringbuf_handle_t bt_app_ringbuf_create(size_t block_size, uint32_t block_cnt)
+{
+    return create(block_size, block_cnt, false);
+}
+
+bt_app_ringbuf_handle_t bt_app_ringbuf_create_staged(size_t block_size, uint32_t block_cnt)
+{
+    return create(block_size, block_cnt, true);
+}
+
+void bt_app_ringbuf_delete(bt_app_ringbuf_handle_t rb)
+{
+    if (rb)
+    {
+        free(rb->buf);
+        free(rb);
+    }
+}
+
+void bt_app_ringbuf_reset(bt_app_ringbuf_handle_t rb)
+{
+    const uint32_t head = atomic_load(&rb->head);
+    atomic_store(&rb->mid, head);
+    atomic_store(&rb->tail, head);
+}
+
+/* block until avail() is non-zero or wait ticks passed, see the file header */
+static uint32_t wait_for(bt_app_ringbuf_handle_t rb, _Atomic(TaskHandle_t) *waiter,
+                         uint32_t (*avail)(bt_app_ringbuf_handle_t), TickType_t wait)
+{
+    uint32_t n = avail(rb);
+    if (n > 0 || wait == 0)
+    {
+        return n;
+    }
+
+    const TickType_t start = xTaskGetTickCount();
+    for (;;)
+    {
+        atomic_store(waiter, xTaskGetCurrentTaskHandle());
+        /* pairs with the fence in wake(), either this sees the other side's
+           update or the other side sees the waiter */
+        atomic_thread_fence(memory_order_seq_cst);
+        if ((n = avail(rb)) > 0)
+        {
+            break;
+        }
+        const TickType_t elapsed = xTaskGetTickCount() - start;
+        if (wait != portMAX_DELAY && elapsed >= wait)
+        {
+            break;
+        }
+        /* other notifications to this task end the wait early, the loop
+           then keeps waiting for the remaining time */
+        ulTaskNotifyTake(pdTRUE, (wait == portMAX_DELAY) ? portMAX_DELAY : (wait - elapsed));
+    }
+    atomic_store(waiter, NULL);
+    return n;
+}
+
+static inline void wake(_Atomic(TaskHandle_t) *waiter)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(waiter, memory_order_relaxed) != NULL)
+    {
+        TaskHandle_t task = atomic_exchange(waiter, NULL);
+        if (task != NULL)
+        {
+            xTaskNotifyGive(task);
+        }
+    }
+}
+
+/* blocks from tail to head, both below 2 * block_cnt */
+static inline uint32_t distance(bt_app_ringbuf_handle_t rb, uint32_t head, uint32_t tail)
+{
+    const uint32_t d = head + 2 * rb->block_cnt - tail;
+    return (d >= 2 * rb->block_cnt) ? (d - 2 * rb->block_cnt) : d;
+}
+
+/* storage index of a head or tail position */
+static inline uint32_t index_of(bt_app_ringbuf_handle_t rb, uint32_t pos)
+{
+    return (pos >= rb->block_cnt) ? (pos - rb->block_cnt) : pos;
+}
+
+/* advance a head or tail position, only called by the side owning it */
+static inline void advance(bt_app_ringbuf_handle_t rb, atomic_uint *pos, uint32_t count)
+{
+    uint32_t next = atomic_load_explicit(pos, memory_order_relaxed) + count;
+    next = (next >= 2 * rb->block_cnt) ? (next - 2 * rb->block_cnt) : next;
+    atomic_store_explicit(pos, next, memory_order_release);
+}
+
+static uint32_t free_blocks(bt_app_ringbuf_handle_t rb)
+{
+    const uint32_t tail = atomic_load_explicit(&rb->tail, memory_order_acquire);
+    return rb->block_cnt - distance(rb, atomic_load_explicit(&rb->head, memory_order_relaxed), tail);
+}
+
+static uint32_t unprocessed_blocks(bt_app_ringbuf_handle_t rb)
+{
+    const uint32_t head = atomic_load_explicit(&rb->head, memory_order_acquire);
+    return distance(rb, head, atomic_load_explicit(&rb->mid, memory_order_relaxed));
+}
+
+/* blocks the consumer may read, the processed ones in a staged ring */
+static uint32_t filled_blocks(bt_app_ringbuf_handle_t rb)
+{
+    const uint32_t ready = atomic_load_explicit(rb->staged ? &rb->mid : &rb->head, memory_order_acquire);
+    return distance(rb, ready, atomic_load_explicit(&rb->tail, memory_order_relaxed));
+}
+
+uint8_t *bt_app_ringbuf_write_acquire(bt_app_ringbuf_handle_t rb, uint32_t *count, TickType_t wait)
+{
+    const uint32_t n = wait_for(rb, &rb->producer_waiter, free_blocks, wait);
+    if (n == 0)
+    {
+        return NULL;
+    }
+    const uint32_t idx = index_of(rb, atomic_load_explicit(&rb->head, memory_order_relaxed));
+    /* the span ends at the end of the storage */
+    *count = (n < rb->block_cnt - idx) ? n : (rb->block_cnt - idx);
+    return rb->buf + idx * rb->block_size;
+}
+
+void bt_app_ringbuf_write_commit(bt_app_ringbuf_handle_t rb, uint32_t count)
+{
+    advance(rb, &rb->head, count);
+    wake(rb->staged ? &rb->stage_waiter : &rb->consumer_waiter);
+}
+
+uint8_t *bt_app_ringbuf_process_acquire(bt_app_ringbuf_handle_t rb, uint32_t *count, TickType_t wait)
+{
+    const uint32_t n = wait_for(rb, &rb->stage_waiter, unprocessed_blocks, wait);
+    if (n == 0)
+    {
+        return NULL;
+    }
+    const uint32_t idx = index_of(rb, atomic_load_explicit(&rb->mid, memory_order_relaxed));
+    *count = (n < rb->block_cnt - idx) ? n : (rb->block_cnt - idx);
+    return rb->buf + idx * rb->block_size;
+}
+
+void bt_app_ringbuf_process_commit(bt_app_ringbuf_handle_t rb, uint32_t count)
+{
+    advance(rb, &rb->mid, count);
+    wake(&rb->consumer_waiter);
+}
+
+uint8_t *bt_app_ringbuf_read_acquire(bt_app_ringbuf_handle_t rb, uint32_t *count, TickType_t wait)
+{
+    const uint32_t n = wait_for(rb, &rb->consumer_waiter, filled_blocks, wait);
+    if (n == 0)
+    {
+        return NULL;
+    }
+    const uint32_t idx = index_of(rb, atomic_load_explicit(&rb->tail, memory_order_relaxed));
+    *count = (n < rb->block_cnt - idx) ? n : (rb->block_cnt - idx);
+    return rb->buf + idx * rb->block_size;
+}
+
+void bt_app_ringbuf_read_release(bt_app_ringbuf_handle_t rb, uint32_t count)
+{
+    advance(rb, &rb->tail, count);
+    wake(&rb->producer_waiter);
+}
+
+uint32_t bt_app_ringbuf_level(bt_app_ringbuf_handle_t rb)
+{
+    /* tail first, head can only have moved further since */
+    const uint32_t tail = atomic_load(&rb->tail);
+    return distance(rb, atomic_load(&rb->head), tail);
+}
+
+uint32_t bt_app_ringbuf_block_cnt(bt_app_ringbuf_handle_t rb)
+{
+    return rb->block_cnt;
+}
+
+size_t bt_app_ringbuf_block_size(bt_app_ringbuf_handle_t rb)
+{
+    return rb->block_size;
+}
+
+#endif /* CONFIG_EXAMPLE_BUILD_FACTORY_IMAGE */
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+
+/*
+* Single producer, single consumer ring of fixed-size blocks. Both sides
+* access the blocks in place through contiguous spans, and only block
+* when the ring is full or empty. A blocked side is woken up by a task
+* notification from the other side, which is only sent when it is actually
+* waiting.
+*
+* A staged ring has a processing stage between the two sides: written
+* blocks are first handed to the stage, which works on them in place, and
+* only reach the consumer once the stage committed them.
+*/
+
+typedef struct bt_app_ringbuf *bt_app_ringbuf_handle_t;
+
+/*
+* Allocates a ring of block_cnt blocks of block_size bytes each.
+* Returns NULL if out of memory.
+*/
+bt_app_ringbuf_handle_t bt_app_ringbuf_create(size_t block_size, uint32_t block_cnt);
+
+/*
+* As bt_app_ringbuf_create(), with a processing stage.
+*/
+bt_app_ringbuf_handle_t bt_app_ringbuf_create_staged(size_t block_size, uint32_t block_cnt);
+
+/*
+* Frees the ring, neither side may be using it.
+*/
+void bt_app_ringbuf_delete(bt_app_ringbuf_handle_t rb);
+
+/*
+* Discards all blocks, neither side may be using the ring.
+*/
+void bt_app_ringbuf_reset(bt_app_ringbuf_handle_t rb);
+
+/*
+* Producer: waits up to wait ticks for free blocks. Returns the first free
+* block and stores the number of contiguous free blocks in count, or
+* returns NULL on timeout.
+*/
+uint8_t *bt_app_ringbuf_write_acquire(bt_app_ringbuf_handle_t rb, uint32_t *count, TickType_t wait);
+
+/*
+* Producer: hands count blocks from the last acquired span to the consumer.
+*/
+void bt_app_ringbuf_write_commit(bt_app_ringbuf_handle_t rb, uint32_t count);
+
+/*
+* Processing stage of a staged ring: waits up to wait ticks for written
+* blocks. Returns the oldest block not processed yet and stores the number
+* of contiguous ones in count, or returns NULL on timeout.
+*/
+uint8_t *bt_app_ringbuf_process_acquire(bt_app_ringbuf_handle_t rb, uint32_t *count, TickType_t wait);
+
+/*
+* Processing stage: hands count blocks from the last acquired span to the
+* consumer.
+*/
+void bt_app_ringbuf_process_commit(bt_app_ringbuf_handle_t rb, uint32_t count);
+
+/*
+* Consumer: waits up to wait ticks for filled blocks, processed ones in a
+* staged ring. Returns the oldest
+* block and stores the number of contiguous filled blocks in count, or
+* returns NULL on timeout.
+*/
+uint8_t *bt_app_ringbuf_read_acquire(bt_app_ringbuf_handle_t rb, uint32_t *count, TickType_t wait);
+
+/*
+* Consumer: returns count blocks from the last acquired span to the producer.
+*/
+void bt_app_ringbuf_read_release(bt_app_ringbuf_handle_t rb, uint32_t count);
+
+/*
+* Returns the number of filled blocks, processed or not, and the number of
+* blocks of the ring.
+*/
+uint32_t bt_app_ringbuf_level(bt_app_ringbuf_handle_t rb);
+uint32_t bt_app_ringbuf_block_cnt(bt_app_ringbuf_handle_t rb);
+
+/*
+* Returns the block size in bytes.
+*/
+size_t bt_app_ringbuf_block_size(bt_app_ringbuf_handle_t rb);
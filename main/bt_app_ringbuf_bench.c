@@ -0,0 +1,153 @@
+/*
+ * Throughput of the block ring against the FreeRTOS ringbuffer on the
+ * target.
+ *
+ * A producer with the core and priority of the DSP task and a consumer with
+ * those of the I2S task move BENCH_BYTES of audio in blocks of the pipeline.
+ * The producer copies each block in like the data callback, the consumer
+ * copies it out like the output write, one block at a time on both rings.
+ * The FreeRTOS byte buffer copies on send, its consumer receives up to a
+ * block and copies it out of the item before returning it.
+ *
+ * Reported is the time per block from the start of the tasks to the last
+ * block received. With both tasks on one core, the default, that is the CPU
+ * time of both sides including the context switches between them.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "sdkconfig.h"
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_BENCH_RINGBUF
+
+#include "bt_app_ringbuf_bench.h"
+#include "bt_app_core.h"
+#include "bt_app_ringbuf.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/ringbuf.h"
+#include "freertos/task.h"
+
+#define BENCH_BLOCK_BYTES (BT_I2S_BLOCK_FRAMES * 2 * sizeof(int16_t))
+#define BENCH_BLOCKS 20                     /* about 60 ms at 44.1 kHz stereo */
+#define BENCH_BYTES (2 * 1024 * 1024)
+#define BENCH_STACK 2048
+
+#if defined(CONFIG_FREERTOS_UNICORE)
+#define BENCH_CORE(core) (0)
+#else
+#define BENCH_CORE(core) (((core) < 0) ? tskNO_AFFINITY : (core))
+#endif
+
+typedef struct {
+    bool freertos;                          /* FreeRTOS ringbuffer, else the block ring */
+    bt_app_ringbuf_handle_t ring;
+    RingbufHandle_t freertos_ring;
+    TaskHandle_t waiter;                    /* notified by each side when done */
+    int64_t end_us;                         /* the consumer received the last block */
+} bench_t;
+
+static const char TAG[] = "RINGBUF_BENCH";
+
+static uint8_t src_block[BENCH_BLOCK_BYTES];
+static uint8_t dst_block[BENCH_BLOCK_BYTES];
+
+
+static void producer_task(void *arg)
+{
+    bench_t *bench = arg;
+
+    for (size_t sent = 0; sent < BENCH_BYTES; sent += BENCH_BLOCK_BYTES)
+    {
+        if (bench->freertos)
+        {
+            xRingbufferSend(bench->freertos_ring, src_block, BENCH_BLOCK_BYTES, portMAX_DELAY);
+        }
+        else
+        {
+            uint32_t count = 0;
+            uint8_t *block = bt_app_ringbuf_write_acquire(bench->ring, &count, portMAX_DELAY);
+            memcpy(block, src_block, BENCH_BLOCK_BYTES);
+            bt_app_ringbuf_write_commit(bench->ring, 1);
+        }
+    }
+    xTaskNotifyGive(bench->waiter);
+    vTaskDelete(NULL);
+}
+
+static void consumer_task(void *arg)
+{
+    bench_t *bench = arg;
+
+    for (size_t received = 0; received < BENCH_BYTES;)
+    {
+        if (bench->freertos)
+        {
+            size_t size = 0;
+            uint8_t *item = xRingbufferReceiveUpTo(bench->freertos_ring, &size, portMAX_DELAY,
+                                                   BENCH_BLOCK_BYTES);
+            memcpy(dst_block, item, size);
+            vRingbufferReturnItem(bench->freertos_ring, item);
+            received += size;
+        }
+        else
+        {
+            uint32_t count = 0;
+            const uint8_t *block = bt_app_ringbuf_read_acquire(bench->ring, &count, portMAX_DELAY);
+            memcpy(dst_block, block, BENCH_BLOCK_BYTES);
+            bt_app_ringbuf_read_release(bench->ring, 1);
+            received += BENCH_BLOCK_BYTES;
+        }
+    }
+    bench->end_us = esp_timer_get_time();
+    xTaskNotifyGive(bench->waiter);
+    vTaskDelete(NULL);
+}
+
+static void bench_ring(bench_t *bench, const char *name)
+{
+    bench->waiter = xTaskGetCurrentTaskHandle();
+    const int64_t start_us = esp_timer_get_time();
+
+    xTaskCreatePinnedToCore(consumer_task, "BenchRead", BENCH_STACK, bench,
+                            CONFIG_EXAMPLE_A2DP_SINK_I2S_TASK_PRIORITY, NULL,
+                            BENCH_CORE(CONFIG_EXAMPLE_A2DP_SINK_I2S_TASK_CORE));
+    xTaskCreatePinnedToCore(producer_task, "BenchWrite", BENCH_STACK, bench,
+                            CONFIG_EXAMPLE_A2DP_SINK_DSP_TASK_PRIORITY, NULL,
+                            BENCH_CORE(CONFIG_EXAMPLE_A2DP_SINK_DSP_TASK_CORE));
+    ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
+    ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
+
+    const uint32_t blocks = BENCH_BYTES / BENCH_BLOCK_BYTES;
+    const int64_t elapsed_us = bench->end_us - start_us;
+    ESP_LOGI(TAG, "%s: %u blocks of %u bytes, %u.%02u us per block, %u kB/s",
+             name, blocks, (uint32_t)BENCH_BLOCK_BYTES,
+             (uint32_t)(elapsed_us / blocks), (uint32_t)(elapsed_us % blocks * 100 / blocks),
+             (uint32_t)((uint64_t)BENCH_BYTES * 1000000 / 1024 / elapsed_us));
+}
+
+void bt_app_ringbuf_bench_run(void)
+{
+    bench_t bench = {0};
+
+    memset(src_block, 0x5a, sizeof(src_block));
+    ESP_LOGI(TAG, "producer on core %d, consumer on core %d", CONFIG_EXAMPLE_A2DP_SINK_DSP_TASK_CORE,
+             CONFIG_EXAMPLE_A2DP_SINK_I2S_TASK_CORE);
+
+    bench.ring = bt_app_ringbuf_create(BENCH_BLOCK_BYTES, BENCH_BLOCKS);
+    if (bench.ring != NULL)
+    {
+        bench_ring(&bench, "block ring");
+        bt_app_ringbuf_delete(bench.ring);
+    }
+
+    bench = (bench_t){.freertos = true};
+    bench.freertos_ring = xRingbufferCreate(BENCH_BLOCK_BYTES * BENCH_BLOCKS, RINGBUF_TYPE_BYTEBUF);
+    if (bench.freertos_ring != NULL)
+    {
+        bench_ring(&bench, "FreeRTOS ringbuffer");
+        vRingbufferDelete(bench.freertos_ring);
+    }
+}
+
+#endif /* CONFIG_EXAMPLE_A2DP_SINK_BENCH_RINGBUF */
@@ -0,0 +1,10 @@
+#pragma once
+
+/*
+* Moves audio blocks between two tasks, pinned like the DSP and I2S tasks,
+* through the block ring of the pipeline and through a FreeRTOS byte
+* ringbuffer, and logs the time per block of each. Blocks the caller for
+* the duration, well below a second; with
+* CONFIG_EXAMPLE_A2DP_SINK_BENCH_RINGBUF.
+*/
+void bt_app_ringbuf_bench_run(void);
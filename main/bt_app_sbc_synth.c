@@ -0,0 +1,187 @@
+/*
+ * SBC synthesis filterbank in fixed point.
+ *
+ * Per block of M subband samples the specification matrixes them into 2M
+ * values V[k] = sum(N[k][i] * sb[i]), N[k][i] = cos((i + 0.5) * (k + M/2) *
+ * pi / M), shifts those into a history of 10 blocks and sums 10 windowed
+ * history values per output sample.
+ *
+ * The matrix is symmetric enough that M - 1 dot products of M terms replace
+ * the 2M of the specification: V[M/2] is 0, V[M - k] = -V[k],
+ * V[3M - k] = V[k], and V[3M/2] is minus the sum of the subband samples.
+ * The history is a ring kept twice in a row, the most recent block first,
+ * so that the window reads it without wrapping.
+ *
+ * The matrix and the window coefficients, -M * C[i] of the prototype
+ * filter, are Q30 and products are summed in 64 bits. The matrixed values
+ * are rounded half away from zero, which keeps the symmetries exact, so the
+ * result is bit-exact with the matrixing of the specification.
+ *
+ * The MAC16 option of the ESP32 is not used. It multiplies 16 by 16 bits,
+ * but the subband samples of a frame at full scale need 18, and with Q14
+ * window coefficients the output was up to 17 steps off the exact
+ * filterbank, against less than one now (test/host/test_sbc_synth.c). The
+ * products are 32 by 32 bits, which GCC builds from MULL and MULSH as it
+ * would for 32 by 16.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "bt_app_sbc_synth.h"
+
+#define HISTORY 10                      /* blocks in the window */
+#define MAT_BITS 30
+#define WIN_BITS 30
+
+#define MAT(x) ((int32_t)((x) * (1 << MAT_BITS) + ((x) < 0 ? -0.5 : 0.5)))
+#define WIN(m, x) ((int32_t)(-(m) * (x) * (1 << WIN_BITS) + ((x) > 0 ? -0.5 : 0.5)))
+
+/* the prototype filters of the specification */
+static const int32_t window4[HISTORY * 4] = {
+    WIN(4, 0.00000000E+00), WIN(4, 5.36548976E-04), WIN(4, 1.49188357E-03), WIN(4, 2.73370904E-03),
+    WIN(4, 3.83720193E-03), WIN(4, 3.89205149E-03), WIN(4, 1.86581691E-03), WIN(4, -3.06012286E-03),
+    WIN(4, 1.09137620E-02), WIN(4, 2.04385087E-02), WIN(4, 2.88757392E-02), WIN(4, 3.21939290E-02),
+    WIN(4, 2.58767811E-02), WIN(4, 6.13245186E-03), WIN(4, -2.88217274E-02), WIN(4, -7.76463494E-02),
+    WIN(4, 1.35593274E-01), WIN(4, 1.94987841E-01), WIN(4, 2.46636662E-01), WIN(4, 2.81828203E-01),
+    WIN(4, 2.94315332E-01), WIN(4, 2.81828203E-01), WIN(4, 2.46636662E-01), WIN(4, 1.94987841E-01),
+    WIN(4, -1.35593274E-01), WIN(4, -7.76463494E-02), WIN(4, -2.88217274E-02), WIN(4, 6.13245186E-03),
+    WIN(4, 2.58767811E-02), WIN(4, 3.21939290E-02), WIN(4, 2.88757392E-02), WIN(4, 2.04385087E-02),
+    WIN(4, -1.09137620E-02), WIN(4, -3.06012286E-03), WIN(4, 1.86581691E-03), WIN(4, 3.89205149E-03),
+    WIN(4, 3.83720193E-03), WIN(4, 2.73370904E-03), WIN(4, 1.49188357E-03), WIN(4, 5.36548976E-04)
+};
+
+static const int32_t window8[HISTORY * 8] = {
+    WIN(8, 0.00000000E+00), WIN(8, 1.56575398E-04), WIN(8, 3.43256425E-04), WIN(8, 5.54620202E-04),
+    WIN(8, 8.23919506E-04), WIN(8, 1.13992507E-03), WIN(8, 1.47640169E-03), WIN(8, 1.78371725E-03),
+    WIN(8, 2.01182542E-03), WIN(8, 2.10371989E-03), WIN(8, 1.99454554E-03), WIN(8, 1.61656283E-03),
+    WIN(8, 9.02154502E-04), WIN(8, -1.78805361E-04), WIN(8, -1.64973098E-03), WIN(8, -3.49717454E-03),
+    WIN(8, 5.65949473E-03), WIN(8, 8.02941163E-03), WIN(8, 1.04584443E-02), WIN(8, 1.27472335E-02),
+    WIN(8, 1.46525263E-02), WIN(8, 1.59045603E-02), WIN(8, 1.62208471E-02), WIN(8, 1.53184106E-02),
+    WIN(8, 1.29371806E-02), WIN(8, 8.85757540E-03), WIN(8, 2.92408442E-03), WIN(8, -4.91578024E-03),
+    WIN(8, -1.46404076E-02), WIN(8, -2.61098752E-02), WIN(8, -3.90751381E-02), WIN(8, -5.31873032E-02),
+    WIN(8, 6.79989431E-02), WIN(8, 8.29847578E-02), WIN(8, 9.75753918E-02), WIN(8, 1.11196689E-01),
+    WIN(8, 1.23264548E-01), WIN(8, 1.33264415E-01), WIN(8, 1.40753505E-01), WIN(8, 1.45389847E-01),
+    WIN(8, 1.46955068E-01), WIN(8, 1.45389847E-01), WIN(8, 1.40753505E-01), WIN(8, 1.33264415E-01),
+    WIN(8, 1.23264548E-01), WIN(8, 1.11196689E-01), WIN(8, 9.75753918E-02), WIN(8, 8.29847578E-02),
+    WIN(8, -6.79989431E-02), WIN(8, -5.31873032E-02), WIN(8, -3.90751381E-02), WIN(8, -2.61098752E-02),
+    WIN(8, -1.46404076E-02), WIN(8, -4.91578024E-03), WIN(8, 2.92408442E-03), WIN(8, 8.85757540E-03),
+    WIN(8, 1.29371806E-02), WIN(8, 1.53184106E-02), WIN(8, 1.62208471E-02), WIN(8, 1.59045603E-02),
+    WIN(8, 1.46525263E-02), WIN(8, 1.27472335E-02), WIN(8, 1.04584443E-02), WIN(8, 8.02941163E-03),
+    WIN(8, -5.65949473E-03), WIN(8, -3.49717454E-03), WIN(8, -1.64973098E-03), WIN(8, -1.78805361E-04),
+    WIN(8, 9.02154502E-04), WIN(8, 1.61656283E-03), WIN(8, 1.99454554E-03), WIN(8, 2.10371989E-03),
+    WIN(8, 2.01182542E-03), WIN(8, 1.78371725E-03), WIN(8, 1.47640169E-03), WIN(8, 1.13992507E-03),
+    WIN(8, 8.23919506E-04), WIN(8, 5.54620202E-04), WIN(8, 3.43256425E-04), WIN(8, 1.56575398E-04)
+};
+
+/* the rows k = 0 .. M/2 - 1, then k = M + 1 .. 3M/2 - 1 of the matrix */
+static const int32_t matrix4[4 - 1][4] = {
+    {MAT(0.7071067811865476), MAT(-0.7071067811865475),
+     MAT(-0.7071067811865477), MAT(0.7071067811865474)},
+    {MAT(0.38268343236508984), MAT(-0.9238795325112868),
+     MAT(0.9238795325112865), MAT(-0.3826834323650899)},
+    {MAT(-0.9238795325112867), MAT(-0.3826834323650899),
+     MAT(0.38268343236509067), MAT(0.9238795325112875)}
+};
+
+static const int32_t matrix8[8 - 1][8] = {
+    {MAT(0.7071067811865476), MAT(-0.7071067811865475), MAT(-0.7071067811865477), MAT(0.7071067811865474),
+     MAT(0.7071067811865477), MAT(-0.7071067811865467), MAT(-0.7071067811865471), MAT(0.7071067811865466)},
+    {MAT(0.5555702330196023), MAT(-0.9807852804032304), MAT(0.1950903220161283), MAT(0.8314696123025455),
+     MAT(-0.8314696123025451), MAT(-0.19509032201612803), MAT(0.9807852804032307), MAT(-0.5555702330196015)},
+    {MAT(0.38268343236508984), MAT(-0.9238795325112868), MAT(0.9238795325112865), MAT(-0.3826834323650899),
+     MAT(-0.38268343236509056), MAT(0.9238795325112867), MAT(-0.9238795325112864), MAT(0.38268343236508956)},
+    {MAT(0.19509032201612833), MAT(-0.5555702330196022), MAT(0.8314696123025455), MAT(-0.9807852804032307),
+     MAT(0.9807852804032304), MAT(-0.831469612302545), MAT(0.5555702330196015), MAT(-0.19509032201612858)},
+    {MAT(-0.8314696123025453), MAT(0.19509032201612878), MAT(0.9807852804032307), MAT(0.5555702330196015),
+     MAT(-0.5555702330196027), MAT(-0.9807852804032303), MAT(-0.19509032201612808), MAT(0.8314696123025471)},
+    {MAT(-0.9238795325112867), MAT(-0.3826834323650899), MAT(0.38268343236509067), MAT(0.9238795325112875),
+     MAT(0.9238795325112868), MAT(0.3826834323650891), MAT(-0.38268343236509145), MAT(-0.9238795325112865)},
+    {MAT(-0.9807852804032304), MAT(-0.8314696123025451), MAT(-0.5555702330196015), MAT(-0.19509032201612858),
+     MAT(0.19509032201613036), MAT(0.5555702330196061), MAT(0.8314696123025471), MAT(0.9807852804032309)}
+};
+
+/* half away from zero, so that V[M - k] = -V[k] holds after rounding */
+static inline int32_t dot(const int32_t *row, const int32_t *sb, unsigned int m)
+{
+    int64_t acc = 0;
+    for (unsigned int i = 0; i < m; i++)
+    {
+        acc += (int64_t)row[i] * sb[i];
+    }
+    return (int32_t)((acc + (INT64_C(1) << (MAT_BITS - 1)) - (acc < 0)) >> MAT_BITS);
+}
+
+static inline void synthesize(bt_app_sbc_synth_t *synth, const int32_t *sb, int16_t *pcm, unsigned int stride,
+                              unsigned int m, const int32_t *rows, const int32_t *window)
+{
+    const unsigned int len = HISTORY * 2 * m;
+    synth->pos = (synth->pos >= 2 * m) ? synth->pos - 2 * m : len - 2 * m;
+    int32_t *v = synth->v + synth->pos;
+
+    int32_t sum = 0;
+    for (unsigned int i = 0; i < m; i++)
+    {
+        sum += sb[i];
+    }
+    for (unsigned int k = 0; k < m / 2; k++)
+    {
+        v[k] = dot(rows + k * m, sb, m);
+        v[m - k] = -v[k];
+    }
+    v[m / 2] = 0;
+    for (unsigned int k = m + 1; k < 3 * m / 2; k++)
+    {
+        v[k] = dot(rows + (k - m / 2 - 1) * m, sb, m);
+        v[3 * m - k] = v[k];
+    }
+    v[3 * m / 2] = -sum;
+    memcpy(v + len, v, 2 * m * sizeof(int32_t));
+
+    /* the even blocks of the history contribute their first half, the odd
+       ones their second */
+    for (unsigned int j = 0; j < m; j++)
+    {
+        int64_t acc = 0;
+        for (unsigned int i = 0; i < HISTORY / 2; i++)
+        {
+            acc += (int64_t)v[4 * m * i + j] * window[2 * m * i + j];
+            acc += (int64_t)v[4 * m * i + 3 * m + j] * window[2 * m * i + m + j];
+        }
+        const unsigned int shift = WIN_BITS + BT_APP_SBC_SB_FRAC_BITS;
+        int32_t sample = (int32_t)((acc + (INT64_C(1) << (shift - 1))) >> shift);
+        if (sample > INT16_MAX)
+        {
+            sample = INT16_MAX;
+        }
+        else if (sample < INT16_MIN)
+        {
+            sample = INT16_MIN;
+        }
+        pcm[j * stride] = (int16_t)sample;
+    }
+}
+
+bool bt_app_sbc_synth_init(bt_app_sbc_synth_t *synth, uint8_t subbands)
+{
+    if (subbands != 4 && subbands != 8)
+    {
+        return false;
+    }
+    memset(synth, 0, sizeof(*synth));
+    synth->subbands = subbands;
+    return true;
+}
+
+void bt_app_sbc_synth_block(bt_app_sbc_synth_t *synth, const int32_t *sb, int16_t *pcm, unsigned int stride)
+{
+    /* separate instances so that the loops are unrolled for each */
+    if (synth->subbands == 8)
+    {
+        synthesize(synth, sb, pcm, stride, 8, &matrix8[0][0], window8);
+    }
+    else
+    {
+        synthesize(synth, sb, pcm, stride, 4, &matrix4[0][0], window4);
+    }
+}
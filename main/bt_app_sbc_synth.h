@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+* Fixed-point synthesis filterbank of the SBC decoder (A2DP specification,
+* section 12.6.4) for 4 and 8 subbands, one instance per channel.
+*
+* Nothing calls this on the target yet: the Bluedroid of ESP-IDF 5.0 decodes
+* SBC in the BTC task and only hands decoded PCM to the application. It is
+* checked and benchmarked on the host by test/host/test_sbc_synth.c.
+*/
+
+#define BT_APP_SBC_MAX_SUBBANDS 8
+/* fraction bits of the subband samples, which are in PCM sample units */
+#define BT_APP_SBC_SB_FRAC_BITS 2
+
+typedef struct {
+    /* the last 10 matrixed blocks of 2 * subbands values, most recent first,
+       stored twice so that the window never wraps */
+    int32_t v[2 * 10 * 2 * BT_APP_SBC_MAX_SUBBANDS];
+    uint16_t pos;                   /* start of the most recent block */
+    uint8_t subbands;
+} bt_app_sbc_synth_t;
+
+/*
+* Clears the filter state for the given number of subbands. Returns false if
+* it is neither 4 nor 8.
+*/
+bool bt_app_sbc_synth_init(bt_app_sbc_synth_t *synth, uint8_t subbands);
+
+/*
+* Synthesizes one block: reads a subband sample per subband, with
+* BT_APP_SBC_SB_FRAC_BITS fraction bits and below 2^18 in magnitude as
+* dequantized from a valid frame, and writes as many PCM samples, rounded
+* and saturated, to pcm[0], pcm[stride], ... so that the channels of a frame
+* can be interleaved.
+*/
+void bt_app_sbc_synth_block(bt_app_sbc_synth_t *synth, const int32_t *sb, int16_t *pcm, unsigned int stride);
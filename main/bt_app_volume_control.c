@@ -13,9 +13,13 @@
  */
 
 #include <stdint.h>
+#include <string.h>
 #include <limits.h>
 #include <math.h>
+#include "sdkconfig.h"
 #include "bt_app_volume_control.h"
+#include "bt_app_dac_output.h"
+#include "bt_app_bass_protect.h"
 #include "esp_log.h"
 #include "esp_system.h"
 #include "esp_random.h"
@@ -36,15 +40,189 @@
 
 #define NOISE_SAMPLE_COUNT 2000
 
+/* the fade level is kept with extra fractional bits so that even long
+   ramps advance by a non-zero step on every frame */
+#define FADE_FRAC_BITS 15
+#define FADE_LEVEL_FULL (VOLUME_SCALE_VAL << FADE_FRAC_BITS)
+
+#define MAX_CHANNELS 2
+
+/* conversion to the output sample format, done as the final step of the
+   volume adjustment so the buffer is only walked once */
+#if defined(BT_APP_DAC_RESAMPLE)
+/* requantized after resampling, see bt_app_dac_resample() */
+#define OUTPUT_SAMPLE(s, ch) (s)
+#elif defined(CONFIG_EXAMPLE_A2DP_SINK_DAC_NOISE_SHAPING)
+#define OUTPUT_SAMPLE(s, ch) bt_app_dac_requantize((s), (ch))
+#elif defined(CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_INTERNAL_DAC)
+/* the internal DAC expects offset binary samples */
+#define OUTPUT_SAMPLE(s, ch) ((int16_t)((uint16_t)(s) + 0x8000U))
+#else
+#define OUTPUT_SAMPLE(s, ch) (s)
+#define OUTPUT_SAMPLE_IDENTITY
+#endif
+
+/* zero level of the samples handed to the output, around which the output
+   fade scales them */
+#if defined(CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_INTERNAL_DAC) && !defined(BT_APP_DAC_RESAMPLE)
+#define OUTPUT_OFFSET 0x8000U
+#else
+#define OUTPUT_OFFSET 0U
+#endif
+
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_DITHER
+#define DITHER_ENABLED 1
+#else
+#define DITHER_ENABLED 0
+#endif
+
+/* kernel processing whole frames at a constant gain, in place or out of place */
+typedef void (* volume_kernel_t) (const int16_t *in_ptr, int16_t *out_ptr, size_t frame_cnt, int32_t gain);
+
 static const char TAG[] = "VOLCTL";
 
 static uint16_t gain_presets[VOLUME_LEVELS];
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_DITHER
 static int16_t noise[NOISE_SAMPLE_COUNT];
+static unsigned int noise_idx = NOISE_SAMPLE_COUNT - 1;
+#endif
 
 /* if the volume is not set by host, use this volume. */
 static int32_t volume = 0;
 
+static uint32_t sample_rate = 44100;
+static uint8_t channels = 2;
+
+/* fade request, written by the controlling task and picked up by the
+   audio task at the start of the next block */
+static volatile uint32_t fade_req_seq = 0;
+static volatile int32_t fade_req_target = 0;
+static volatile uint32_t fade_req_frames = 0;
+
+/* fade state, only touched by the audio task; output starts muted so that
+   the first stream fades in */
+static uint32_t fade_seq = 0;
+static int32_t fade_level = 0;
+static int32_t fade_step = 0;
+static int32_t fade_target = 0;
+static uint32_t fade_frames_left = 0;
+
+/* output fade state, only touched by the output writer; the stream plays at
+   full level unless the output ran dry */
+static int32_t out_fade_level = FADE_LEVEL_FULL;
+static int32_t out_fade_step = 0;
+static int32_t out_fade_target = FADE_LEVEL_FULL;
+static uint32_t out_fade_frames_left = 0;
+
+/* last input frame seen, used to continue a fade after the stream ended */
+static int16_t hold_frame[MAX_CHANNELS];
+
+/* kernel for the current volume and stream format, see select_kernel() */
+static volatile volume_kernel_t kernel = NULL;
+
+static void adjust_volume_ramp(const int16_t *in_ptr, int16_t *out_ptr, size_t frame_cnt, int32_t gain);
+
+/* kernels specialized at build time */
+#define KERNEL_NAME adjust_volume_stereo
+#define KERNEL_CHANNELS 2
+#define KERNEL_SCALE 1
+#define KERNEL_DITHER 0
+#include "bt_app_volume_kernel.h"
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_DITHER
+#define KERNEL_NAME adjust_volume_stereo_dither
+#define KERNEL_CHANNELS 2
+#define KERNEL_SCALE 1
+#define KERNEL_DITHER 1
+#include "bt_app_volume_kernel.h"
+#endif
+#ifndef OUTPUT_SAMPLE_IDENTITY
+#define KERNEL_NAME convert_stereo
+#define KERNEL_CHANNELS 2
+#define KERNEL_SCALE 0
+#define KERNEL_DITHER 0
+#include "bt_app_volume_kernel.h"
+#endif
+
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_MONO_KERNELS
+#define KERNEL_NAME adjust_volume_mono
+#define KERNEL_CHANNELS 1
+#define KERNEL_SCALE 1
+#define KERNEL_DITHER 0
+#include "bt_app_volume_kernel.h"
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_DITHER
+#define KERNEL_NAME adjust_volume_mono_dither
+#define KERNEL_CHANNELS 1
+#define KERNEL_SCALE 1
+#define KERNEL_DITHER 1
+#include "bt_app_volume_kernel.h"
+#endif
+#ifndef OUTPUT_SAMPLE_IDENTITY
+#define KERNEL_NAME convert_mono
+#define KERNEL_CHANNELS 1
+#define KERNEL_SCALE 0
+#define KERNEL_DITHER 0
+#include "bt_app_volume_kernel.h"
+#endif
+#endif /* CONFIG_EXAMPLE_A2DP_SINK_MONO_KERNELS */
+
+/* select the kernel matching the current volume and stream format */
+static void select_kernel(void)
+{
+    const uint16_t gain = gain_presets[volume];
+    const bool scale = (gain < VOLUME_SCALE_VAL);
+    const bool dither = DITHER_ENABLED && (gain <= (VOLUME_SCALE_VAL / 2));
+    volume_kernel_t selected = adjust_volume_ramp;
+
+    if (channels == 2)
+    {
+        if (!scale)
+        {
+#ifdef OUTPUT_SAMPLE_IDENTITY
+            selected = NULL;
+#else
+            selected = convert_stereo;
+#endif
+        }
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_DITHER
+        else if (dither)
+        {
+            selected = adjust_volume_stereo_dither;
+        }
+#endif
+        else
+        {
+            selected = adjust_volume_stereo;
+        }
+    }
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_MONO_KERNELS
+    else
+    {
+        if (!scale)
+        {
+#ifdef OUTPUT_SAMPLE_IDENTITY
+            selected = NULL;
+#else
+            selected = convert_mono;
+#endif
+        }
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_DITHER
+        else if (dither)
+        {
+            selected = adjust_volume_mono_dither;
+        }
+#endif
+        else
+        {
+            selected = adjust_volume_mono;
+        }
+    }
+#endif
+    (void) dither;
+    kernel = selected;
+}
+
 
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_DITHER
 void generate_triangular_pdf_noise()
 {
     ESP_LOGD(TAG, "Generating %d samples of triangular PDF noise", NOISE_SAMPLE_COUNT);
@@ -91,6 +269,7 @@ void generate_triangular_pdf_noise()
     }
     */
 }
+#endif /* CONFIG_EXAMPLE_A2DP_SINK_DITHER */
 
 void bt_app_vc_initialize(double min_db, double max_db, bool level0_mute)
 {
@@ -108,8 +287,14 @@ void bt_app_vc_initialize(double min_db, double max_db, bool level0_mute)
         ESP_LOGD(TAG, "gain[%d] = %x\n", 0, gain_presets[0]);
     }
 
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_DITHER
     /* create Triangular PDF noise for dither */
     generate_triangular_pdf_noise();
+#endif
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_BASS_PROTECT
+    bt_app_bass_protect_init(gain_presets, VOLUME_LEVELS, VOLUME_SCALE_BITS);
+#endif
+    select_kernel();
 }
 
 void bt_app_set_initial_volume()
@@ -120,6 +305,10 @@ void bt_app_set_initial_volume()
 void bt_app_set_volume(uint32_t level)
 {
     volume = MIN(level, VOLUME_LEVEL_MAX);
+    select_kernel();
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_BASS_PROTECT
+    bt_app_bass_protect_set_level(volume);
+#endif
     ESP_LOGD(TAG, "volume: level=%d/127, mult=%d/%d",
              level, gain_presets[volume], VOLUME_SCALE_VAL);
 }
@@ -129,32 +318,221 @@ uint32_t bt_app_get_volume(void)
     return volume;
 }
 
-void bt_app_adjust_volume(uint8_t *data, size_t size)
+void bt_app_vc_set_format(uint32_t rate, uint8_t ch_count)
+{
+    sample_rate = rate;
+    channels = (ch_count > 0 && ch_count <= MAX_CHANNELS) ? ch_count : MAX_CHANNELS;
+    select_kernel();
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_BASS_PROTECT
+    bt_app_bass_protect_set_format(sample_rate, channels);
+#endif
+    ESP_LOGD(TAG, "format: %d Hz, %d channel(s)", sample_rate, channels);
+}
+
+void bt_app_vc_start_fade(bool fade_in, uint32_t duration_ms)
+{
+    fade_req_target = fade_in ? FADE_LEVEL_FULL : 0;
+    fade_req_frames = (uint32_t)(((uint64_t)sample_rate * duration_ms) / 1000);
+    fade_req_seq++;
+    ESP_LOGD(TAG, "fade %s over %d ms", fade_in ? "in" : "out", duration_ms);
+}
+
+bool bt_app_vc_fade_active(void)
+{
+    return (fade_req_seq != fade_seq) || (fade_frames_left > 0);
+}
+
+bool bt_app_vc_fading_out(void)
+{
+    if (fade_req_seq != fade_seq)
+    {
+        return fade_req_target == 0;
+    }
+    return (fade_frames_left > 0) && (fade_target == 0);
+}
+
+bool bt_app_vc_muted(void)
+{
+    return (fade_req_seq == fade_seq) && (fade_frames_left == 0) && (fade_level == 0);
+}
+
+void bt_app_vc_start_output_fade(bool fade_in, uint32_t duration_ms)
+{
+    out_fade_target = fade_in ? FADE_LEVEL_FULL : 0;
+    out_fade_frames_left = (uint32_t)(((uint64_t)sample_rate * duration_ms) / 1000);
+    if (out_fade_frames_left == 0)
+    {
+        out_fade_level = out_fade_target;
+    }
+    else
+    {
+        out_fade_step = (out_fade_target - out_fade_level) / (int32_t)out_fade_frames_left;
+    }
+}
+
+bool bt_app_vc_output_fading_out(void)
+{
+    return (out_fade_frames_left > 0) && (out_fade_target == 0);
+}
+
+bool bt_app_vc_output_muted(void)
+{
+    return (out_fade_frames_left == 0) && (out_fade_level == 0);
+}
+
+void bt_app_vc_apply_output_fade(uint8_t *data, size_t size)
+{
+    size_t frame_cnt = size / (channels * sizeof(int16_t));
+    uint16_t *sample_ptr = (uint16_t *)data;
+
+    if (out_fade_frames_left == 0 && out_fade_level == FADE_LEVEL_FULL)
+    {
+        return;
+    }
+    while (frame_cnt)
+    {
+        if (out_fade_frames_left > 0)
+        {
+            out_fade_frames_left -= 1;
+            out_fade_level = (out_fade_frames_left > 0) ? (out_fade_level + out_fade_step) : out_fade_target;
+        }
+        const int32_t gain = out_fade_level >> FADE_FRAC_BITS;
+        for (unsigned int ch = 0; ch < channels; ch++)
+        {
+            const int32_t sample = (int16_t)(uint16_t)(*sample_ptr - OUTPUT_OFFSET);
+            *sample_ptr++ = (uint16_t)((sample * gain) / VOLUME_SCALE_VAL) + OUTPUT_OFFSET;
+        }
+        frame_cnt -= 1;
+    }
+}
+
+void bt_app_vc_fill_hold(uint8_t *data, size_t size)
+{
+    size_t frame_cnt = size / (channels * sizeof(int16_t));
+    int16_t* sample_ptr = (int16_t *)data;
+    while (frame_cnt)
+    {
+        for (unsigned int ch = 0; ch < channels; ch++)
+        {
+            *sample_ptr++ = hold_frame[ch];
+        }
+        frame_cnt -= 1;
+    }
+}
+
+/* pick up a pending fade request */
+static void update_fade(void)
+{
+    const uint32_t seq = fade_req_seq;
+    if (seq != fade_seq)
+    {
+        fade_seq = seq;
+        fade_target = fade_req_target;
+        fade_frames_left = fade_req_frames;
+        if (fade_frames_left == 0)
+        {
+            fade_level = fade_target;
+        }
+        else
+        {
+            fade_step = (fade_target - fade_level) / (int32_t)fade_frames_left;
+        }
+    }
+}
+
+static inline int16_t scale_sample(int16_t sample, int32_t gain, bool apply_dither)
+{
+    /* perform volume adjustment in 32 bit */
+    int32_t fraction = (int32_t)sample;
+    fraction *= gain;
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_DITHER
+    if (apply_dither)
+    {
+        fraction += noise[noise_idx];
+        noise_idx = (noise_idx > 0) ? (noise_idx - 1) : (NOISE_SAMPLE_COUNT - 1);
+    }
+#endif
+    /* use division instead of bit shifting for symmetric rounding of
+       positive and negative values (on which dithering relies, too) */
+    fraction /= VOLUME_SCALE_VAL;
+    return (int16_t)fraction;
+}
+
+/* volume adjustment with a gain ramp, advancing the fade level per frame;
+   also serves as generic kernel for formats without a specialized one */
+static void adjust_volume_ramp(const int16_t *in_ptr, int16_t *out_ptr, size_t frame_cnt, int32_t gain)
+{
+    while (frame_cnt)
+    {
+        if (fade_frames_left > 0)
+        {
+            fade_frames_left -= 1;
+            fade_level = (fade_frames_left > 0) ? (fade_level + fade_step) : fade_target;
+        }
+        const int32_t frame_gain =
+            (gain * (fade_level >> FADE_FRAC_BITS)) / VOLUME_SCALE_VAL;
+        const bool apply_dither = DITHER_ENABLED && (frame_gain <= (VOLUME_SCALE_VAL / 2));
+        for (unsigned int ch = 0; ch < channels; ch++)
+        {
+            *out_ptr = OUTPUT_SAMPLE(scale_sample(*in_ptr, frame_gain, apply_dither), ch);
+            in_ptr += 1;
+            out_ptr += 1;
+        }
+        frame_cnt -= 1;
+    }
+}
+
+void bt_app_adjust_volume(const uint8_t *in, uint8_t *out, size_t size)
 {
     const uint16_t gain = gain_presets[volume];
+    const size_t frame_size = channels * sizeof(int16_t);
+    const size_t frame_cnt = size / frame_size;
+    const int16_t *src = (const int16_t *)in;
 
-    if (gain < VOLUME_SCALE_VAL)
+    if (frame_cnt == 0)
     {
-        const bool apply_dither = (gain <= (VOLUME_SCALE_VAL / 2));
-        size_t sample_cnt = size / sizeof(int16_t);
-        int16_t* sample_ptr = (int16_t *)data;
+        return;
+    }
+    memcpy(hold_frame, in + (frame_cnt - 1) * frame_size, frame_size);
+
+    update_fade();
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_BASS_PROTECT
+    if (fade_frames_left > 0 || fade_level > 0)
+    {
+        if (bt_app_bass_protect_process(src, (int16_t *)out, frame_cnt))
+        {
+            /* continue on the bass protected samples */
+            src = (const int16_t *)out;
+        }
+    }
+#endif
+    if (fade_frames_left == 0 && fade_level == 0)
+    {
+        size_t sample_cnt = frame_cnt * channels;
+        int16_t* sample_ptr = (int16_t *)out;
+        unsigned int ch = 0;
         while (sample_cnt)
         {
-            /* perform volume adjustment in 32 bit */
-            int32_t fraction = (int32_t)*sample_ptr;
-            fraction *= gain;
-            if (apply_dither)
-            {
-                static unsigned int noise_idx = NOISE_SAMPLE_COUNT - 1;
-                fraction += noise[noise_idx];
-                noise_idx = (noise_idx > 0) ? (noise_idx - 1) : (NOISE_SAMPLE_COUNT - 1);
-            }
-            /* use division instead of bit shifting for symmetric rounding of
-               positive and negative values (on which dithering relies, too) */
-            fraction /= VOLUME_SCALE_VAL;
-            *sample_ptr = (int16_t)fraction;
+            *sample_ptr = OUTPUT_SAMPLE(0, ch);
+            ch = (ch + 1) & (channels - 1);
             sample_ptr += 1;
             sample_cnt -= 1;
         }
     }
-}
\ No newline at end of file
+    else if (fade_frames_left > 0 || fade_level < FADE_LEVEL_FULL)
+    {
+        adjust_volume_ramp(src, (int16_t *)out, frame_cnt, gain);
+    }
+    else
+    {
+        const volume_kernel_t selected = kernel;
+        if (selected)
+        {
+            selected(src, (int16_t *)out, frame_cnt, gain);
+        }
+        else if ((const uint8_t *)src != out)
+        {
+            memcpy(out, src, frame_cnt * frame_size);
+        }
+    }
+}
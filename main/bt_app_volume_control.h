@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /*
@@ -25,6 +26,68 @@ uint32_t bt_app_get_volume(void);
 void bt_app_set_initial_volume();
 
 /*
-* Changes an input data according to volume level.
+* Sets the format of the stream passed to bt_app_adjust_volume().
+* Required for timing fades and keeping track of whole frames.
 */
-void bt_app_adjust_volume(uint8_t *data, size_t size);
\ No newline at end of file
+void bt_app_vc_set_format(uint32_t sample_rate, uint8_t channels);
+
+/*
+* Starts a linear gain ramp from the current fade level towards full level
+* (fade_in == true) or silence, lasting duration_ms. A duration of 0 applies
+* the target level immediately.
+*/
+void bt_app_vc_start_fade(bool fade_in, uint32_t duration_ms);
+
+/*
+* Returns true while a fade is pending or in progress.
+*/
+bool bt_app_vc_fade_active(void);
+
+/*
+* Returns true while a fade towards silence is pending or in progress.
+*/
+bool bt_app_vc_fading_out(void);
+
+/*
+* Returns true if the output is silent and no fade is pending.
+*/
+bool bt_app_vc_muted(void);
+
+/*
+* Starts a linear gain ramp of the output fade, which is applied by the output
+* writer to processed audio right before it is handed to the output, on top of
+* the stream fade. Used to fade out on the last frame when the stream ran dry
+* and to fade in the audio buffered up meanwhile, without touching the gain of
+* the audio already processed. Writer task only.
+*/
+void bt_app_vc_start_output_fade(bool fade_in, uint32_t duration_ms);
+
+/*
+* Returns true while the output fade is in progress towards silence.
+*/
+bool bt_app_vc_output_fading_out(void);
+
+/*
+* Returns true if the output fade has muted the output.
+*/
+bool bt_app_vc_output_muted(void);
+
+/*
+* Applies the output fade in place to processed audio, which is in the sample
+* format expected by the output. Returns at once at full level.
+*/
+void bt_app_vc_apply_output_fade(uint8_t *data, size_t size);
+
+/*
+* Fills a buffer with repetitions of the most recent input frame. Passing the
+* result through bt_app_adjust_volume() continues a running fade seamlessly
+* when the stream has run dry.
+*/
+void bt_app_vc_fill_hold(uint8_t *data, size_t size);
+
+/*
+* Changes an input data according to volume level and fade state, and
+* converts it to the sample format expected by the output in the same pass.
+* Input and output may be the same buffer.
+*/
+void bt_app_adjust_volume(const uint8_t *in, uint8_t *out, size_t size);
\ No newline at end of file
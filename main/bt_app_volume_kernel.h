@@ -0,0 +1,52 @@
+/*
+ * Template for the volume kernels, included by bt_app_volume_control.c once
+ * per variant (no include guard on purpose). Before including, define
+ *   KERNEL_NAME      name of the generated function
+ *   KERNEL_CHANNELS  number of interleaved channels (1 or 2)
+ *   KERNEL_SCALE     1 to apply the gain, 0 for output conversion only
+ *   KERNEL_DITHER    1 to add dither noise before requantization
+ *
+ * Input and output may be the same buffer. All decisions are resolved at
+ * build time, so apart from the wrap-around of the noise index the inner
+ * loop has no branches. Samples are 16 bit, the only width delivered by
+ * the SBC decoder.
+ */
+
+static void KERNEL_NAME(const int16_t *in_ptr, int16_t *out_ptr, size_t frame_cnt, int32_t gain)
+{
+#if KERNEL_DITHER
+    unsigned int idx = noise_idx;
+#endif
+#if !KERNEL_SCALE
+    (void) gain;
+#endif
+    while (frame_cnt)
+    {
+        for (unsigned int ch = 0; ch < KERNEL_CHANNELS; ch++)
+        {
+            int32_t fraction = (int32_t)in_ptr[ch];
+#if KERNEL_SCALE
+            fraction *= gain;
+#if KERNEL_DITHER
+            fraction += noise[idx];
+            idx = (idx > 0) ? (idx - 1) : (NOISE_SAMPLE_COUNT - 1);
+#endif
+            /* use division instead of bit shifting for symmetric rounding of
+               positive and negative values (on which dithering relies, too) */
+            fraction /= VOLUME_SCALE_VAL;
+#endif
+            out_ptr[ch] = OUTPUT_SAMPLE(fraction, ch);
+        }
+        in_ptr += KERNEL_CHANNELS;
+        out_ptr += KERNEL_CHANNELS;
+        frame_cnt -= 1;
+    }
+#if KERNEL_DITHER
+    noise_idx = idx;
+#endif
+}
+
+#undef KERNEL_NAME
+#undef KERNEL_CHANNELS
+#undef KERNEL_SCALE
+#undef KERNEL_DITHER
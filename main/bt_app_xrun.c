@@ -0,0 +1,180 @@
+/*
+ * Overrun and underrun counters.
+ *
+ * Counts and timestamps are independent atomic words, so a reader may see
+ * a count together with the timestamp of the event before. The timestamp
+ * is taken from esp_timer, which can be read from ISR context.
+ *
+ * The event log is a ring written by the data callback, the I2S task and
+ * the I2S ISR, and read by the publishing task. A writer reserves an entry
+ * by advancing the head with compare-and-swap, or drops the event if the
+ * reader is a full ring behind, and marks the entry with its index + 1
+ * once written. The reader stops at the first entry not marked with the
+ * index it expects, which another writer may still be filling in, and
+ * advances the tail behind what it read. Nobody waits, so an ISR that
+ * interrupts a writer on the same core does not block.
+ */
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include "sdkconfig.h"
+#ifndef CONFIG_EXAMPLE_BUILD_FACTORY_IMAGE
+
+#include "bt_app_xrun.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char TAG[] = "XRUN";
+
+_Static_assert((BT_APP_XRUN_LOG_LEN & (BT_APP_XRUN_LOG_LEN - 1)) == 0, "indexes wrap at 2^32");
+
+typedef struct {
+    atomic_uint seq;                /* index + 1 once written */
+    uint32_t ms;
+    bt_app_xrun_event_t event;
+} log_slot_t;
+
+static atomic_uint counts[BT_APP_XRUN_NUM];
+static atomic_uint last_ms[BT_APP_XRUN_NUM];
+static volatile bool active = false;
+
+static log_slot_t log_slots[BT_APP_XRUN_LOG_LEN];
+static atomic_uint log_head = 0;    /* next index to reserve */
+static atomic_uint log_tail = 0;    /* next index to read */
+static atomic_uint log_lost = 0;
+
+/* state of the last publication, only touched by the publishing task */
+static uint32_t published[BT_APP_XRUN_NUM];
+static uint32_t last_publish_ms = 0;
+
+
+static inline uint32_t IRAM_ATTR now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static void IRAM_ATTR log_event(bt_app_xrun_event_t event, uint32_t ms)
+{
+    unsigned int head = atomic_load_explicit(&log_head, memory_order_relaxed);
+    do
+    {
+        if (head - atomic_load_explicit(&log_tail, memory_order_acquire) >= BT_APP_XRUN_LOG_LEN)
+        {
+            atomic_fetch_add_explicit(&log_lost, 1, memory_order_relaxed);
+            return;
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&log_head, &head, head + 1, memory_order_relaxed,
+                                                    memory_order_relaxed));
+
+    log_slot_t *slot = &log_slots[head % BT_APP_XRUN_LOG_LEN];
+    slot->ms = ms;
+    slot->event = event;
+    atomic_store_explicit(&slot->seq, head + 1, memory_order_release);
+}
+
+void IRAM_ATTR bt_app_xrun_record(bt_app_xrun_event_t event)
+{
+    if (event == BT_APP_XRUN_DMA_UNDERRUN && !active)
+    {
+        return;
+    }
+    const uint32_t ms = now_ms();
+    atomic_store_explicit(&last_ms[event], ms, memory_order_relaxed);
+    atomic_fetch_add_explicit(&counts[event], 1, memory_order_relaxed);
+    if (event != BT_APP_XRUN_DMA_SENT)
+    {
+        log_event(event, ms);
+    }
+}
+
+void bt_app_xrun_set_active(bool value)
+{
+    active = value;
+}
+
+void bt_app_xrun_get(bt_app_xrun_counter_t counters[BT_APP_XRUN_NUM])
+{
+    for (unsigned int i = 0; i < BT_APP_XRUN_NUM; i++)
+    {
+        counters[i].count = atomic_load_explicit(&counts[i], memory_order_relaxed);
+        counters[i].last_ms = atomic_load_explicit(&last_ms[i], memory_order_relaxed);
+    }
+}
+
+size_t bt_app_xrun_drain(bt_app_xrun_entry_t *entries, size_t max_count, uint32_t *lost)
+{
+    unsigned int tail = atomic_load_explicit(&log_tail, memory_order_relaxed);
+    size_t count = 0;
+
+    for (; count < max_count; count++, tail++)
+    {
+        const log_slot_t *slot = &log_slots[tail % BT_APP_XRUN_LOG_LEN];
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) != tail + 1)
+        {
+            break;
+        }
+        entries[count].ms = slot->ms;
+        entries[count].event = slot->event;
+    }
+    atomic_store_explicit(&log_tail, tail, memory_order_release);
+    *lost = atomic_exchange_explicit(&log_lost, 0, memory_order_relaxed);
+    return count;
+}
+
+/* the logged events in one line, static as the I2S task publishes */
+static void publish_log(void)
+{
+    static const char *const names[BT_APP_XRUN_NUM] = {"ring full", "ring empty", "DMA underrun", "DMA sent"};
+    static bt_app_xrun_entry_t entries[BT_APP_XRUN_LOG_LEN];
+    static char line[BT_APP_XRUN_LOG_LEN * 24];
+    uint32_t lost = 0;
+
+    const size_t count = bt_app_xrun_drain(entries, BT_APP_XRUN_LOG_LEN, &lost);
+    size_t len = 0;
+    for (size_t i = 0; i < count && len < sizeof(line); i++)
+    {
+        len += snprintf(line + len, sizeof(line) - len, "%s%s %u", (i > 0) ? ", " : "", names[entries[i].event],
+                        entries[i].ms);
+    }
+    if (count > 0 || lost > 0)
+    {
+        ESP_LOGW(TAG, "events (ms): %s%s%u lost", (count > 0) ? line : "", (count > 0) ? ", " : "", lost);
+    }
+}
+
+void bt_app_xrun_publish(void)
+{
+    const uint32_t now = now_ms();
+    if (now - last_publish_ms < CONFIG_EXAMPLE_A2DP_SINK_XRUN_LOG_INTERVAL_MS)
+    {
+        return;
+    }
+    last_publish_ms = now;
+
+    bt_app_xrun_counter_t c[BT_APP_XRUN_NUM];
+    bt_app_xrun_get(c);
+    bool changed = false;
+    /* buffers are sent all the time, only report them along with the others */
+    for (unsigned int i = 0; i < BT_APP_XRUN_DMA_SENT; i++)
+    {
+        changed |= (c[i].count != published[i]);
+    }
+    if (!changed)
+    {
+        return;
+    }
+    for (unsigned int i = 0; i < BT_APP_XRUN_NUM; i++)
+    {
+        published[i] = c[i].count;
+    }
+    ESP_LOGW(TAG, "ring full %u (last %u), ring empty %u (last %u), DMA underrun %u (last %u), DMA sent %u",
+             c[BT_APP_XRUN_RING_FULL].count, c[BT_APP_XRUN_RING_FULL].last_ms,
+             c[BT_APP_XRUN_RING_EMPTY].count, c[BT_APP_XRUN_RING_EMPTY].last_ms,
+             c[BT_APP_XRUN_DMA_UNDERRUN].count, c[BT_APP_XRUN_DMA_UNDERRUN].last_ms,
+             c[BT_APP_XRUN_DMA_SENT].count);
+    publish_log();
+}
+
+#endif /* CONFIG_EXAMPLE_BUILD_FACTORY_IMAGE */
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+* Counters for buffer overruns and underruns along the audio path, telling
+* apart glitches caused by the Bluetooth link from glitches caused by the
+* I2S task falling behind. Counters are updated without locks and may be
+* recorded from ISR context. Each event keeps the time it last occurred,
+* in ms since boot like the log timestamps, and all but DMA buffers sent
+* are also kept with their time in a log of BT_APP_XRUN_LOG_LEN entries,
+* so that a burst between two publications can still be matched with
+* connection events.
+*/
+
+#define BT_APP_XRUN_LOG_LEN 32      /* power of two */
+
+typedef enum {
+    BT_APP_XRUN_RING_FULL = 0,      /* data callback found the ringbuffer full */
+    BT_APP_XRUN_RING_EMPTY,         /* I2S task found the ringbuffer empty while playing */
+    BT_APP_XRUN_DMA_UNDERRUN,       /* DMA ran out of data written by the I2S task */
+    BT_APP_XRUN_DMA_SENT,           /* DMA buffer sent */
+    BT_APP_XRUN_NUM,
+} bt_app_xrun_event_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t last_ms;               /* time of the most recent event */
+} bt_app_xrun_counter_t;
+
+typedef struct {
+    uint32_t ms;
+    bt_app_xrun_event_t event;
+} bt_app_xrun_entry_t;
+
+/*
+* Records an event, safe to call from ISR context.
+*/
+void bt_app_xrun_record(bt_app_xrun_event_t event);
+
+/*
+* Enables counting DMA underruns. The DMA runs dry on purpose while no audio
+* is played, so they are only counted while the output is active.
+*/
+void bt_app_xrun_set_active(bool active);
+
+/*
+* Copies the current counters.
+*/
+void bt_app_xrun_get(bt_app_xrun_counter_t counters[BT_APP_XRUN_NUM]);
+
+/*
+* Moves up to max_count logged events into entries, oldest first, and
+* returns their number. Events that found the log full were dropped, their
+* number since the last call is stored in lost. One reader at a time.
+*/
+size_t bt_app_xrun_drain(bt_app_xrun_entry_t *entries, size_t max_count, uint32_t *lost);
+
+/*
+* Logs the counters and the logged events if any counter changed, at most
+* once per CONFIG_EXAMPLE_A2DP_SINK_XRUN_LOG_INTERVAL_MS. Called
+* periodically.
+*/
+void bt_app_xrun_publish(void);
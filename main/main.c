@@ -28,6 +28,9 @@
 #include "bt_app_core.h"
 #include "bt_app_av.h"
 #include "bt_app_volume_control.h"
+#include "bt_app_event_stats.h"
+#include "bt_app_latency.h"
+#include "bt_app_ringbuf_bench.h"
 #include "esp_bt_main.h"
 #include "esp_bt_device.h"
 #include "esp_gap_bt_api.h"
@@ -110,6 +113,8 @@ static void bt_av_hdl_stack_evt(uint16_t event, void *p_param)
     switch (event) {
     /* when do the stack up, this event comes */
     case BT_APP_EVT_STACK_UP: {
+        bt_app_event_stats_set_name(bt_av_hdl_stack_evt, "stack");
+        bt_app_av_name_handlers();
         esp_bt_dev_set_device_name(LOCAL_DEVICE_NAME);
         esp_bt_gap_register_callback(bt_app_gap_cb);
 
@@ -182,6 +187,11 @@ void app_main(void)
     try_ota_update(LOCAL_DEVICE_NAME, "BT-A2DP-Sink", CONFIG_EXAMPLE_OTA_URL);
 #endif
 
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_BENCH_RINGBUF
+    /* before the Bluetooth stack takes CPU time */
+    bt_app_ringbuf_bench_run();
+#endif
+
     /*
      * This example only uses the functions of Classical Bluetooth.
      * So release the controller memory for Bluetooth Low Energy.
@@ -229,6 +239,11 @@ void app_main(void)
 
     bt_app_task_start_up();
 
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_LATENCY_CONSOLE
+    /* select the latency profile on the serial console between connections */
+    bt_app_latency_console_start();
+#endif
+
     /* bluetooth device name, connection mode and profile set up */
 
     ota_mark_application_ok();
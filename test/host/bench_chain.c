@@ -0,0 +1,95 @@
+/*
+ * Cycles per frame of the processing chain as built for a configuration:
+ * the volume adjustment with its output conversion, and for the internal
+ * DAC with resampling the resampler and requantization as well. Measured
+ * for stereo and mono streams at 0 dB, an attenuated level and a dithered
+ * level, each with the kernel specialized for it, and with the generic
+ * ramp kernel used during fades for reference.
+ *
+ * Usage: bench_chain <configuration name>
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include "sdkconfig.h"
+#include "bt_app_dac_output.h"
+#include "bt_app_volume_control.h"
+#include "esp_cpu.h"
+#include "esp_log.h"
+
+#define BLOCK_FRAMES 480
+#define BLOCKS 50
+#define RUNS 50
+
+static int16_t input[BLOCKS * BLOCK_FRAMES * 2];
+static int16_t output[BLOCKS * BLOCK_FRAMES * 2];
+#ifdef BT_APP_DAC_RESAMPLE
+static int16_t resampled[BLOCK_FRAMES * 2 * BT_APP_DAC_RATE_FACTOR + 4];
+#endif
+
+static double cycles_per_frame(uint8_t channels)
+{
+    const size_t size = BLOCK_FRAMES * channels * sizeof(int16_t);
+    uint32_t best = UINT32_MAX;
+
+    for (int run = 0; run < RUNS; run++)
+    {
+        const uint32_t start = esp_cpu_get_cycle_count();
+        for (unsigned int b = 0; b < BLOCKS; b++)
+        {
+            const size_t offset = b * BLOCK_FRAMES * channels;
+            bt_app_adjust_volume((const uint8_t *)(input + offset), (uint8_t *)(output + offset), size);
+#ifdef BT_APP_DAC_RESAMPLE
+            bt_app_dac_resample((const uint8_t *)(output + offset), size, (uint8_t *)resampled);
+#endif
+        }
+        const uint32_t cycles = esp_cpu_get_cycle_count() - start;
+        best = (cycles < best) ? cycles : best;
+    }
+    return (double)best / (BLOCKS * BLOCK_FRAMES);
+}
+
+static void bench(const char *config, uint8_t channels)
+{
+    static const struct {
+        uint32_t level;
+        const char *name;
+    } levels[] = {{127, "0 dB"}, {120, "scaled"}, {64, "dithered"}};
+
+    bt_app_vc_set_format(48000, channels);
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_INTERNAL_DAC
+    bt_app_dac_output_set_format(channels);
+#endif
+    printf("%-13s %-6s", config, (channels == 2) ? "stereo" : "mono");
+    for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); i++)
+    {
+        bt_app_set_volume(levels[i].level);
+        bt_app_vc_start_fade(true, 0);
+        printf("  %s %5.2f", levels[i].name, cycles_per_frame(channels));
+    }
+
+    /* a fade long enough to cover the measurement keeps the ramp kernel */
+    bt_app_set_volume(120);
+    bt_app_vc_start_fade(false, 0);
+    bt_app_adjust_volume((const uint8_t *)input, (uint8_t *)output, BLOCK_FRAMES * channels * sizeof(int16_t));
+    bt_app_vc_start_fade(true, 3600 * 1000);
+    printf("  ramp %5.2f cycles/frame\n", cycles_per_frame(channels));
+}
+
+int main(int argc, char **argv)
+{
+    const char *config = (argc > 1) ? argv[1] : "?";
+    uint32_t seed = 1;
+
+    esp_log_level_set("*", ESP_LOG_WARN);
+    for (size_t i = 0; i < sizeof(input) / sizeof(input[0]); i++)
+    {
+        seed = seed * 1664525 + 1013904223;
+        input[i] = (int16_t)(seed >> 16);
+    }
+    /* 0 dB at the top level, so that it needs the conversion only */
+    bt_app_vc_initialize(-57.0, 0.0, false);
+    bench(config, 2);
+    bench(config, 1);
+    return 0;
+}
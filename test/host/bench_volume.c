@@ -0,0 +1,105 @@
+/*
+ * Cost of the volume adjustment for the internal DAC, with the offset
+ * binary conversion fused into the volume kernels (config/dac_plain) and,
+ * for comparison, in a second pass over the buffer as before
+ * (config/pipeline, which has no output conversion of its own).
+ *
+ * Both builds print the cycles and nanoseconds per sample for a few
+ * volume levels and a checksum of the output, which must be the same.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include "sdkconfig.h"
+#include "bt_app_volume_control.h"
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "freertos_host.h"
+
+#define BLOCK_FRAMES 480            /* 10 ms at 48 kHz */
+#define BLOCKS 100
+#define RUNS 50
+
+static int16_t input[BLOCKS * BLOCK_FRAMES * 2];
+static int16_t output[BLOCKS * BLOCK_FRAMES * 2];
+
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_INTERNAL_DAC
+#define VARIANT "fused"
+#else
+#define VARIANT "separate"
+
+/* the conversion pass the I2S task used to run after the volume adjustment */
+static void bt_i2s_convert_for_internal_dac(int16_t *data, size_t len)
+{
+    uint16_t *dt = (uint16_t *)data;
+    size_t count = len / 2;
+    while (count)
+    {
+        *dt += 0x8000U;
+        dt++;
+        count--;
+    }
+}
+#endif
+
+static void process(void)
+{
+    for (unsigned int b = 0; b < BLOCKS; b++)
+    {
+        const size_t offset = b * BLOCK_FRAMES * 2;
+        const size_t size = BLOCK_FRAMES * 2 * sizeof(int16_t);
+        bt_app_adjust_volume((const uint8_t *)(input + offset), (uint8_t *)(output + offset), size);
+#ifndef CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_INTERNAL_DAC
+        bt_i2s_convert_for_internal_dac(output + offset, size);
+#endif
+    }
+}
+
+static void bench(uint32_t level, const char *name)
+{
+    uint32_t best_cycles = UINT32_MAX;
+    int64_t best_us = INT64_MAX;
+    uint32_t checksum = 0;
+
+    bt_app_set_volume(level);
+    for (int run = 0; run < RUNS; run++)
+    {
+        const int64_t start_us = host_time_us();
+        const uint32_t start = esp_cpu_get_cycle_count();
+        process();
+        const uint32_t cycles = esp_cpu_get_cycle_count() - start;
+        const int64_t us = host_time_us() - start_us;
+        best_cycles = (cycles < best_cycles) ? cycles : best_cycles;
+        best_us = (us < best_us) ? us : best_us;
+    }
+    for (size_t i = 0; i < sizeof(output) / sizeof(output[0]); i++)
+    {
+        checksum = checksum * 31 + (uint16_t)output[i];
+    }
+    const double samples = BLOCKS * BLOCK_FRAMES * 2;
+    printf("%-8s %-10s %5.2f cycles/sample %5.2f ns/sample, checksum %08x\n", VARIANT, name,
+           best_cycles / samples, best_us * 1000.0 / samples, checksum);
+}
+
+int main(void)
+{
+    uint32_t seed = 1;
+
+    esp_log_level_set("*", ESP_LOG_WARN);
+    for (size_t i = 0; i < sizeof(input) / sizeof(input[0]); i++)
+    {
+        seed = seed * 1664525 + 1013904223;
+        input[i] = (int16_t)(seed >> 16);
+    }
+
+    /* 0 dB at the top level, so that it needs the conversion only */
+    bt_app_vc_initialize(-57.0, 0.0, false);
+    bt_app_vc_set_format(48000, 2);
+    bt_app_vc_start_fade(true, 0);
+    bt_app_adjust_volume((const uint8_t *)input, (uint8_t *)output, BLOCK_FRAMES * 2 * sizeof(int16_t));
+
+    bench(127, "0 dB");
+    bench(110, "scaled");
+    bench(64, "dithered");
+    return 0;
+}
@@ -0,0 +1,347 @@
+/*
+ * Bluetooth stand-in, see bt_host.h.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "bt_host.h"
+#include "esp_gap_bt_api.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+#define QUEUE_LEN 32
+#define DEFAULT_DELAY_VALUE 150     /* Bluedroid's default sink delay, in 0.1 ms */
+
+typedef enum {
+    KIND_A2D,
+    KIND_AVRC_CT,
+    KIND_AVRC_TG,
+    KIND_SYNC,
+} kind_t;
+
+typedef struct {
+    kind_t kind;
+    int event;
+    union {
+        esp_a2d_cb_param_t a2d;
+        esp_avrc_ct_cb_param_t ct;
+        esp_avrc_tg_cb_param_t tg;
+        TaskHandle_t waiter;
+    } param;
+} item_t;
+
+static const char TAG[] = "BT_HOST";
+static const char *metadata[] = {"Sine", "Host", "Simulation", "", "", "Test"};
+
+static QueueHandle_t queue = NULL;
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+static esp_a2d_cb_t a2d_cb = NULL;
+static esp_a2d_sink_data_cb_t data_cb = NULL;
+static esp_avrc_ct_cb_t ct_cb = NULL;
+static esp_avrc_tg_cb_t tg_cb = NULL;
+static bool a2d_initialized = false;
+static bool a2d_init_reported = false;
+static uint16_t peer_caps = 0;
+static uint16_t registered = 0;     /* notifications the sink registered for */
+static bt_host_stats_t stats = {0};
+
+
+static void post(const item_t *item)
+{
+    xQueueSend(queue, item, portMAX_DELAY);
+}
+
+static void deliver(item_t *item)
+{
+    switch (item->kind)
+    {
+    case KIND_A2D:
+        if (a2d_cb)
+        {
+            a2d_cb(item->event, &item->param.a2d);
+            return;
+        }
+        break;
+    case KIND_AVRC_CT:
+        if (ct_cb)
+        {
+            ct_cb(item->event, &item->param.ct);
+            return;
+        }
+        break;
+    case KIND_AVRC_TG:
+        if (tg_cb)
+        {
+            tg_cb(item->event, &item->param.tg);
+            return;
+        }
+        break;
+    case KIND_SYNC:
+        xTaskNotifyGive(item->param.waiter);
+        return;
+    }
+    ESP_LOGW(TAG, "no callback for event %d of kind %d", item->event, item->kind);
+}
+
+static void btc_task(void *arg)
+{
+    item_t item;
+    for (;;)
+    {
+        if (xQueueReceive(queue, &item, portMAX_DELAY) == pdTRUE)
+        {
+            deliver(&item);
+        }
+    }
+}
+
+/* Bluedroid reports the initialization once both happened */
+static void report_init(void)
+{
+    if (a2d_cb && a2d_initialized && !a2d_init_reported)
+    {
+        esp_a2d_cb_param_t param = {.a2d_prof_stat.init_state = ESP_A2D_INIT_SUCCESS};
+        a2d_init_reported = true;
+        bt_host_a2d_event(ESP_A2D_PROF_STATE_EVT, &param);
+    }
+}
+
+void bt_host_start(uint16_t peer_rn_caps)
+{
+    peer_caps = peer_rn_caps;
+    queue = xQueueCreate(QUEUE_LEN, sizeof(item_t));
+    xTaskCreate(btc_task, "BTC_TASK", 4096, NULL, 19, NULL);
+}
+
+void bt_host_a2d_event(esp_a2d_cb_event_t event, const esp_a2d_cb_param_t *param)
+{
+    item_t item = {.kind = KIND_A2D, .event = event};
+    if (param)
+    {
+        item.param.a2d = *param;
+    }
+    post(&item);
+}
+
+void bt_host_avrc_ct_event(esp_avrc_ct_cb_event_t event, const esp_avrc_ct_cb_param_t *param)
+{
+    item_t item = {.kind = KIND_AVRC_CT, .event = event};
+    if (param)
+    {
+        item.param.ct = *param;
+    }
+    post(&item);
+}
+
+void bt_host_avrc_tg_event(esp_avrc_tg_cb_event_t event, const esp_avrc_tg_cb_param_t *param)
+{
+    item_t item = {.kind = KIND_AVRC_TG, .event = event};
+    if (param)
+    {
+        item.param.tg = *param;
+    }
+    post(&item);
+}
+
+bool bt_host_change_notify(uint8_t event_id, const esp_avrc_rn_param_t *param)
+{
+    taskENTER_CRITICAL(&lock);
+    const bool was_registered = registered & (1U << event_id);
+    registered &= ~(1U << event_id);
+    if (was_registered)
+    {
+        stats.notifications++;
+    }
+    else
+    {
+        stats.unregistered++;
+    }
+    taskEXIT_CRITICAL(&lock);
+    if (!was_registered)
+    {
+        return false;
+    }
+    esp_avrc_ct_cb_param_t ct = {.change_ntf = {.event_id = event_id, .event_parameter = *param}};
+    bt_host_avrc_ct_event(ESP_AVRC_CT_CHANGE_NOTIFY_EVT, &ct);
+    return true;
+}
+
+void bt_host_audio_data(const uint8_t *data, uint32_t len)
+{
+    if (data_cb)
+    {
+        data_cb(data, len);
+    }
+}
+
+void bt_host_sync(void)
+{
+    item_t item = {.kind = KIND_SYNC, .param.waiter = xTaskGetCurrentTaskHandle()};
+    post(&item);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+}
+
+void bt_host_get_stats(bt_host_stats_t *out)
+{
+    taskENTER_CRITICAL(&lock);
+    *out = stats;
+    taskEXIT_CRITICAL(&lock);
+}
+
+esp_err_t esp_a2d_register_callback(esp_a2d_cb_t callback)
+{
+    a2d_cb = callback;
+    report_init();
+    return ESP_OK;
+}
+
+esp_err_t esp_a2d_sink_register_data_callback(esp_a2d_sink_data_cb_t callback)
+{
+    data_cb = callback;
+    return ESP_OK;
+}
+
+esp_err_t esp_a2d_sink_init(void)
+{
+    a2d_initialized = true;
+    report_init();
+    return ESP_OK;
+}
+
+esp_err_t esp_a2d_sink_set_delay_value(uint16_t delay_value)
+{
+    taskENTER_CRITICAL(&lock);
+    if (stats.delay_reports == 0 || delay_value < stats.delay_min)
+    {
+        stats.delay_min = delay_value;
+    }
+    if (delay_value > stats.delay_max)
+    {
+        stats.delay_max = delay_value;
+    }
+    stats.delay_value = delay_value;
+    stats.delay_reports++;
+    taskEXIT_CRITICAL(&lock);
+
+    esp_a2d_cb_param_t param = {
+        .a2d_set_delay_value_stat = {.set_state = ESP_A2D_SET_SUCCESS, .delay_value = delay_value},
+    };
+    bt_host_a2d_event(ESP_A2D_SNK_SET_DELAY_VALUE_EVT, &param);
+    return ESP_OK;
+}
+
+esp_err_t esp_a2d_sink_get_delay_value(void)
+{
+    esp_a2d_cb_param_t param = {.a2d_get_delay_value_stat.delay_value = DEFAULT_DELAY_VALUE};
+    taskENTER_CRITICAL(&lock);
+    stats.delay_base = DEFAULT_DELAY_VALUE;
+    taskEXIT_CRITICAL(&lock);
+    bt_host_a2d_event(ESP_A2D_SNK_GET_DELAY_VALUE_EVT, &param);
+    return ESP_OK;
+}
+
+esp_err_t esp_avrc_ct_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_avrc_ct_register_callback(esp_avrc_ct_cb_t callback)
+{
+    ct_cb = callback;
+    return ESP_OK;
+}
+
+esp_err_t esp_avrc_ct_send_get_rn_capabilities_cmd(uint8_t tl)
+{
+    esp_avrc_ct_cb_param_t param = {.get_rn_caps_rsp = {.cap_count = __builtin_popcount(peer_caps)}};
+    param.get_rn_caps_rsp.evt_set.bits = peer_caps;
+    bt_host_avrc_ct_event(ESP_AVRC_CT_GET_RN_CAPABILITIES_RSP_EVT, &param);
+    return ESP_OK;
+}
+
+esp_err_t esp_avrc_ct_send_register_notification_cmd(uint8_t tl, uint8_t event_id, uint32_t event_parameter)
+{
+    if (!(peer_caps & (1U << event_id)))
+    {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    taskENTER_CRITICAL(&lock);
+    registered |= 1U << event_id;
+    taskEXIT_CRITICAL(&lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_avrc_ct_send_metadata_cmd(uint8_t tl, uint8_t attr_mask)
+{
+    taskENTER_CRITICAL(&lock);
+    stats.metadata_requests++;
+    taskEXIT_CRITICAL(&lock);
+    for (unsigned int i = 0; i < sizeof(metadata) / sizeof(metadata[0]); i++)
+    {
+        if ((attr_mask & (1U << i)) && metadata[i][0])
+        {
+            /* the callback copies the text, as it must with Bluedroid */
+            esp_avrc_ct_cb_param_t param = {
+                .meta_rsp = {
+                    .attr_id = 1U << i,
+                    .attr_text = (uint8_t *)metadata[i],
+                    .attr_length = strlen(metadata[i]),
+                },
+            };
+            bt_host_avrc_ct_event(ESP_AVRC_CT_METADATA_RSP_EVT, &param);
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_avrc_tg_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_avrc_tg_register_callback(esp_avrc_tg_cb_t callback)
+{
+    tg_cb = callback;
+    return ESP_OK;
+}
+
+esp_err_t esp_avrc_tg_set_rn_evt_cap(const esp_avrc_rn_evt_cap_mask_t *evt_set)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_avrc_tg_send_rn_rsp(esp_avrc_rn_event_ids_t event_id, esp_avrc_rn_rsp_t rsp,
+                                  esp_avrc_rn_param_t *param)
+{
+    taskENTER_CRITICAL(&lock);
+    stats.volume_responses++;
+    taskEXIT_CRITICAL(&lock);
+    return ESP_OK;
+}
+
+bool esp_avrc_rn_evt_bit_mask_operation(esp_avrc_bit_mask_op_t op, esp_avrc_rn_evt_cap_mask_t *events,
+                                        esp_avrc_rn_event_ids_t event_id)
+{
+    const uint16_t bit = 1U << event_id;
+    switch (op)
+    {
+    case ESP_AVRC_BIT_MASK_OP_SET:
+        events->bits |= bit;
+        return true;
+    case ESP_AVRC_BIT_MASK_OP_CLEAR:
+        events->bits &= ~bit;
+        return true;
+    default:
+        return (events->bits & bit) != 0;
+    }
+}
+
+esp_err_t esp_bt_gap_set_scan_mode(esp_bt_connection_mode_t c_mode, esp_bt_discovery_mode_t d_mode)
+{
+    taskENTER_CRITICAL(&lock);
+    stats.connectable = (c_mode == ESP_BT_CONNECTABLE);
+    taskEXIT_CRITICAL(&lock);
+    return ESP_OK;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_a2dp_api.h"
+#include "esp_avrc_api.h"
+
+/*
+* Bluetooth stand-in for the simulation. Events are delivered to the
+* callbacks the application registered from a task of their own, like the
+* Bluedroid BTC task, and requests of the application are answered there
+* as a source would: the notification capabilities, metadata, and the
+* results of getting and setting the delay value.
+*/
+
+typedef struct {
+    uint32_t delay_reports;         /* esp_a2d_sink_set_delay_value() calls */
+    uint16_t delay_value;           /* last value reported, in 0.1 ms */
+    uint16_t delay_base;            /* stack delay returned to the sink */
+    uint16_t delay_min;
+    uint16_t delay_max;
+    uint32_t notifications;         /* change notifications delivered */
+    uint32_t unregistered;          /* changes the sink had not registered for */
+    uint32_t metadata_requests;
+    uint32_t volume_responses;      /* esp_avrc_tg_send_rn_rsp() calls */
+    bool connectable;               /* last scan mode set */
+} bt_host_stats_t;
+
+/*
+* Starts the BTC task. peer_rn_caps are the notification capabilities of
+* the simulated source, as a bit mask of esp_avrc_rn_event_ids_t.
+*/
+void bt_host_start(uint16_t peer_rn_caps);
+
+/*
+* Queue an event for the registered callback.
+*/
+void bt_host_a2d_event(esp_a2d_cb_event_t event, const esp_a2d_cb_param_t *param);
+void bt_host_avrc_ct_event(esp_avrc_ct_cb_event_t event, const esp_avrc_ct_cb_param_t *param);
+void bt_host_avrc_tg_event(esp_avrc_tg_cb_event_t event, const esp_avrc_tg_cb_param_t *param);
+
+/*
+* Queues a change notification if the sink registered for the event, which
+* it has to do again after each notification. Returns false if it had not.
+*/
+bool bt_host_change_notify(uint8_t event_id, const esp_avrc_rn_param_t *param);
+
+/*
+* Passes decoded audio to the registered data callback, in the calling task
+* like the A2DP sink decoder task does.
+*/
+void bt_host_audio_data(const uint8_t *data, uint32_t len);
+
+/*
+* Waits until the events queued so far have been delivered.
+*/
+void bt_host_sync(void);
+
+void bt_host_get_stats(bt_host_stats_t *stats);
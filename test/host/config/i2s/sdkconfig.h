@@ -0,0 +1,34 @@
+/*
+ * External I2S codec with the defaults of main/Kconfig.projbuild.
+ */
+#pragma once
+
+#define CONFIG_FREERTOS_HZ 100
+
+#define CONFIG_EXAMPLE_A2DP_SINK_OUTPUT_EXTERNAL_I2S 1
+
+#define CONFIG_EXAMPLE_A2DP_SINK_FADE_MS 20
+#define CONFIG_EXAMPLE_A2DP_SINK_DITHER 1
+#define CONFIG_EXAMPLE_A2DP_SINK_LATENCY_PROFILE_BALANCED 1
+#define CONFIG_EXAMPLE_A2DP_SINK_RINGBUF_LATENCY_MS 60
+#define CONFIG_EXAMPLE_A2DP_SINK_RINGBUF_MIN_KB 4
+#define CONFIG_EXAMPLE_A2DP_SINK_RINGBUF_MAX_KB 16
+#define CONFIG_EXAMPLE_A2DP_SINK_JITTER_PREFILL_MS 20
+#define CONFIG_EXAMPLE_A2DP_SINK_JITTER_LOW_WATERMARK_MS 5
+#define CONFIG_EXAMPLE_A2DP_SINK_JITTER_HIGH_WATERMARK_MS 50
+#define CONFIG_EXAMPLE_A2DP_SINK_JITTER_ADAPTIVE 1
+#define CONFIG_EXAMPLE_A2DP_SINK_JITTER_DROP_ON_HIGH 1
+#define CONFIG_EXAMPLE_A2DP_SINK_OVERFLOW_DROP_OLDEST 1
+#define CONFIG_EXAMPLE_A2DP_SINK_OVERFLOW_WAIT_MS 10
+#define CONFIG_EXAMPLE_A2DP_SINK_CLOCK_SYNC 1
+#define CONFIG_EXAMPLE_A2DP_SINK_CLOCK_SYNC_MAX_PPM 300
+#define CONFIG_EXAMPLE_A2DP_SINK_DELAY_REPORT 1
+#define CONFIG_EXAMPLE_A2DP_SINK_DELAY_REPORT_THRESHOLD_MS 10
+#define CONFIG_EXAMPLE_A2DP_SINK_XRUN_LOG_INTERVAL_MS 10000
+#define CONFIG_EXAMPLE_A2DP_SINK_DSP_TASK_CORE 1
+#define CONFIG_EXAMPLE_A2DP_SINK_DSP_TASK_PRIORITY 20
+#define CONFIG_EXAMPLE_A2DP_SINK_DSP_TASK_STACK 3072
+#define CONFIG_EXAMPLE_A2DP_SINK_I2S_TASK_CORE 1
+#define CONFIG_EXAMPLE_A2DP_SINK_I2S_TASK_PRIORITY 22
+#define CONFIG_EXAMPLE_A2DP_SINK_I2S_TASK_STACK 2048
+#define CONFIG_EXAMPLE_A2DP_SINK_EVENT_STATS_INTERVAL_MS 60000
@@ -0,0 +1,118 @@
+/*
+ * ESP-IDF system services for the host: timer, cycle counter, random
+ * numbers, log and error names.
+ */
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "esp_cpu.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "freertos_host.h"
+
+static esp_log_level_t log_level = ESP_LOG_INFO;
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t random_state = 0x12345678;
+
+
+int64_t esp_timer_get_time(void)
+{
+    return host_time_us();
+}
+
+uint32_t esp_cpu_get_cycle_count(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return (uint32_t)__rdtsc();
+#else
+    return (uint32_t)(host_time_us() * 1000);
+#endif
+}
+
+uint32_t esp_random(void)
+{
+    /* xorshift32, shared by all tasks like the hardware generator */
+    uint32_t x = __atomic_load_n(&random_state, __ATOMIC_RELAXED);
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    __atomic_store_n(&random_state, x, __ATOMIC_RELAXED);
+    return x;
+}
+
+void esp_fill_random(void *buf, size_t len)
+{
+    uint8_t *p = buf;
+    while (len > 0)
+    {
+        const uint32_t r = esp_random();
+        const size_t n = (len < sizeof(r)) ? len : sizeof(r);
+        for (size_t i = 0; i < n; i++)
+        {
+            p[i] = (uint8_t)(r >> (8 * i));
+        }
+        p += n;
+        len -= n;
+    }
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    /* one level for all tags */
+    log_level = level;
+}
+
+uint32_t esp_log_timestamp(void)
+{
+    return (uint32_t)(host_time_us() / 1000);
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    if (level > log_level)
+    {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    /* whole lines, the tasks log concurrently */
+    pthread_mutex_lock(&log_lock);
+    vprintf(format, args);
+    fflush(stdout);
+    pthread_mutex_unlock(&log_lock);
+    va_end(args);
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code)
+    {
+    case ESP_OK:
+        return "ESP_OK";
+    case ESP_FAIL:
+        return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:
+        return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+        return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:
+        return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:
+        return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:
+        return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED:
+        return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT:
+        return "ESP_ERR_TIMEOUT";
+    default:
+        return "UNKNOWN ERROR";
+    }
+}
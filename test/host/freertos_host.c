@@ -0,0 +1,442 @@
+/*
+ * FreeRTOS stand-in on POSIX threads.
+ *
+ * Each task is a detached thread with a notification count guarded by its
+ * own mutex. Queues and semaphores are fixed size rings under a mutex with
+ * two condition variables, all waiting on CLOCK_MONOTONIC. Timeouts end on
+ * the tick boundary they would end on with FreeRTOS, so code that waits a
+ * number of ticks sees the same granularity as on the target. Critical
+ * sections take one recursive mutex shared by all spinlocks.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "freertos_host.h"
+
+#define TICK_US (1000000 / configTICK_RATE_HZ)
+
+struct host_task {
+    char name[16];
+    TaskFunction_t fn;
+    void *arg;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notify;            /* notification count */
+    bool running;
+    uint64_t cpu_us;            /* set once the task is deleted */
+    struct host_task *next;
+};
+
+struct host_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    UBaseType_t length;
+    UBaseType_t item_size;      /* 0 for semaphores */
+    UBaseType_t count;
+    UBaseType_t head;
+    uint8_t items[];
+};
+
+static pthread_mutex_t critical = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct host_task *registry = NULL;      /* all tasks, newest first */
+static __thread struct host_task *current = NULL;
+static int64_t start_us = 0;
+
+
+static int64_t monotonic_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+__attribute__((constructor)) static void host_time_init(void)
+{
+    start_us = monotonic_us();
+}
+
+int64_t host_time_us(void)
+{
+    return monotonic_us() - start_us;
+}
+
+/* absolute CLOCK_MONOTONIC time of the tick boundary ticks from now */
+static struct timespec tick_deadline(TickType_t ticks)
+{
+    const int64_t tick_now = host_time_us() / TICK_US;
+    const int64_t us = start_us + (tick_now + (int64_t)ticks) * TICK_US;
+    struct timespec ts = {
+        .tv_sec = us / 1000000,
+        .tv_nsec = (us % 1000000) * 1000,
+    };
+    return ts;
+}
+
+static void cond_init(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static void unlock_on_cancel(void *lock)
+{
+    pthread_mutex_unlock(lock);
+}
+
+/* waits on cond until the deadline, forever with portMAX_DELAY; returns
+   false once the deadline has passed. A task deleted while waiting
+   releases the lock. */
+static bool cond_wait(pthread_cond_t *cond, pthread_mutex_t *lock, TickType_t ticks, const struct timespec *deadline)
+{
+    volatile int rc = 0;
+    pthread_cleanup_push(unlock_on_cancel, lock);
+    if (ticks == portMAX_DELAY)
+    {
+        pthread_cond_wait(cond, lock);
+    }
+    else
+    {
+        rc = pthread_cond_timedwait(cond, lock, deadline);
+    }
+    pthread_cleanup_pop(0);
+    return rc != ETIMEDOUT;
+}
+
+static uint64_t thread_cpu_us(pthread_t thread)
+{
+    clockid_t clock;
+    struct timespec ts;
+    if (pthread_getcpuclockid(thread, &clock) != 0 || clock_gettime(clock, &ts) != 0)
+    {
+        return 0;
+    }
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static struct host_task *task_new(const char *name)
+{
+    struct host_task *task = calloc(1, sizeof(*task));
+    if (task == NULL)
+    {
+        return NULL;
+    }
+    snprintf(task->name, sizeof(task->name), "%s", name);
+    pthread_mutex_init(&task->lock, NULL);
+    cond_init(&task->cond);
+    task->running = true;
+    pthread_mutex_lock(&registry_lock);
+    task->next = registry;
+    registry = task;
+    pthread_mutex_unlock(&registry_lock);
+    return task;
+}
+
+/* tasks are never freed, a handle may still be notified after the task
+   was deleted */
+static void task_finish(struct host_task *task)
+{
+    pthread_mutex_lock(&registry_lock);
+    task->cpu_us = thread_cpu_us(task->thread);
+    task->running = false;
+    pthread_mutex_unlock(&registry_lock);
+}
+
+static void *task_entry(void *arg)
+{
+    struct host_task *task = arg;
+    current = task;
+    task->fn(task->arg);
+    /* a FreeRTOS task must not return, treat it as deleting itself */
+    vTaskDelete(NULL);
+    return NULL;
+}
+
+void host_critical_enter(portMUX_TYPE *mux)
+{
+    (void)mux;
+    pthread_mutex_lock(&critical);
+}
+
+void host_critical_exit(portMUX_TYPE *mux)
+{
+    (void)mux;
+    pthread_mutex_unlock(&critical);
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core)
+{
+    struct host_task *task = task_new(name);
+    if (task == NULL)
+    {
+        return pdFAIL;
+    }
+    task->fn = fn;
+    task->arg = arg;
+    /* the handle is valid before the task runs, as with FreeRTOS */
+    if (handle)
+    {
+        *handle = task;
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    const int rc = pthread_create(&task->thread, &attr, task_entry, task);
+    pthread_attr_destroy(&attr);
+    if (rc != 0)
+    {
+        task->running = false;
+        if (handle)
+        {
+            *handle = NULL;
+        }
+        return pdFAIL;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                       UBaseType_t priority, TaskHandle_t *handle)
+{
+    return xTaskCreatePinnedToCore(fn, name, stack_depth, arg, priority, handle, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task == NULL || task == current)
+    {
+        task = xTaskGetCurrentTaskHandle();
+        task_finish(task);
+        pthread_exit(NULL);
+    }
+    /* the waits of the stand-in are cancellation points */
+    task_finish(task);
+    pthread_cancel(task->thread);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    if (ticks == 0)
+    {
+        sched_yield();
+        return;
+    }
+    const struct timespec deadline = tick_deadline(ticks);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR)
+    {
+    }
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(host_time_us() / TICK_US);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    if (current == NULL)
+    {
+        /* a thread not created as a task, e.g. the one running main() */
+        current = task_new("main");
+        current->thread = pthread_self();
+    }
+    return current;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks)
+{
+    struct host_task *task = xTaskGetCurrentTaskHandle();
+    const struct timespec deadline = tick_deadline(ticks);
+
+    pthread_mutex_lock(&task->lock);
+    while (task->notify == 0 && ticks > 0)
+    {
+        if (!cond_wait(&task->cond, &task->lock, ticks, &deadline))
+        {
+            break;
+        }
+    }
+    const uint32_t value = task->notify;
+    if (value > 0)
+    {
+        task->notify = clear_on_exit ? 0 : value - 1;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    pthread_mutex_lock(&task->lock);
+    task->notify++;
+    pthread_cond_signal(&task->cond);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higher_priority_task_woken)
+{
+    xTaskNotifyGive(task);
+    if (higher_priority_task_woken)
+    {
+        *higher_priority_task_woken = pdFALSE;
+    }
+}
+
+size_t host_task_get_stats(host_task_stats_t *stats, size_t max)
+{
+    pthread_mutex_lock(&registry_lock);
+    size_t count = 0;
+    for (struct host_task *task = registry; task != NULL; task = task->next)
+    {
+        count++;
+    }
+    /* the registry is newest first */
+    size_t i = count;
+    for (struct host_task *task = registry; task != NULL; task = task->next)
+    {
+        if (--i < max)
+        {
+            stats[i].name = task->name;
+            stats[i].running = task->running;
+            stats[i].cpu_us = task->running ? thread_cpu_us(task->thread) : task->cpu_us;
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+    return (count < max) ? count : max;
+}
+
+static struct host_queue *queue_new(UBaseType_t length, UBaseType_t item_size)
+{
+    struct host_queue *queue = calloc(1, sizeof(*queue) + (size_t)length * item_size);
+    if (queue == NULL)
+    {
+        return NULL;
+    }
+    pthread_mutex_init(&queue->lock, NULL);
+    cond_init(&queue->not_empty);
+    cond_init(&queue->not_full);
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    return queue_new(length, item_size);
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    const struct timespec deadline = tick_deadline(ticks);
+
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->length)
+    {
+        if (ticks == 0 || !cond_wait(&queue->not_full, &queue->lock, ticks, &deadline))
+        {
+            pthread_mutex_unlock(&queue->lock);
+            return errQUEUE_FULL;
+        }
+    }
+    if (queue->item_size > 0)
+    {
+        const UBaseType_t tail = (queue->head + queue->count) % queue->length;
+        memcpy(queue->items + (size_t)tail * queue->item_size, item, queue->item_size);
+    }
+    queue->count++;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    const struct timespec deadline = tick_deadline(ticks);
+
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0)
+    {
+        if (ticks == 0 || !cond_wait(&queue->not_empty, &queue->lock, ticks, &deadline))
+        {
+            pthread_mutex_unlock(&queue->lock);
+            return errQUEUE_EMPTY;
+        }
+    }
+    if (queue->item_size > 0)
+    {
+        memcpy(item, queue->items + (size_t)queue->head * queue->item_size, queue->item_size);
+        queue->head = (queue->head + 1) % queue->length;
+    }
+    queue->count--;
+    pthread_cond_signal(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->count = 0;
+    queue->head = 0;
+    pthread_cond_broadcast(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    const UBaseType_t count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    if (queue == NULL)
+    {
+        return;
+    }
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_cond_destroy(&queue->not_full);
+    free(queue);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return queue_new(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count)
+{
+    struct host_queue *queue = queue_new(max_count, 0);
+    if (queue)
+    {
+        queue->count = initial_count;
+    }
+    return queue;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    /* no priority inheritance, the host scheduler ignores priorities anyway */
+    return xSemaphoreCreateCounting(1, 1);
+}
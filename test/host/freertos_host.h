@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+* Host extensions of the FreeRTOS stand-in, for the tests and the
+* simulation to observe the tasks.
+*/
+
+typedef struct {
+    const char *name;
+    uint64_t cpu_us;        /* CPU time used by the task's thread */
+    bool running;           /* not deleted yet */
+} host_task_stats_t;
+
+/*
+* Returns the monotonic time in us since the start of the process, the
+* time base of the tick count and of esp_timer_get_time().
+*/
+int64_t host_time_us(void);
+
+/*
+* Copies the statistics of up to max tasks, in order of creation, and
+* returns the number copied. Threads that called into the task API without
+* being created as a task are included under the name "main".
+*/
+size_t host_task_get_stats(host_task_stats_t *stats, size_t max);
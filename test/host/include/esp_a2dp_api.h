@@ -0,0 +1,103 @@
+#pragma once
+
+/*
+* The A2DP sink API of Bluedroid as far as the application uses it. The
+* stand-ins in bt_host.c keep the registered callbacks for the simulation
+* to call, and answer requests with the events Bluedroid would send.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_bt_defs.h"
+#include "esp_err.h"
+
+#define ESP_A2D_MCT_SBC         (0)
+#define ESP_A2D_CIE_LEN_SBC     (4)
+#define ESP_A2D_PSC_DELAY_RPT   (1 << 0)
+
+typedef uint8_t esp_a2d_mct_t;
+typedef uint16_t esp_a2d_psc_t;
+
+typedef struct {
+    esp_a2d_mct_t type;
+    union {
+        uint8_t sbc[ESP_A2D_CIE_LEN_SBC];
+    } cie;
+} esp_a2d_mcc_t;
+
+typedef enum {
+    ESP_A2D_CONNECTION_STATE_DISCONNECTED = 0,
+    ESP_A2D_CONNECTION_STATE_CONNECTING,
+    ESP_A2D_CONNECTION_STATE_CONNECTED,
+    ESP_A2D_CONNECTION_STATE_DISCONNECTING,
+} esp_a2d_connection_state_t;
+
+typedef enum {
+    ESP_A2D_DISC_RSN_NORMAL = 0,
+    ESP_A2D_DISC_RSN_ABNORMAL,
+} esp_a2d_disc_rsn_t;
+
+typedef enum {
+    ESP_A2D_AUDIO_STATE_REMOTE_SUSPEND = 0,
+    ESP_A2D_AUDIO_STATE_STOPPED,
+    ESP_A2D_AUDIO_STATE_STARTED,
+} esp_a2d_audio_state_t;
+
+typedef enum {
+    ESP_A2D_DEINIT_SUCCESS = 0,
+    ESP_A2D_INIT_SUCCESS,
+} esp_a2d_init_state_t;
+
+typedef enum {
+    ESP_A2D_SET_SUCCESS = 0,
+    ESP_A2D_SET_INVALID_PARAMS,
+} esp_a2d_set_delay_value_state_t;
+
+typedef enum {
+    ESP_A2D_CONNECTION_STATE_EVT = 0,
+    ESP_A2D_AUDIO_STATE_EVT,
+    ESP_A2D_AUDIO_CFG_EVT,
+    ESP_A2D_MEDIA_CTRL_ACK_EVT,
+    ESP_A2D_PROF_STATE_EVT,
+    ESP_A2D_SNK_PSC_CFG_EVT,
+    ESP_A2D_SNK_SET_DELAY_VALUE_EVT,
+    ESP_A2D_SNK_GET_DELAY_VALUE_EVT,
+} esp_a2d_cb_event_t;
+
+typedef union {
+    struct a2d_conn_stat_param {
+        esp_a2d_connection_state_t state;
+        esp_bd_addr_t remote_bda;
+        esp_a2d_disc_rsn_t disc_rsn;
+    } conn_stat;
+    struct a2d_audio_stat_param {
+        esp_a2d_audio_state_t state;
+        esp_bd_addr_t remote_bda;
+    } audio_stat;
+    struct a2d_audio_cfg_param {
+        esp_bd_addr_t remote_bda;
+        esp_a2d_mcc_t mcc;
+    } audio_cfg;
+    struct a2d_prof_stat_param {
+        esp_a2d_init_state_t init_state;
+    } a2d_prof_stat;
+    struct a2d_psc_cfg_param {
+        esp_a2d_psc_t psc_mask;
+    } a2d_psc_cfg_stat;
+    struct a2d_set_stat_param {
+        esp_a2d_set_delay_value_state_t set_state;
+        uint16_t delay_value;
+    } a2d_set_delay_value_stat;
+    struct a2d_get_stat_param {
+        uint16_t delay_value;
+    } a2d_get_delay_value_stat;
+} esp_a2d_cb_param_t;
+
+typedef void (*esp_a2d_cb_t)(esp_a2d_cb_event_t event, esp_a2d_cb_param_t *param);
+typedef void (*esp_a2d_sink_data_cb_t)(const uint8_t *buf, uint32_t len);
+
+esp_err_t esp_a2d_register_callback(esp_a2d_cb_t callback);
+esp_err_t esp_a2d_sink_register_data_callback(esp_a2d_sink_data_cb_t callback);
+esp_err_t esp_a2d_sink_init(void);
+esp_err_t esp_a2d_sink_set_delay_value(uint16_t delay_value);
+esp_err_t esp_a2d_sink_get_delay_value(void);
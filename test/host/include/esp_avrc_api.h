@@ -0,0 +1,151 @@
+#pragma once
+
+/*
+* The AVRCP controller and target API of Bluedroid as far as the
+* application uses it, see esp_a2dp_api.h.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_bt_defs.h"
+#include "esp_err.h"
+
+typedef enum {
+    ESP_AVRC_CT_CONNECTION_STATE_EVT = 0,
+    ESP_AVRC_CT_PASSTHROUGH_RSP_EVT = 1,
+    ESP_AVRC_CT_METADATA_RSP_EVT = 2,
+    ESP_AVRC_CT_PLAY_STATUS_RSP_EVT = 3,
+    ESP_AVRC_CT_CHANGE_NOTIFY_EVT = 4,
+    ESP_AVRC_CT_REMOTE_FEATURES_EVT = 5,
+    ESP_AVRC_CT_GET_RN_CAPABILITIES_RSP_EVT = 6,
+    ESP_AVRC_CT_SET_ABSOLUTE_VOLUME_RSP_EVT = 7,
+} esp_avrc_ct_cb_event_t;
+
+typedef enum {
+    ESP_AVRC_TG_CONNECTION_STATE_EVT = 0,
+    ESP_AVRC_TG_REMOTE_FEATURES_EVT = 1,
+    ESP_AVRC_TG_PASSTHROUGH_CMD_EVT = 2,
+    ESP_AVRC_TG_SET_ABSOLUTE_VOLUME_CMD_EVT = 3,
+    ESP_AVRC_TG_REGISTER_NOTIFICATION_EVT = 4,
+    ESP_AVRC_TG_SET_PLAYER_APP_VALUE_EVT = 5,
+} esp_avrc_tg_cb_event_t;
+
+typedef enum {
+    ESP_AVRC_MD_ATTR_TITLE = 0x1,
+    ESP_AVRC_MD_ATTR_ARTIST = 0x2,
+    ESP_AVRC_MD_ATTR_ALBUM = 0x4,
+    ESP_AVRC_MD_ATTR_TRACK_NUM = 0x8,
+    ESP_AVRC_MD_ATTR_NUM_TRACKS = 0x10,
+    ESP_AVRC_MD_ATTR_GENRE = 0x20,
+    ESP_AVRC_MD_ATTR_PLAYING_TIME = 0x40,
+} esp_avrc_md_attr_mask_t;
+
+typedef enum {
+    ESP_AVRC_RN_PLAY_STATUS_CHANGE = 0x01,
+    ESP_AVRC_RN_TRACK_CHANGE = 0x02,
+    ESP_AVRC_RN_TRACK_REACHED_END = 0x03,
+    ESP_AVRC_RN_TRACK_REACHED_START = 0x04,
+    ESP_AVRC_RN_PLAY_POS_CHANGED = 0x05,
+    ESP_AVRC_RN_BATTERY_STATUS_CHANGE = 0x06,
+    ESP_AVRC_RN_SYSTEM_STATUS_CHANGE = 0x07,
+    ESP_AVRC_RN_APP_SETTING_CHANGE = 0x08,
+    ESP_AVRC_RN_NOW_PLAYING_CHANGE = 0x09,
+    ESP_AVRC_RN_AVAILABLE_PLAYERS_CHANGE = 0x0a,
+    ESP_AVRC_RN_ADDRESSED_PLAYER_CHANGE = 0x0b,
+    ESP_AVRC_RN_UIDS_CHANGE = 0x0c,
+    ESP_AVRC_RN_VOLUME_CHANGE = 0x0d,
+    ESP_AVRC_RN_MAX_EVT,
+} esp_avrc_rn_event_ids_t;
+
+typedef enum {
+    ESP_AVRC_BIT_MASK_OP_TEST = 0,
+    ESP_AVRC_BIT_MASK_OP_SET = 1,
+    ESP_AVRC_BIT_MASK_OP_CLEAR = 2,
+} esp_avrc_bit_mask_op_t;
+
+typedef enum {
+    ESP_AVRC_RN_RSP_INTERIM = 13,
+    ESP_AVRC_RN_RSP_CHANGED = 15,
+} esp_avrc_rn_rsp_t;
+
+typedef struct {
+    uint16_t bits;
+} esp_avrc_rn_evt_cap_mask_t;
+
+typedef union {
+    uint8_t volume;
+    uint8_t playback;
+    uint8_t elm_id[8];
+    uint32_t play_pos;
+} esp_avrc_rn_param_t;
+
+typedef union {
+    struct avrc_ct_conn_stat_param {
+        bool connected;
+        esp_bd_addr_t remote_bda;
+    } conn_stat;
+    struct avrc_ct_psth_rsp_param {
+        uint8_t tl;
+        uint8_t key_code;
+        uint8_t key_state;
+    } psth_rsp;
+    struct avrc_ct_meta_rsp_param {
+        uint8_t attr_id;
+        uint8_t *attr_text;
+        int attr_length;
+    } meta_rsp;
+    struct avrc_ct_change_notify_param {
+        uint8_t event_id;
+        esp_avrc_rn_param_t event_parameter;
+    } change_ntf;
+    struct avrc_ct_rmt_feats_param {
+        uint32_t feat_mask;
+        uint16_t tg_feat_flag;
+        esp_bd_addr_t remote_bda;
+    } rmt_feats;
+    struct avrc_ct_get_rn_caps_rsp_param {
+        uint8_t cap_count;
+        esp_avrc_rn_evt_cap_mask_t evt_set;
+    } get_rn_caps_rsp;
+} esp_avrc_ct_cb_param_t;
+
+typedef union {
+    struct avrc_tg_conn_stat_param {
+        bool connected;
+        esp_bd_addr_t remote_bda;
+    } conn_stat;
+    struct avrc_tg_rmt_feats_param {
+        uint32_t feat_mask;
+        uint16_t ct_feat_flag;
+        esp_bd_addr_t remote_bda;
+    } rmt_feats;
+    struct avrc_tg_psth_cmd_param {
+        uint8_t key_code;
+        uint8_t key_state;
+    } psth_cmd;
+    struct avrc_tg_set_abs_vol_param {
+        uint8_t volume;
+    } set_abs_vol;
+    struct avrc_tg_reg_ntf_param {
+        uint8_t event_id;
+        uint32_t event_parameter;
+    } reg_ntf;
+} esp_avrc_tg_cb_param_t;
+
+typedef void (*esp_avrc_ct_cb_t)(esp_avrc_ct_cb_event_t event, esp_avrc_ct_cb_param_t *param);
+typedef void (*esp_avrc_tg_cb_t)(esp_avrc_tg_cb_event_t event, esp_avrc_tg_cb_param_t *param);
+
+esp_err_t esp_avrc_ct_init(void);
+esp_err_t esp_avrc_ct_register_callback(esp_avrc_ct_cb_t callback);
+esp_err_t esp_avrc_ct_send_get_rn_capabilities_cmd(uint8_t tl);
+esp_err_t esp_avrc_ct_send_register_notification_cmd(uint8_t tl, uint8_t event_id, uint32_t event_parameter);
+esp_err_t esp_avrc_ct_send_metadata_cmd(uint8_t tl, uint8_t attr_mask);
+
+esp_err_t esp_avrc_tg_init(void);
+esp_err_t esp_avrc_tg_register_callback(esp_avrc_tg_cb_t callback);
+esp_err_t esp_avrc_tg_set_rn_evt_cap(const esp_avrc_rn_evt_cap_mask_t *evt_set);
+esp_err_t esp_avrc_tg_send_rn_rsp(esp_avrc_rn_event_ids_t event_id, esp_avrc_rn_rsp_t rsp,
+                                  esp_avrc_rn_param_t *param);
+
+bool esp_avrc_rn_evt_bit_mask_operation(esp_avrc_bit_mask_op_t op, esp_avrc_rn_evt_cap_mask_t *events,
+                                        esp_avrc_rn_event_ids_t event_id);
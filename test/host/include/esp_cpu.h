@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdint.h>
+
+/* the time stamp counter on x86 hosts, nanoseconds elsewhere */
+uint32_t esp_cpu_get_cycle_count(void);
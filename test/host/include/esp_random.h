@@ -0,0 +1,8 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* a fixed sequence, so that runs with dither are repeatable */
+uint32_t esp_random(void);
+void esp_fill_random(void *buf, size_t len);
@@ -0,0 +1,4 @@
+#pragma once
+
+/* esp_system.h includes esp_random.h in IDF 5.0 */
+#include "esp_random.h"
@@ -0,0 +1,56 @@
+#pragma once
+
+/*
+* Host stand-in for the parts of the FreeRTOS API used by the application,
+* implemented on POSIX threads in freertos_host.c. Priorities and core
+* affinities are accepted but the host scheduler runs the tasks, so the
+* timing is that of the host rather than of the ESP32.
+*/
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOSConfig.h"
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE                 0
+#define pdTRUE                  1
+#define pdFAIL                  pdFALSE
+#define pdPASS                  pdTRUE
+#define errQUEUE_EMPTY          pdFALSE
+#define errQUEUE_FULL           pdFALSE
+
+#define portMAX_DELAY           ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS      ((TickType_t)1000 / configTICK_RATE_HZ)
+#define portNUM_PROCESSORS      2
+#define pdMS_TO_TICKS(ms)       ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000))
+
+#define tskNO_AFFINITY          0x7fffffff
+
+#define configASSERT(x)         assert(x)
+#define portYIELD_FROM_ISR(x)   ((void)(x))
+
+/* all critical sections share one recursive mutex, the spinlock is unused */
+typedef struct {
+    uint32_t owner;
+    uint32_t count;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {0, 0}
+
+void host_critical_enter(portMUX_TYPE *mux);
+void host_critical_exit(portMUX_TYPE *mux);
+
+#define portENTER_CRITICAL(mux)         host_critical_enter(mux)
+#define portEXIT_CRITICAL(mux)          host_critical_exit(mux)
+#define portENTER_CRITICAL_ISR(mux)     host_critical_enter(mux)
+#define portEXIT_CRITICAL_ISR(mux)      host_critical_exit(mux)
+#define taskENTER_CRITICAL(mux)         host_critical_enter(mux)
+#define taskEXIT_CRITICAL(mux)          host_critical_exit(mux)
+#define taskENTER_CRITICAL_ISR(mux)     host_critical_enter(mux)
+#define taskEXIT_CRITICAL_ISR(mux)      host_critical_exit(mux)
@@ -0,0 +1,6 @@
+#pragma once
+
+#include "sdkconfig.h"
+
+#define configTICK_RATE_HZ      CONFIG_FREERTOS_HZ
+#define configMAX_PRIORITIES    25
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "freertos/queue.h"
+
+/* semaphores are queues of items without data, as in FreeRTOS */
+typedef QueueHandle_t SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count);
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+
+#define xSemaphoreTake(sem, ticks)  xQueueReceive(sem, NULL, ticks)
+#define xSemaphoreGive(sem)         xQueueSend(sem, NULL, 0)
+#define vSemaphoreDelete(sem)       vQueueDelete(sem)
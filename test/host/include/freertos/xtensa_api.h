@@ -0,0 +1,3 @@
+#pragma once
+
+/* nothing of the Xtensa port is used by the application */
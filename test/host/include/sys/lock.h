@@ -0,0 +1,3 @@
+#pragma once
+
+/* included by the A2DP example code, no lock is used */
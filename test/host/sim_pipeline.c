@@ -0,0 +1,911 @@
+/*
+ * Host simulation of the sink: the application code of main/ on the
+ * FreeRTOS and Bluetooth stand-ins, driven by a script of connection,
+ * audio configuration, volume and AVRCP events, with PCM fed through the
+ * A2DP data callback at the pace of a source. The audio ends up in a WAV
+ * file through the WAV output backend.
+ *
+ * The latency is taken from the audio in flight: bytes passed to the data
+ * callback and not yet written to the file, less the bytes the sink
+ * dropped, plus the audio queued in the emulated output. The file writes
+ * are observed by wrapping fopen() and fwrite() at link time. The last
+ * delay reported to the source, less the stack delay, is compared with the
+ * mean latency of the last stream, and the 95th percentile of the latency
+ * of each stream with the pre-fill of its profile plus the output latency.
+ * The output is starved when a write comes after the audio written before
+ * has played out.
+ *
+ * Usage: sim_pipeline [-i input.wav] [-o output.wav] [-q|-v] script
+ *
+ * Without an input file a 997 Hz sine at -12 dBFS is played. Script lines
+ * are "<time ms> <command> [arguments]", "expect <value> <op> <limit>" or
+ * comments starting with '#', see scripts/basic.txt for the commands.
+ */
+
+#define _GNU_SOURCE
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "bt_app_av.h"
+#include "bt_app_core.h"
+#include "bt_app_event_stats.h"
+#include "bt_app_jitter.h"
+#include "bt_app_latency.h"
+#include "bt_app_output.h"
+#include "bt_app_volume_control.h"
+#include "bt_app_xrun.h"
+#include "bt_host.h"
+#include "esp_gap_bt_api.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos_host.h"
+
+#define MAX_LINES 256
+#define MAX_EXPECTS 16
+#define MAX_PACKET_FRAMES 4096
+#define LATENCY_BINS 2000           /* 1 ms each */
+#define SETTLE_MS 1000              /* latency is sampled from this long after a start */
+#define SINE_HZ 997.0
+#define SINE_AMPLITUDE 8192.0       /* -12 dBFS */
+#define PEER_RN_CAPS ((1 << ESP_AVRC_RN_PLAY_STATUS_CHANGE) | (1 << ESP_AVRC_RN_TRACK_CHANGE) | \
+                      (1 << ESP_AVRC_RN_PLAY_POS_CHANGED))
+
+typedef struct {
+    uint32_t time_ms;
+    char text[96];
+} line_t;
+
+typedef struct {
+    char name[32];
+    char op[3];
+    double limit;
+} expect_t;
+
+/* the simulated source, set by the script and read by the feeder */
+typedef struct {
+    bool streaming;
+    uint32_t generation;            /* incremented on each start */
+    uint32_t sample_rate;
+    uint8_t channels;
+    uint32_t packet_frames;
+    uint32_t jitter_ms;             /* packets are delayed by up to this much */
+    int32_t drift_ppm;              /* source clock offset */
+    int64_t hold_until_us;          /* a gap in the link, packets are held back */
+} source_t;
+
+static const char TAG[] = "SIM";
+
+const char *host_wav_path = "sim_out.wav";
+
+static pthread_mutex_t source_lock = PTHREAD_MUTEX_INITIALIZER;
+static source_t source = {
+    .sample_rate = 44100,
+    .channels = 2,
+    .packet_frames = 640,
+};
+static TaskHandle_t feeder_task = NULL;
+
+/* input PCM, NULL for the sine */
+static int16_t *input = NULL;
+static size_t input_frames = 0;
+static uint8_t input_channels = 0;
+static uint64_t input_pos = 0;
+
+/* measurements */
+static FILE *output_file = NULL;
+static atomic_uint_fast64_t fed_bytes = 0;          /* since the last start */
+static atomic_uint_fast64_t written_bytes = 0;
+static atomic_uint_fast64_t total_written = 0;
+static atomic_uint_fast64_t dropped_base = 0;       /* dropped by the sink before the last start */
+static atomic_int_fast64_t settle_us = INT64_MAX;
+static atomic_uint bytes_per_s = 176400;
+static uint32_t latency_hist[LATENCY_BINS + 1];
+static uint32_t latency_count = 0;
+static uint32_t latency_max_ms = 0;
+static uint32_t stream_hist[LATENCY_BINS + 1];      /* since the last start */
+static double stream_latency_sum_ms = 0;
+static double stream_target_sum_ms = 0;
+static atomic_uint buffered_target_ms = 0;          /* pre-fill of the last buffering */
+static uint32_t stream_latency_count = 0;
+static bool stream_open = false;                    /* started and not finished */
+static double p95_error_max_ms = 0;                 /* over the finished streams */
+static int64_t play_end_us = 0;                     /* the audio written has played out */
+static double starved_ms = 0;
+static uint64_t total_fed = 0;
+static uint32_t packets = 0;
+static uint64_t callback_us = 0;
+static uint32_t callback_max_us = 0;
+static uint32_t streams = 0;
+static uint32_t connections = 0;
+
+static line_t lines[MAX_LINES];
+static size_t line_count = 0;
+static expect_t expects[MAX_EXPECTS];
+static size_t expect_count = 0;
+
+
+/* ---------------------------------------------------------------------------
+ * output capture
+ */
+
+FILE *__real_fopen(const char *path, const char *mode);
+size_t __real_fwrite(const void *ptr, size_t size, size_t n, FILE *stream);
+
+FILE *__wrap_fopen(const char *path, const char *mode)
+{
+    FILE *file = __real_fopen(path, mode);
+    if (file && strcmp(path, host_wav_path) == 0)
+    {
+        output_file = file;
+    }
+    return file;
+}
+
+/* bytes the sink dropped while playing, which never reach the file */
+static uint64_t sink_dropped_bytes(void)
+{
+    bt_app_jitter_stats_t jitter;
+    bt_i2s_overflow_stats_t overflow;
+    bt_app_jitter_get_stats(&jitter, false);
+    bt_i2s_task_get_overflow_stats(&overflow, false);
+    return (uint64_t)jitter.dropped_bytes + overflow.dropped_oldest + overflow.dropped_newest;
+}
+
+/* the adaptive pre-fill only applies at the next buffering, so the latency
+   follows the target of the last one rather than the current target */
+bool __real_bt_app_jitter_prefilled(void);
+
+bool __wrap_bt_app_jitter_prefilled(void)
+{
+    const bool prefilled = __real_bt_app_jitter_prefilled();
+    if (prefilled)
+    {
+        atomic_store(&buffered_target_ms, (unsigned int)(bt_app_jitter_target() * 1000 / atomic_load(&bytes_per_s)));
+    }
+    return prefilled;
+}
+
+/* the output counts the bytes being written as queued once fwrite() returns */
+static void record_latency(size_t writing)
+{
+    const uint64_t fed = atomic_load(&fed_bytes);
+    const uint64_t written = atomic_load(&written_bytes);
+    const uint64_t dropped = sink_dropped_bytes() - atomic_load(&dropped_base);
+    const uint64_t in_flight = (fed > written + dropped) ? fed - written - dropped : 0;
+    const double latency_ms = (double)(in_flight + writing) * 1000 / atomic_load(&bytes_per_s) +
+                              bt_app_output_get()->queued() / 10.0;
+    uint32_t ms = (uint32_t)latency_ms;
+
+    stream_latency_sum_ms += latency_ms;
+    stream_target_sum_ms += atomic_load(&buffered_target_ms);
+    stream_latency_count++;
+
+    latency_max_ms = (ms > latency_max_ms) ? ms : latency_max_ms;
+    ms = (ms < LATENCY_BINS) ? ms : LATENCY_BINS;
+    latency_hist[ms]++;
+    latency_count++;
+    stream_hist[ms]++;
+}
+
+/* the output plays what is written back to back, from the first write */
+static void record_playout(size_t bytes, bool settled)
+{
+    const int64_t now = host_time_us();
+
+    if (settled && play_end_us > 0 && now > play_end_us)
+    {
+        starved_ms += (now - play_end_us) / 1000.0;
+    }
+    play_end_us = ((now > play_end_us) ? now : play_end_us) +
+                  (int64_t)bytes * 1000000 / atomic_load(&bytes_per_s);
+}
+
+size_t __wrap_fwrite(const void *ptr, size_t size, size_t n, FILE *stream)
+{
+    /* the header is written at the start of the file */
+    const bool audio = (stream == output_file && ftell(stream) > 0);
+    const size_t done = __real_fwrite(ptr, size, n, stream);
+    if (audio)
+    {
+        atomic_fetch_add(&written_bytes, done * size);
+        atomic_fetch_add(&total_written, done * size);
+        const bool settled = host_time_us() >= atomic_load(&settle_us);
+        record_playout(done * size, settled);
+        if (settled)
+        {
+            record_latency(done * size);
+        }
+    }
+    return done;
+}
+
+static uint32_t latency_percentile(const uint32_t *hist, uint32_t count, unsigned int percent)
+{
+    const uint64_t target = ((uint64_t)count * percent + 99) / 100;
+    uint64_t sum = 0;
+    for (uint32_t ms = 0; ms <= LATENCY_BINS; ms++)
+    {
+        sum += hist[ms];
+        if (sum >= target)
+        {
+            return ms;
+        }
+    }
+    return LATENCY_BINS;
+}
+
+/* ---------------------------------------------------------------------------
+ * source
+ */
+
+static bool load_wav(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    uint8_t header[12];
+    uint16_t format = 0;
+    uint16_t bits = 0;
+
+    if (file == NULL || fread(header, 1, sizeof(header), file) != sizeof(header) ||
+        memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0)
+    {
+        fprintf(stderr, "%s: not a WAV file\n", path);
+        return false;
+    }
+    for (;;)
+    {
+        uint8_t chunk[8];
+        if (fread(chunk, 1, sizeof(chunk), file) != sizeof(chunk))
+        {
+            fprintf(stderr, "%s: no data chunk\n", path);
+            return false;
+        }
+        const uint32_t size = chunk[4] | chunk[5] << 8 | chunk[6] << 16 | (uint32_t)chunk[7] << 24;
+        if (memcmp(chunk, "fmt ", 4) == 0)
+        {
+            uint8_t fmt[16];
+            if (size < sizeof(fmt) || fread(fmt, 1, sizeof(fmt), file) != sizeof(fmt))
+            {
+                return false;
+            }
+            format = fmt[0] | fmt[1] << 8;
+            input_channels = fmt[2];
+            bits = fmt[14] | fmt[15] << 8;
+            fseek(file, (size - sizeof(fmt) + 1) & ~1U, SEEK_CUR);
+        }
+        else if (memcmp(chunk, "data", 4) == 0)
+        {
+            if (format != 1 || bits != 16 || input_channels < 1 || input_channels > 2)
+            {
+                fprintf(stderr, "%s: only 16 bit PCM with one or two channels is supported\n", path);
+                return false;
+            }
+            input = malloc(size);
+            input_frames = fread(input, 1, size, file) / (input_channels * sizeof(int16_t));
+            fclose(file);
+            return input_frames > 0;
+        }
+        else
+        {
+            fseek(file, (size + 1) & ~1U, SEEK_CUR);
+        }
+    }
+}
+
+static void fill_packet(int16_t *pcm, uint32_t frames, const source_t *src)
+{
+    for (uint32_t i = 0; i < frames; i++, input_pos++)
+    {
+        int16_t left;
+        int16_t right;
+        if (input)
+        {
+            const int16_t *frame = input + (input_pos % input_frames) * input_channels;
+            left = frame[0];
+            right = frame[input_channels - 1];
+        }
+        else
+        {
+            left = right = (int16_t)lrint(SINE_AMPLITUDE * sin(2.0 * M_PI * SINE_HZ * input_pos / src->sample_rate));
+        }
+        if (src->channels == 2)
+        {
+            pcm[2 * i] = left;
+            pcm[2 * i + 1] = right;
+        }
+        else
+        {
+            pcm[i] = (int16_t)(((int32_t)left + right) / 2);
+        }
+    }
+}
+
+static void sleep_until(int64_t time_us)
+{
+    const int64_t delay = time_us - host_time_us();
+    if (delay > 0)
+    {
+        const struct timespec ts = {.tv_sec = delay / 1000000, .tv_nsec = (delay % 1000000) * 1000};
+        nanosleep(&ts, NULL);
+    }
+}
+
+/* the A2DP sink decoder task of Bluedroid, passing a decoded packet at a
+   time to the data callback */
+static void feeder_task_handler(void *arg)
+{
+    static int16_t pcm[MAX_PACKET_FRAMES * 2];
+    uint32_t generation = 0;
+    double next_us = 0;
+    int64_t last_us = 0;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&source_lock);
+        const source_t src = source;
+        pthread_mutex_unlock(&source_lock);
+
+        if (!src.streaming)
+        {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+            continue;
+        }
+        if (src.generation != generation)
+        {
+            generation = src.generation;
+            next_us = (double)host_time_us();
+        }
+
+        /* a faster source clock sends more frames per second */
+        next_us += src.packet_frames * 1e6 / (src.sample_rate * (1.0 + src.drift_ppm * 1e-6));
+        int64_t due = (int64_t)next_us;
+        if (src.jitter_ms > 0)
+        {
+            due += rand() % (src.jitter_ms * 1000);
+        }
+        due = (due > last_us) ? due : last_us;
+        due = (due > src.hold_until_us) ? due : src.hold_until_us;
+        sleep_until(due);
+        last_us = due;
+
+        const uint32_t bytes = src.packet_frames * src.channels * sizeof(int16_t);
+        fill_packet(pcm, src.packet_frames, &src);
+        const int64_t start = host_time_us();
+        bt_host_audio_data((const uint8_t *)pcm, bytes);
+        const uint32_t took = (uint32_t)(host_time_us() - start);
+        atomic_fetch_add(&fed_bytes, bytes);
+
+        callback_us += took;
+        callback_max_us = (took > callback_max_us) ? took : callback_max_us;
+        total_fed += bytes;
+        packets++;
+    }
+}
+
+/* ---------------------------------------------------------------------------
+ * script
+ */
+
+/* what main.c does once the Bluetooth stack is up */
+static void sim_stack_evt(uint16_t event, void *param)
+{
+    bt_app_event_stats_set_name(sim_stack_evt, "stack");
+    bt_app_av_name_handlers();
+
+    esp_avrc_ct_init();
+    esp_avrc_ct_register_callback(bt_app_rc_ct_cb);
+    esp_avrc_tg_init();
+    esp_avrc_tg_register_callback(bt_app_rc_tg_cb);
+
+    esp_avrc_rn_evt_cap_mask_t evt_set = {0};
+    esp_avrc_rn_evt_bit_mask_operation(ESP_AVRC_BIT_MASK_OP_SET, &evt_set, ESP_AVRC_RN_VOLUME_CHANGE);
+    esp_avrc_tg_set_rn_evt_cap(&evt_set);
+
+    esp_a2d_sink_init();
+    esp_a2d_register_callback(&bt_app_a2d_cb);
+    esp_a2d_sink_register_data_callback(bt_app_a2d_data_cb);
+    esp_a2d_sink_get_delay_value();
+
+    esp_bt_gap_set_scan_mode(ESP_BT_CONNECTABLE, ESP_BT_GENERAL_DISCOVERABLE);
+}
+
+static void set_streaming(bool streaming)
+{
+    pthread_mutex_lock(&source_lock);
+    source.streaming = streaming;
+    if (streaming)
+    {
+        source.generation++;
+    }
+    pthread_mutex_unlock(&source_lock);
+}
+
+static void send_audio_state(esp_a2d_audio_state_t state)
+{
+    esp_a2d_cb_param_t param = {.audio_stat.state = state};
+    bt_host_a2d_event(ESP_A2D_AUDIO_STATE_EVT, &param);
+}
+
+static void send_conn_state(esp_a2d_connection_state_t state)
+{
+    esp_a2d_cb_param_t param = {.conn_stat = {.state = state, .remote_bda = {0x02, 0, 0, 0, 0, 0x01}}};
+    bt_host_a2d_event(ESP_A2D_CONNECTION_STATE_EVT, &param);
+}
+
+static void send_avrc_conn_state(bool connected)
+{
+    esp_avrc_ct_cb_param_t ct = {.conn_stat = {.connected = connected, .remote_bda = {0x02, 0, 0, 0, 0, 0x01}}};
+    esp_avrc_tg_cb_param_t tg = {.conn_stat = {.connected = connected, .remote_bda = {0x02, 0, 0, 0, 0, 0x01}}};
+    bt_host_avrc_ct_event(ESP_AVRC_CT_CONNECTION_STATE_EVT, &ct);
+    bt_host_avrc_tg_event(ESP_AVRC_TG_CONNECTION_STATE_EVT, &tg);
+}
+
+/* SBC configuration as the source selects it, 16 blocks and 8 subbands */
+static void send_audio_cfg(uint32_t sample_rate, uint8_t channels)
+{
+    esp_a2d_cb_param_t param = {.audio_cfg.mcc.type = ESP_A2D_MCT_SBC};
+    uint8_t *sbc = param.audio_cfg.mcc.cie.sbc;
+
+    sbc[0] = (sample_rate == 32000) ? 0x40 : (sample_rate == 44100) ? 0x20 : (sample_rate == 48000) ? 0x10 : 0x80;
+    sbc[0] |= (channels == 1) ? 0x08 : 0x01;
+    sbc[1] = 0x10 | 0x04 | 0x01;
+    sbc[2] = 2;
+    sbc[3] = 53;
+    bt_host_a2d_event(ESP_A2D_AUDIO_CFG_EVT, &param);
+
+    pthread_mutex_lock(&source_lock);
+    source.sample_rate = sample_rate;
+    source.channels = channels;
+    pthread_mutex_unlock(&source_lock);
+    atomic_store(&bytes_per_s, sample_rate * channels * sizeof(int16_t));
+}
+
+static void send_volume(uint8_t volume)
+{
+    esp_avrc_tg_cb_param_t param = {.set_abs_vol.volume = volume};
+    bt_host_avrc_tg_event(ESP_AVRC_TG_SET_ABSOLUTE_VOLUME_CMD_EVT, &param);
+}
+
+static void notify(uint8_t event_id, uint32_t value)
+{
+    esp_avrc_rn_param_t param = {0};
+    if (event_id == ESP_AVRC_RN_PLAY_POS_CHANGED)
+    {
+        param.play_pos = value;
+    }
+    if (!bt_host_change_notify(event_id, &param))
+    {
+        ESP_LOGW(TAG, "sink not registered for notification %u", event_id);
+    }
+}
+
+static void start_stream(void)
+{
+    /* the latency is counted from here, after the buffers settled */
+    atomic_store(&settle_us, INT64_MAX);
+    bt_host_sync();
+    atomic_store(&fed_bytes, 0);
+    atomic_store(&written_bytes, 0);
+    atomic_store(&dropped_base, sink_dropped_bytes());
+    stream_latency_sum_ms = 0;
+    stream_target_sum_ms = 0;
+    stream_latency_count = 0;
+    memset(stream_hist, 0, sizeof(stream_hist));
+    play_end_us = 0;
+    stream_open = true;
+    atomic_store(&settle_us, host_time_us() + SETTLE_MS * 1000);
+    streams++;
+    send_audio_state(ESP_A2D_AUDIO_STATE_STARTED);
+    set_streaming(true);
+    xTaskNotifyGive(feeder_task);
+}
+
+/* compares the 95th percentile of the latency of the stream with the
+   pre-fill it played from, averaged over its writes, plus the output latency */
+static void finish_stream(void)
+{
+    if (!stream_open || stream_latency_count == 0)
+    {
+        return;
+    }
+    const double expected_ms = stream_target_sum_ms / stream_latency_count + bt_app_output_get()->latency() / 10.0;
+    const uint32_t p95 = latency_percentile(stream_hist, stream_latency_count, 95);
+    const double error_ms = fabs(p95 - expected_ms);
+
+    ESP_LOGI(TAG, "stream %u: latency p95 %u ms, pre-fill and output %.1f ms", streams, p95, expected_ms);
+    p95_error_max_ms = (error_ms > p95_error_max_ms) ? error_ms : p95_error_max_ms;
+    stream_open = false;
+}
+
+static void stop_stream(esp_a2d_audio_state_t state)
+{
+    atomic_store(&settle_us, INT64_MAX);
+    bt_host_sync();
+    finish_stream();
+    set_streaming(false);
+    send_audio_state(state);
+}
+
+static bool run_command(const char *text)
+{
+    char cmd[32];
+    unsigned int a = 0;
+    unsigned int b = 0;
+    int n = sscanf(text, "%31s %u %u", cmd, &a, &b);
+
+    if (n < 1)
+    {
+        return false;
+    }
+    ESP_LOGI(TAG, "> %s", text);
+    if (strcmp(cmd, "connect") == 0 && n == 3)
+    {
+        /* Bluedroid opens the stream, configures the codec, then reports
+           the connection; AVRCP connects right after */
+        connections++;
+        send_conn_state(ESP_A2D_CONNECTION_STATE_CONNECTING);
+        esp_a2d_cb_param_t psc = {.a2d_psc_cfg_stat.psc_mask = strstr(text, "delay_report") ? ESP_A2D_PSC_DELAY_RPT : 0};
+        bt_host_a2d_event(ESP_A2D_SNK_PSC_CFG_EVT, &psc);
+        send_audio_cfg(a, (uint8_t)b);
+        send_conn_state(ESP_A2D_CONNECTION_STATE_CONNECTED);
+        send_avrc_conn_state(true);
+        /* the source follows the volume of the sink */
+        esp_avrc_tg_cb_param_t reg = {.reg_ntf.event_id = ESP_AVRC_RN_VOLUME_CHANGE};
+        bt_host_avrc_tg_event(ESP_AVRC_TG_REGISTER_NOTIFICATION_EVT, &reg);
+    }
+    else if (strcmp(cmd, "config") == 0 && n == 3)
+    {
+        send_audio_cfg(a, (uint8_t)b);
+    }
+    else if (strcmp(cmd, "start") == 0)
+    {
+        start_stream();
+    }
+    else if (strcmp(cmd, "suspend") == 0)
+    {
+        stop_stream(ESP_A2D_AUDIO_STATE_REMOTE_SUSPEND);
+    }
+    else if (strcmp(cmd, "disconnect") == 0)
+    {
+        stop_stream(ESP_A2D_AUDIO_STATE_STOPPED);
+        send_avrc_conn_state(false);
+        send_conn_state(ESP_A2D_CONNECTION_STATE_DISCONNECTING);
+        send_conn_state(ESP_A2D_CONNECTION_STATE_DISCONNECTED);
+    }
+    else if (strcmp(cmd, "volume") == 0 && n == 2)
+    {
+        send_volume((uint8_t)a);
+    }
+    else if (strcmp(cmd, "slide") == 0 && n == 3)
+    {
+        /* a volume slider, one command per step in a burst */
+        const int step = (b > a) ? 1 : -1;
+        for (int v = (int)a; v != (int)b + step; v += step)
+        {
+            send_volume((uint8_t)v);
+        }
+    }
+    else if (strcmp(cmd, "track") == 0)
+    {
+        notify(ESP_AVRC_RN_TRACK_CHANGE, 0);
+    }
+    else if (strcmp(cmd, "play_pos") == 0 && n == 2)
+    {
+        notify(ESP_AVRC_RN_PLAY_POS_CHANGED, a);
+    }
+    else if (strcmp(cmd, "jitter") == 0 && n == 2)
+    {
+        pthread_mutex_lock(&source_lock);
+        source.jitter_ms = a;
+        pthread_mutex_unlock(&source_lock);
+    }
+    else if (strcmp(cmd, "gap") == 0 && n == 2)
+    {
+        pthread_mutex_lock(&source_lock);
+        source.hold_until_us = host_time_us() + (int64_t)a * 1000;
+        pthread_mutex_unlock(&source_lock);
+    }
+    else if (strcmp(cmd, "drift") == 0)
+    {
+        int ppm = 0;
+        if (sscanf(text, "%*s %d", &ppm) != 1)
+        {
+            return false;
+        }
+        pthread_mutex_lock(&source_lock);
+        source.drift_ppm = ppm;
+        pthread_mutex_unlock(&source_lock);
+    }
+    else if (strcmp(cmd, "packet") == 0 && n == 2 && a > 0 && a <= MAX_PACKET_FRAMES)
+    {
+        pthread_mutex_lock(&source_lock);
+        source.packet_frames = a;
+        pthread_mutex_unlock(&source_lock);
+    }
+    else if (strcmp(cmd, "profile") == 0)
+    {
+        char name[16] = "";
+        sscanf(text, "%*s %15s", name);
+        const bt_app_latency_profile_t profile = (strcmp(name, "low") == 0) ? BT_APP_LATENCY_LOW :
+                                                 (strcmp(name, "robust") == 0) ? BT_APP_LATENCY_ROBUST :
+                                                 BT_APP_LATENCY_BALANCED;
+        if (!bt_app_latency_set_profile(profile))
+        {
+            ESP_LOGW(TAG, "profile not changed while connected");
+        }
+    }
+    else if (strcmp(cmd, "end") != 0)
+    {
+        return false;
+    }
+    return true;
+}
+
+static bool load_script(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    char buf[128];
+    unsigned int number = 0;
+
+    if (file == NULL)
+    {
+        perror(path);
+        return false;
+    }
+    while (fgets(buf, sizeof(buf), file))
+    {
+        number++;
+        char *text = buf + strspn(buf, " \t");
+        text[strcspn(text, "#\r\n")] = 0;
+        for (size_t len = strlen(text); len > 0 && (text[len - 1] == ' ' || text[len - 1] == '\t'); len--)
+        {
+            text[len - 1] = 0;
+        }
+        if (text[0] == 0)
+        {
+            continue;
+        }
+        if (strncmp(text, "expect ", 7) == 0)
+        {
+            expect_t *e = &expects[expect_count];
+            if (expect_count == MAX_EXPECTS || sscanf(text + 7, "%31s %2s %lf", e->name, e->op, &e->limit) != 3)
+            {
+                fprintf(stderr, "%s:%u: bad expectation\n", path, number);
+                return false;
+            }
+            expect_count++;
+            continue;
+        }
+        line_t *line = &lines[line_count];
+        int skip = 0;
+        if (line_count == MAX_LINES || sscanf(text, "%u %n", &line->time_ms, &skip) != 1 ||
+            (line_count > 0 && line->time_ms < lines[line_count - 1].time_ms))
+        {
+            fprintf(stderr, "%s:%u: expected a non-decreasing time in ms\n", path, number);
+            return false;
+        }
+        snprintf(line->text, sizeof(line->text), "%s", text + skip);
+        line_count++;
+    }
+    fclose(file);
+    return true;
+}
+
+/* ---------------------------------------------------------------------------
+ * report
+ */
+
+typedef struct {
+    const char *name;
+    double value;
+} result_t;
+
+static bool check_expects(const result_t *results, size_t count)
+{
+    bool ok = true;
+    for (size_t i = 0; i < expect_count; i++)
+    {
+        const expect_t *e = &expects[i];
+        const result_t *r = NULL;
+        for (size_t j = 0; j < count; j++)
+        {
+            if (strcmp(results[j].name, e->name) == 0)
+            {
+                r = &results[j];
+            }
+        }
+        if (r == NULL)
+        {
+            printf("FAIL: unknown value %s\n", e->name);
+            ok = false;
+            continue;
+        }
+        const double v = r->value;
+        const bool met = (strcmp(e->op, "<") == 0) ? v < e->limit : (strcmp(e->op, "<=") == 0) ? v <= e->limit :
+                         (strcmp(e->op, ">") == 0) ? v > e->limit : (strcmp(e->op, ">=") == 0) ? v >= e->limit :
+                         (strcmp(e->op, "==") == 0) ? v == e->limit : false;
+        printf("%s: %s = %g, expected %s %g\n", met ? "ok" : "FAIL", e->name, v, e->op, e->limit);
+        ok &= met;
+    }
+    return ok;
+}
+
+static void report_tasks(double audio_s)
+{
+    host_task_stats_t tasks[32];
+    const size_t count = host_task_get_stats(tasks, 32);
+    uint64_t audio_cpu_us = 0;
+
+    printf("CPU time per task:");
+    for (size_t i = 0; i < count; i++)
+    {
+        /* tasks started several times are summed up under their name */
+        bool seen = false;
+        for (size_t j = 0; j < i; j++)
+        {
+            seen |= (strcmp(tasks[j].name, tasks[i].name) == 0);
+        }
+        if (seen)
+        {
+            continue;
+        }
+        uint64_t us = 0;
+        unsigned int instances = 0;
+        for (size_t j = i; j < count; j++)
+        {
+            if (strcmp(tasks[j].name, tasks[i].name) == 0)
+            {
+                us += tasks[j].cpu_us;
+                instances++;
+            }
+        }
+        if (strcmp(tasks[i].name, "BtDspTask") == 0 || strcmp(tasks[i].name, "BtI2STask") == 0)
+        {
+            audio_cpu_us += us;
+        }
+        printf(" %s %.1f ms", tasks[i].name, us / 1000.0);
+        if (instances > 1)
+        {
+            printf(" (%u runs)", instances);
+        }
+    }
+    printf("\n");
+    if (audio_s > 0)
+    {
+        printf("DSP and I2S tasks: %.2f %% of a host core while playing, %.0f x real time\n",
+               audio_cpu_us / 1e4 / audio_s, audio_cpu_us > 0 ? audio_s * 1e6 / audio_cpu_us : 0.0);
+    }
+}
+
+static bool report(double elapsed_s)
+{
+    bt_host_stats_t bt;
+    bt_app_xrun_counter_t xruns[BT_APP_XRUN_NUM];
+    bt_host_get_stats(&bt);
+    bt_app_xrun_get(xruns);
+
+    pthread_mutex_lock(&source_lock);
+    const uint32_t rate = source.sample_rate;
+    const uint8_t channels = source.channels;
+    pthread_mutex_unlock(&source_lock);
+    const double audio_s = (double)atomic_load(&total_written) / (rate * channels * sizeof(int16_t));
+
+    printf("\n--- simulation report ---\n");
+    printf("%.1f s, %u connection(s), %u stream(s)\n", elapsed_s, connections, streams);
+    printf("fed %u packets, %llu bytes; wrote %llu bytes to %s\n", packets,
+           (unsigned long long)total_fed, (unsigned long long)atomic_load(&total_written), host_wav_path);
+    if (packets > 0)
+    {
+        printf("data callback: %.1f us per packet on average, %u us max\n",
+               (double)callback_us / packets, callback_max_us);
+    }
+    if (latency_count > 0)
+    {
+        printf("latency (in flight plus output): p50 %u ms, p95 %u ms, max %u ms over %u writes\n",
+               latency_percentile(latency_hist, latency_count, 50),
+               latency_percentile(latency_hist, latency_count, 95), latency_max_ms, latency_count);
+        printf("latency p95 per stream: %.1f ms at most from the pre-fill and output\n", p95_error_max_ms);
+    }
+    printf("output starved: %.1f ms while streaming\n", starved_ms);
+    printf("underruns: %u, ringbuffer full: %u\n", xruns[BT_APP_XRUN_RING_EMPTY].count,
+           xruns[BT_APP_XRUN_RING_FULL].count);
+    double delay_error_ms = 0;
+    if (bt.delay_reports > 0)
+    {
+        printf("delay reports: %u, last %.1f ms, range %.1f..%.1f ms\n", bt.delay_reports,
+               bt.delay_value / 10.0, bt.delay_min / 10.0, bt.delay_max / 10.0);
+    }
+    if (bt.delay_reports > 0 && stream_latency_count > 0)
+    {
+        const double measured_ms = stream_latency_sum_ms / stream_latency_count;
+        delay_error_ms = fabs((bt.delay_value - bt.delay_base) / 10.0 - measured_ms);
+        printf("last stream: %.1f ms latency on average, %.1f ms reported without the stack delay\n",
+               measured_ms, (bt.delay_value - bt.delay_base) / 10.0);
+    }
+    printf("AVRCP: %u notifications delivered, %u not registered, %u metadata requests, %u volume responses\n",
+           bt.notifications, bt.unregistered, bt.metadata_requests, bt.volume_responses);
+    report_tasks(audio_s);
+
+    const result_t results[] = {
+        {"output_ms", audio_s * 1000},
+        {"latency_p50_ms", latency_percentile(latency_hist, latency_count, 50)},
+        {"latency_p95_ms", latency_percentile(latency_hist, latency_count, 95)},
+        {"latency_max_ms", latency_max_ms},
+        {"latency_p95_error_ms", p95_error_max_ms},
+        {"starved_ms", starved_ms},
+        {"callback_max_us", callback_max_us},
+        {"underruns", xruns[BT_APP_XRUN_RING_EMPTY].count},
+        {"delay_reports", bt.delay_reports},
+        {"delay_error_ms", delay_error_ms},
+        {"lost_notifications", bt.unregistered},
+        {"metadata_requests", bt.metadata_requests},
+        {"connectable", bt.connectable},
+    };
+    return check_expects(results, sizeof(results) / sizeof(results[0])) && audio_s > 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *input_path = NULL;
+    esp_log_level_t level = ESP_LOG_INFO;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "i:o:qv")) != -1)
+    {
+        switch (opt)
+        {
+        case 'i':
+            input_path = optarg;
+            break;
+        case 'o':
+            host_wav_path = optarg;
+            break;
+        case 'q':
+            level = ESP_LOG_WARN;
+            break;
+        case 'v':
+            level = ESP_LOG_DEBUG;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-i input.wav] [-o output.wav] [-q|-v] script\n", argv[0]);
+            return 2;
+        }
+    }
+    if (optind != argc - 1 || !load_script(argv[optind]) || (input_path && !load_wav(input_path)))
+    {
+        fprintf(stderr, "usage: %s [-i input.wav] [-o output.wav] [-q|-v] script\n", argv[0]);
+        return 2;
+    }
+    esp_log_level_set("*", level);
+
+    /* app_main() */
+    bt_app_vc_initialize(-57.0, -6.0, false);
+    bt_app_set_initial_volume();
+    bt_app_task_start_up();
+    bt_host_start(PEER_RN_CAPS);
+    bt_app_work_dispatch(sim_stack_evt, 0, NULL, 0, NULL);
+    xTaskCreate(feeder_task_handler, "BtA2dSinkT", 4096, NULL, 21, &feeder_task);
+
+    const int64_t start = host_time_us();
+    for (size_t i = 0; i < line_count; i++)
+    {
+        sleep_until(start + (int64_t)lines[i].time_ms * 1000);
+        if (!run_command(lines[i].text))
+        {
+            fprintf(stderr, "bad command: %s\n", lines[i].text);
+            return 2;
+        }
+    }
+
+    /* let the application handle what is queued, then complete the file */
+    bt_host_sync();
+    finish_stream();
+    vTaskDelay(pdMS_TO_TICKS(100));
+    bt_app_output_get()->uninstall();
+    return report((host_time_us() - start) / 1e6) ? 0 : 1;
+}
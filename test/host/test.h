@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdio.h>
+
+/*
+* Checks for the host tests: a failed check is reported with its location
+* and the test goes on, TEST_RESULT() makes the exit status.
+*/
+
+static unsigned int test_checks;
+static unsigned int test_failures;
+
+#define CHECK(cond) \
+    do { \
+        test_checks++; \
+        if (!(cond)) { \
+            test_failures++; \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        } \
+    } while (0)
+
+#define CHECK_EQ(a, b) \
+    do { \
+        const long long _a = (long long)(a); \
+        const long long _b = (long long)(b); \
+        test_checks++; \
+        if (_a != _b) { \
+            test_failures++; \
+            printf("%s:%d: check failed: %s == %s (%lld != %lld)\n", __FILE__, __LINE__, #a, #b, _a, _b); \
+        } \
+    } while (0)
+
+#define TEST_RESULT() \
+    (printf("%s: %u checks, %u failed\n", __FILE__, test_checks, test_failures), test_failures ? 1 : 0)
@@ -0,0 +1,167 @@
+/*
+ * Clock drift compensation against a simulated link: a source sending
+ * packets at its own clock with random delays, and an output consuming
+ * DMA blocks at the corrected rate of the internal DAC resampler. Each run
+ * starts from a jitter buffer at its target, with no estimate, and checks
+ * that the estimate converges to the source's clock offset while the fill
+ * level stays near the target.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "bt_app_clock_sync.h"
+#include "bt_app_dac_output.h"
+#include "esp_log.h"
+#include "test.h"
+
+#define RATE 44100
+#define FRAME_BYTES 4
+#define PACKET_FRAMES 640               /* 5 SBC frames of 128 samples */
+#define BLOCK_FRAMES 240                /* DMA descriptor */
+#define TARGET_BYTES (20 * RATE / 1000 * FRAME_BYTES)
+#define RUN_S 600
+#define SETTLED_PPM 2.0
+#define TOLERANCE_UPPM (BT_APP_CLOCK_SYNC_UPPM_PER_PPM / 2)
+
+typedef struct {
+    double offset_ppm;                  /* source clock against the output */
+    double jitter_ms;                   /* packets are delayed by up to this */
+} link_t;
+
+typedef struct {
+    double settle_s;                    /* first time the estimate came within SETTLED_PPM */
+    double mean_ppm;                    /* estimate over the second half of the run */
+    double stddev_ppm;
+    double correction_stddev_ppm;       /* of the applied correction, likewise */
+    double max_error_ms;                /* largest fill level deviation from the target */
+    double final_error_ms;              /* largest deviation over the last minute */
+} run_t;
+
+/* the correction the controller applies to the output */
+static int32_t correction_uppm = 0;
+
+void bt_app_dac_output_set_correction(int32_t uppm)
+{
+    correction_uppm = uppm;
+}
+
+static double random_ms(double max)
+{
+    return max * rand() / ((double)RAND_MAX + 1);
+}
+
+static run_t simulate(link_t link)
+{
+    run_t run = {.settle_s = -1};
+    double sum = 0;
+    double sum_sq = 0;
+    double corr_sum = 0;
+    double corr_sum_sq = 0;
+    uint32_t count = 0;
+    const double packet_s = PACKET_FRAMES / (RATE * (1 + link.offset_ppm * 1e-6));
+    double next_send = 0;
+    double next_arrival = random_ms(link.jitter_ms) / 1000;
+    double next_block = 0;
+    int64_t fill = TARGET_BYTES;
+
+    srand(1);
+    bt_app_clock_sync_reset();
+    bt_app_clock_sync_set_format(RATE, 2);
+
+    while (next_block < RUN_S)
+    {
+        if (next_arrival <= next_block)
+        {
+            fill += PACKET_FRAMES * FRAME_BYTES;
+            next_send += packet_s;
+            /* packets keep their order */
+            const double arrival = next_send + random_ms(link.jitter_ms) / 1000;
+            next_arrival = (arrival > next_arrival) ? arrival : next_arrival;
+            continue;
+        }
+
+        /* the output plays on from silence if the buffer ran empty */
+        const int64_t consumed = (fill < BLOCK_FRAMES * FRAME_BYTES) ? fill : BLOCK_FRAMES * FRAME_BYTES;
+        fill -= consumed;
+        bt_app_clock_sync_update((size_t)fill, TARGET_BYTES, (size_t)consumed);
+        next_block += BLOCK_FRAMES / (RATE * (1 + correction_uppm * 1e-12));
+
+        const double error_ms = fabs((double)(fill - TARGET_BYTES)) * 1000 / (RATE * FRAME_BYTES);
+        run.max_error_ms = (error_ms > run.max_error_ms) ? error_ms : run.max_error_ms;
+        if (next_block > RUN_S - 60)
+        {
+            run.final_error_ms = (error_ms > run.final_error_ms) ? error_ms : run.final_error_ms;
+        }
+        const double estimate = (double)bt_app_clock_sync_get_offset() / BT_APP_CLOCK_SYNC_UPPM_PER_PPM;
+        if (run.settle_s < 0 && fabs(estimate - link.offset_ppm) < SETTLED_PPM)
+        {
+            run.settle_s = next_block;
+        }
+        if (next_block > RUN_S / 2)
+        {
+            sum += estimate;
+            sum_sq += estimate * estimate;
+            corr_sum += correction_uppm * 1e-6;
+            corr_sum_sq += correction_uppm * 1e-6 * correction_uppm * 1e-6;
+            count++;
+        }
+    }
+    run.mean_ppm = sum / count;
+    run.stddev_ppm = sqrt(fmax(sum_sq / count - run.mean_ppm * run.mean_ppm, 0));
+    run.correction_stddev_ppm = sqrt(fmax(corr_sum_sq / count - (corr_sum / count) * (corr_sum / count), 0));
+    return run;
+}
+
+static void test_convergence(void)
+{
+    static const link_t links[] = {
+        {0, 0}, {20, 0}, {-50, 0}, {100, 5}, {-200, 10}, {250, 20},
+    };
+
+    for (size_t i = 0; i < sizeof(links) / sizeof(links[0]); i++)
+    {
+        const run_t r = simulate(links[i]);
+        printf("%+5.0f ppm, %2.0f ms jitter: estimate %+8.3f ppm sd %.2f, correction sd %5.2f ppm, "
+               "within %.0f ppm after %5.1f s, fill error max %5.2f ms, %5.2f ms in the last minute\n",
+               links[i].offset_ppm, links[i].jitter_ms, r.mean_ppm, r.stddev_ppm, r.correction_stddev_ppm,
+               SETTLED_PPM, r.settle_s, r.max_error_ms, r.final_error_ms);
+        /* jitter moves the estimate around, about 0.4 ppm per ms */
+        CHECK(fabs(r.mean_ppm - links[i].offset_ppm) < 0.5 + r.stddev_ppm);
+        CHECK(r.stddev_ppm < 0.5 + 0.5 * links[i].jitter_ms);
+        CHECK(r.settle_s >= 0 && r.settle_s < RUN_S / 4);
+        /* the packet size and the jitter, nothing of the drift left */
+        CHECK(r.final_error_ms < PACKET_FRAMES * 1000.0 / RATE + links[i].jitter_ms);
+    }
+}
+
+static void test_limit(void)
+{
+    /* beyond CONFIG_EXAMPLE_A2DP_SINK_CLOCK_SYNC_MAX_PPM the correction saturates */
+    const run_t r = simulate((link_t) {CONFIG_EXAMPLE_A2DP_SINK_CLOCK_SYNC_MAX_PPM + 100, 0});
+    printf("%+5d ppm: estimate %+8.3f ppm, fill error %.0f ms after %d s\n",
+           CONFIG_EXAMPLE_A2DP_SINK_CLOCK_SYNC_MAX_PPM + 100, r.mean_ppm, r.max_error_ms, RUN_S);
+    CHECK_EQ(bt_app_clock_sync_get_offset(),
+             (int64_t)CONFIG_EXAMPLE_A2DP_SINK_CLOCK_SYNC_MAX_PPM * BT_APP_CLOCK_SYNC_UPPM_PER_PPM);
+    CHECK_EQ(correction_uppm, bt_app_clock_sync_get_offset());
+}
+
+static void test_format_change(void)
+{
+    /* the estimate carries over to a new format, and a reset clears it */
+    simulate((link_t) {-50, 0});
+    bt_app_clock_sync_set_format(48000, 2);
+    CHECK(llabs(correction_uppm + 50LL * BT_APP_CLOCK_SYNC_UPPM_PER_PPM) < TOLERANCE_UPPM);
+    bt_app_clock_sync_reset();
+    CHECK_EQ(bt_app_clock_sync_get_offset(), 0);
+    CHECK_EQ(correction_uppm, 0);
+}
+
+int main(void)
+{
+    esp_log_level_set("*", ESP_LOG_WARN);
+    test_convergence();
+    test_limit();
+    test_format_change();
+    return TEST_RESULT();
+}
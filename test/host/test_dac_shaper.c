@@ -0,0 +1,226 @@
+/*
+ * Noise-shaped requantization for the internal DAC, built once for the
+ * stream rate (config/dac) and once for twice the rate (config/dac_2x).
+ *
+ * A sine at an exact DFT bin goes through the output stage, the sine is
+ * fitted and subtracted, and the residual noise is summed over the audio
+ * band (20 Hz to 20 kHz) and below 6 kHz, where hearing is most sensitive.
+ * The same is done for plain truncation to the upper 8 bits, which is what
+ * the DAC does without the shaper, and for rounding. The cycles per sample
+ * of the output stage are taken from the cycle counter, the host's TSC.
+ */
+
+#include <complex.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bt_app_dac_output.h"
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "test.h"
+
+#define RATE 44100
+#define N_LOG2 14
+#define N (1 << N_LOG2)                 /* DFT length at the stream rate */
+#define TONE_BIN 372                    /* 1001 Hz */
+#define WARMUP 1024                     /* input frames before the measured block */
+#define BENCH_FRAMES 4096
+#define BENCH_RUNS 200
+
+typedef struct {
+    double snr_db;                      /* sine to noise, 20 Hz to 20 kHz */
+    double noise_db;                    /* noise below 20 kHz, dB re full scale sine */
+    double noise_6k_db;                 /* noise below 6 kHz */
+} result_t;
+
+static int16_t input[(N + WARMUP) * BT_APP_DAC_RATE_FACTOR + 4];
+static int16_t output[(N + WARMUP) * BT_APP_DAC_RATE_FACTOR + 4];
+static double complex spectrum[N * BT_APP_DAC_RATE_FACTOR];
+
+
+static void fft(double complex *x, unsigned int n)
+{
+    for (unsigned int i = 1, j = 0; i < n; i++)
+    {
+        unsigned int bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+        {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j)
+        {
+            const double complex t = x[i];
+            x[i] = x[j];
+            x[j] = t;
+        }
+    }
+    for (unsigned int len = 2; len <= n; len <<= 1)
+    {
+        const double complex w = cexp(-2.0 * M_PI * I / len);
+        for (unsigned int i = 0; i < n; i += len)
+        {
+            double complex wk = 1;
+            for (unsigned int k = 0; k < len / 2; k++, wk *= w)
+            {
+                const double complex u = x[i + k];
+                const double complex v = x[i + k + len / 2] * wk;
+                x[i + k] = u + v;
+                x[i + k + len / 2] = u - v;
+            }
+        }
+    }
+}
+
+static void generate(double dbfs)
+{
+    const double amplitude = 32767.0 * pow(10.0, dbfs / 20.0);
+    for (unsigned int i = 0; i < N + WARMUP; i++)
+    {
+        input[i] = (int16_t)lrint(amplitude * sin(2.0 * M_PI * TONE_BIN * i / N + 0.3));
+    }
+}
+
+/*
+ * Measures n samples of a signed output at rate. The tone sits on an exact
+ * bin, so the sine is removed by clearing its bin, and DC with it.
+ */
+static result_t analyze(const int16_t *samples, unsigned int n, unsigned int rate)
+{
+    const double bin_hz = (double)rate / n;
+    double signal = 0;
+    double noise = 0;
+    double noise_6k = 0;
+
+    for (unsigned int i = 0; i < n; i++)
+    {
+        spectrum[i] = samples[i];
+    }
+    fft(spectrum, n);
+    for (unsigned int k = 1; k < n / 2; k++)
+    {
+        const double power = 2 * creal(spectrum[k] * conj(spectrum[k])) / ((double)n * n);
+        const double hz = k * bin_hz;
+        if (k == TONE_BIN)
+        {
+            signal = power;
+        }
+        else if (hz >= 20 && hz <= 20000)
+        {
+            noise += power;
+            noise_6k += (hz <= 6000) ? power : 0;
+        }
+    }
+    const double full_scale = 32768.0 * 32768.0 / 2;
+    return (result_t) {
+        .snr_db = 10 * log10(signal / noise),
+        .noise_db = 10 * log10(noise / full_scale),
+        .noise_6k_db = 10 * log10(noise_6k / full_scale),
+    };
+}
+
+/* the internal DAC only takes the upper byte */
+static result_t baseline(bool round)
+{
+    static int16_t quantized[N];
+    for (unsigned int i = 0; i < N; i++)
+    {
+        const int32_t s = input[WARMUP + i] + (round ? 128 : 0);
+        quantized[i] = (int16_t)(((s > INT16_MAX) ? INT16_MAX : s) & ~0xff);
+    }
+    return analyze(quantized, N, RATE);
+}
+
+static result_t shaped(void)
+{
+    bt_app_dac_output_set_format(1);
+#ifdef BT_APP_DAC_RESAMPLE
+    bt_app_dac_output_set_correction(0);
+    const size_t bytes = bt_app_dac_resample((const uint8_t *)input, sizeof(int16_t) * (N + WARMUP),
+                                             (uint8_t *)output);
+    CHECK(bytes >= sizeof(int16_t) * (N + WARMUP - 2) * BT_APP_DAC_RATE_FACTOR);
+#else
+    for (unsigned int i = 0; i < N + WARMUP; i++)
+    {
+        output[i] = bt_app_dac_requantize(input[i], 0);
+    }
+#endif
+    /* back from offset binary, checking that only the upper byte is used */
+    unsigned int low_bits = 0;
+    for (unsigned int i = 0; i < (N + WARMUP) * BT_APP_DAC_RATE_FACTOR; i++)
+    {
+        low_bits += (output[i] & 0xff) != 0;
+        output[i] = (int16_t)((uint16_t)output[i] - 0x8000U);
+    }
+    CHECK_EQ(low_bits, 0);
+    return analyze(output + WARMUP * BT_APP_DAC_RATE_FACTOR, N * BT_APP_DAC_RATE_FACTOR,
+                   RATE * BT_APP_DAC_RATE_FACTOR);
+}
+
+static void print_result(const char *name, result_t r)
+{
+    printf("  %-12s SNR %5.1f dB, noise %6.1f dB (20 kHz) %6.1f dB (6 kHz)\n",
+           name, r.snr_db, r.noise_db, r.noise_6k_db);
+}
+
+static void test_level(double dbfs)
+{
+    generate(dbfs);
+    const result_t trunc = baseline(false);
+    const result_t round = baseline(true);
+    const result_t shape = shaped();
+
+    printf("%.0f dBFS sine at %u Hz, %ux output:\n", dbfs, TONE_BIN * RATE / N, BT_APP_DAC_RATE_FACTOR);
+    print_result("truncated", trunc);
+    print_result("rounded", round);
+    print_result("shaped", shape);
+
+#ifdef CONFIG_EXAMPLE_A2DP_SINK_DAC_OVERSAMPLE_2X
+    /* zeros at DC and 14 kHz plus the doubled bandwidth, over the whole band */
+    CHECK(shape.noise_db < round.noise_db - 10);
+    CHECK(shape.snr_db > trunc.snr_db + 10);
+#else
+    /* the F-weighted filter moves the noise above 6 kHz, raising it in total */
+    CHECK(shape.noise_6k_db < round.noise_6k_db - 10);
+    CHECK(shape.noise_db > round.noise_db);
+#endif
+}
+
+static void bench(void)
+{
+    static int16_t in[BENCH_FRAMES * 2];
+    static int16_t out[BENCH_FRAMES * 2 * BT_APP_DAC_RATE_FACTOR + 4];
+    uint32_t best = UINT32_MAX;
+
+    for (unsigned int i = 0; i < BENCH_FRAMES * 2; i++)
+    {
+        in[i] = input[i % N];
+    }
+    bt_app_dac_output_set_format(2);
+    for (int run = 0; run < BENCH_RUNS; run++)
+    {
+        const uint32_t start = esp_cpu_get_cycle_count();
+#ifdef BT_APP_DAC_RESAMPLE
+        bt_app_dac_resample((const uint8_t *)in, sizeof(in), (uint8_t *)out);
+#else
+        for (unsigned int i = 0; i < BENCH_FRAMES * 2; i++)
+        {
+            out[i] = bt_app_dac_requantize(in[i], i & 1);
+        }
+#endif
+        const uint32_t cycles = esp_cpu_get_cycle_count() - start;
+        best = (cycles < best) ? cycles : best;
+    }
+    printf("output stage: %.1f host cycles per input sample (stereo, best of %u runs)\n",
+           (double)best / (BENCH_FRAMES * 2), BENCH_RUNS);
+}
+
+int main(void)
+{
+    esp_log_level_set("*", ESP_LOG_WARN);
+    test_level(-6);
+    test_level(-30);
+    bench();
+    return TEST_RESULT();
+}
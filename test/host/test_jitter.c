@@ -0,0 +1,204 @@
+/*
+ * Fill level accounting of the jitter buffer: pre-fill and the reserve
+ * for the output, watermark crossings, the adaptive pre-fill target,
+ * dropping on the high watermark and the fill level history. Runs with the watermarks of the pipeline
+ * configuration, 20 ms pre-fill and 5/50 ms watermarks at 44.1 kHz stereo.
+ */
+
+#include <stdint.h>
+#include "bt_app_jitter.h"
+#include "esp_log.h"
+#include "test.h"
+
+#define BYTES_PER_MS 176    /* 44.1 kHz stereo, as the jitter buffer counts */
+#define CAPACITY (100 * BYTES_PER_MS)
+
+/* consumes in 1 ms steps, checking after each like the I2S task */
+static unsigned int consume(size_t bytes, bt_app_jitter_event_t *last)
+{
+    unsigned int events = 0;
+    for (; bytes >= BYTES_PER_MS; bytes -= BYTES_PER_MS)
+    {
+        bt_app_jitter_consumed(BYTES_PER_MS);
+        const bt_app_jitter_event_t event = bt_app_jitter_check();
+        if (event != BT_APP_JITTER_OK)
+        {
+            *last = event;
+            events++;
+        }
+    }
+    return events;
+}
+
+static void test_prefill(void)
+{
+    bt_app_jitter_set_format(44100, 2, CAPACITY);
+    CHECK_EQ(bt_app_jitter_target(), 20 * BYTES_PER_MS);
+    bt_app_jitter_produced(19 * BYTES_PER_MS);
+    CHECK(!bt_app_jitter_prefilled());
+    bt_app_jitter_produced(BYTES_PER_MS);
+    CHECK(bt_app_jitter_prefilled());
+    CHECK_EQ(bt_app_jitter_fill(), 20 * BYTES_PER_MS);
+    CHECK_EQ(bt_app_jitter_target_delay(), 199);   /* 3520 bytes at 176400 bytes/s */
+}
+
+static void test_output_reserve(void)
+{
+    /* the pre-fill covers the 10 ms (1764 bytes) the output takes at start
+       on top of the target */
+    bt_app_jitter_set_output_latency(100);
+    bt_app_jitter_set_format(44100, 2, CAPACITY);
+    CHECK_EQ(bt_app_jitter_target(), 20 * BYTES_PER_MS);
+    bt_app_jitter_produced(bt_app_jitter_target() + 1763);
+    CHECK(!bt_app_jitter_prefilled());
+    bt_app_jitter_produced(1);
+    CHECK(bt_app_jitter_prefilled());
+
+    /* but never beyond the high watermark */
+    bt_app_jitter_set_output_latency(400);
+    bt_app_jitter_set_format(44100, 2, CAPACITY);
+    bt_app_jitter_produced(50 * BYTES_PER_MS);
+    CHECK(bt_app_jitter_prefilled());
+    bt_app_jitter_set_output_latency(0);
+}
+
+static void test_low_watermark(void)
+{
+    bt_app_jitter_event_t last = BT_APP_JITTER_OK;
+    bt_app_jitter_stats_t stats;
+
+    bt_app_jitter_set_format(44100, 2, CAPACITY);
+    bt_app_jitter_produced(20 * BYTES_PER_MS);
+
+    /* a single report when dropping below 5 ms, however long it stays there */
+    CHECK_EQ(consume(18 * BYTES_PER_MS, &last), 1);
+    CHECK_EQ(last, BT_APP_JITTER_LOW);
+    bt_app_jitter_get_stats(&stats, false);
+    CHECK_EQ(stats.low_count, 1);
+    CHECK_EQ(stats.min_fill_ms, 2);
+    CHECK_EQ(stats.max_fill_ms, 19);
+
+    /* the next buffering keeps a larger reserve */
+    CHECK_EQ(stats.prefill_ms, 25);
+    CHECK_EQ(bt_app_jitter_target(), 25 * BYTES_PER_MS);
+
+    /* back above and below again is a second crossing */
+    bt_app_jitter_produced(10 * BYTES_PER_MS);
+    CHECK_EQ(consume(BYTES_PER_MS, &last), 0);
+    CHECK_EQ(consume(8 * BYTES_PER_MS, &last), 1);
+    bt_app_jitter_get_stats(&stats, true);
+    CHECK_EQ(stats.low_count, 2);
+    CHECK_EQ(stats.prefill_ms, 30);
+
+    /* an underrun raises it as well, up to a quarter of the watermark span
+       below the high watermark; the reset kept the target */
+    bt_app_jitter_underrun();
+    bt_app_jitter_get_stats(&stats, false);
+    CHECK_EQ(stats.low_count, 0);
+    CHECK_EQ(stats.underrun_count, 1);
+    CHECK_EQ(stats.prefill_ms, 35);
+}
+
+static void test_adaptive_limit(void)
+{
+    bt_app_jitter_stats_t stats;
+
+    bt_app_jitter_set_format(44100, 2, CAPACITY);
+    for (int i = 0; i < 20; i++)
+    {
+        bt_app_jitter_underrun();
+    }
+    bt_app_jitter_get_stats(&stats, false);
+    CHECK_EQ(stats.underrun_count, 20);
+    CHECK_EQ(bt_app_jitter_target(), 50 * BYTES_PER_MS - 45 * BYTES_PER_MS / 4);
+
+    /* and is lowered one step per 10 s without a low watermark crossing */
+    bt_app_jitter_event_t last = BT_APP_JITTER_OK;
+    const size_t raised = bt_app_jitter_target();
+    bt_app_jitter_produced(30 * BYTES_PER_MS);
+    for (int ms = 0; ms < 10000; ms += 10)
+    {
+        bt_app_jitter_produced(10 * BYTES_PER_MS);
+        consume(10 * BYTES_PER_MS, &last);
+    }
+    CHECK_EQ(bt_app_jitter_target(), raised - 5 * BYTES_PER_MS);
+
+    /* down to less than a step above the configured pre-fill */
+    for (int ms = 0; ms < 100000; ms += 10)
+    {
+        bt_app_jitter_produced(10 * BYTES_PER_MS);
+        consume(10 * BYTES_PER_MS, &last);
+    }
+    CHECK(bt_app_jitter_target() >= 20 * BYTES_PER_MS && bt_app_jitter_target() < 25 * BYTES_PER_MS);
+    CHECK_EQ(last, BT_APP_JITTER_OK);
+}
+
+static void test_high_watermark(void)
+{
+    bt_app_jitter_event_t last = BT_APP_JITTER_OK;
+    bt_app_jitter_stats_t stats;
+
+    /* the capacity caps the high watermark */
+    bt_app_jitter_set_format(44100, 2, 30 * BYTES_PER_MS);
+    bt_app_jitter_produced(31 * BYTES_PER_MS);
+    CHECK_EQ(consume(0, &last), 0);
+    CHECK_EQ(bt_app_jitter_check(), BT_APP_JITTER_HIGH);
+    CHECK_EQ(bt_app_jitter_check(), BT_APP_JITTER_OK);
+
+    /* the consumer drops the excess over the pre-fill target */
+    const size_t excess = bt_app_jitter_excess();
+    CHECK_EQ(excess, 31 * BYTES_PER_MS - bt_app_jitter_target());
+    bt_app_jitter_consumed(excess);
+    bt_app_jitter_dropped(excess);
+    CHECK_EQ(bt_app_jitter_check(), BT_APP_JITTER_OK);
+    CHECK_EQ(bt_app_jitter_fill(), bt_app_jitter_target());
+    bt_app_jitter_get_stats(&stats, false);
+    CHECK_EQ(stats.high_count, 1);
+    CHECK_EQ(stats.dropped_bytes, excess);
+
+    /* data discarded before the consumer leaves the fill level */
+    bt_app_jitter_discarded(BYTES_PER_MS);
+    CHECK_EQ(bt_app_jitter_fill(), bt_app_jitter_target() - BYTES_PER_MS);
+}
+
+static void test_history(void)
+{
+    bt_app_jitter_event_t last = BT_APP_JITTER_OK;
+    uint16_t history[BT_APP_JITTER_HISTORY_LEN];
+
+    bt_app_jitter_set_format(44100, 2, CAPACITY);
+    CHECK_EQ(bt_app_jitter_get_history(history, BT_APP_JITTER_HISTORY_LEN), 0);
+
+    /* a sample per 100 ms played, the fill level rising by 1 ms per period */
+    bt_app_jitter_produced(20 * BYTES_PER_MS);
+    for (int i = 0; i < BT_APP_JITTER_HISTORY_LEN + 6; i++)
+    {
+        bt_app_jitter_produced(101 * BYTES_PER_MS);
+        consume(100 * BYTES_PER_MS, &last);
+    }
+    CHECK_EQ(bt_app_jitter_get_history(history, BT_APP_JITTER_HISTORY_LEN), BT_APP_JITTER_HISTORY_LEN);
+    CHECK_EQ(history[0], 27);
+    CHECK_EQ(history[BT_APP_JITTER_HISTORY_LEN - 1], 90);
+    CHECK_EQ(bt_app_jitter_get_history(history, 4), 4);
+    CHECK_EQ(history[0], 87);
+
+    /* the average settles on a steady level */
+    for (int ms = 0; ms < 1000; ms++)
+    {
+        bt_app_jitter_produced(BYTES_PER_MS);
+        consume(BYTES_PER_MS, &last);
+    }
+    CHECK(bt_app_jitter_avg_delay() >= 895 && bt_app_jitter_avg_delay() <= 905);
+}
+
+int main(void)
+{
+    esp_log_level_set("*", ESP_LOG_WARN);
+    test_prefill();
+    test_output_reserve();
+    test_low_watermark();
+    test_adaptive_limit();
+    test_high_watermark();
+    test_history();
+    return TEST_RESULT();
+}
@@ -0,0 +1,305 @@
+/*
+ * Block ring: the span and wrap-around arithmetic on one task, then a
+ * producer and a consumer task moving numbered blocks through rings of
+ * several sizes, with random span lengths, partial commits and releases,
+ * and yields in between to shake up the interleaving. Every block carries
+ * its sequence number in each word, so that lost, repeated, reordered or
+ * torn blocks are caught. Staged rings get a processing task in between,
+ * which marks each block in place; the consumer must only see marked ones.
+ */
+
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bt_app_ringbuf.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos_host.h"
+#include "test.h"
+
+#define BLOCK_SIZE 48
+#define STRESS_BLOCKS 200000
+#define PROCESSED 0x80000000u
+
+typedef struct {
+    bt_app_ringbuf_handle_t rb;
+    uint32_t blocks;
+    unsigned int seed;
+    uint32_t errors;
+    uint32_t spans;
+    bool staged;
+    TaskHandle_t done;
+} stress_t;
+
+static void test_single_task(void)
+{
+    uint32_t count = 0;
+    bt_app_ringbuf_handle_t rb = bt_app_ringbuf_create(30, 3);
+
+    CHECK(rb != NULL);
+    CHECK_EQ(bt_app_ringbuf_block_size(rb), 32);        /* word aligned */
+    CHECK_EQ(bt_app_ringbuf_level(rb), 0);
+    CHECK(bt_app_ringbuf_read_acquire(rb, &count, 0) == NULL);
+
+    /* a full ring is not mistaken for an empty one with an odd block count */
+    uint8_t *first = bt_app_ringbuf_write_acquire(rb, &count, 0);
+    CHECK_EQ(count, 3);
+    bt_app_ringbuf_write_commit(rb, 3);
+    CHECK_EQ(bt_app_ringbuf_level(rb), 3);
+    CHECK(bt_app_ringbuf_write_acquire(rb, &count, 0) == NULL);
+
+    /* a timeout returns after the ticks given */
+    const int64_t start = host_time_us();
+    CHECK(bt_app_ringbuf_write_acquire(rb, &count, 2) == NULL);
+    const int64_t waited = host_time_us() - start;
+    CHECK(waited >= 1000 * portTICK_PERIOD_MS && waited < 4000 * portTICK_PERIOD_MS);
+
+    /* spans end at the end of the storage */
+    CHECK(bt_app_ringbuf_read_acquire(rb, &count, 0) == first);
+    CHECK_EQ(count, 3);
+    bt_app_ringbuf_read_release(rb, 2);
+    CHECK(bt_app_ringbuf_write_acquire(rb, &count, 0) == first);
+    CHECK_EQ(count, 2);
+    bt_app_ringbuf_write_commit(rb, 1);
+    CHECK(bt_app_ringbuf_read_acquire(rb, &count, 0) == first + 2 * 32);
+    CHECK_EQ(count, 1);
+    bt_app_ringbuf_read_release(rb, 1);
+    CHECK(bt_app_ringbuf_read_acquire(rb, &count, 0) == first);
+    CHECK_EQ(count, 1);
+
+    /* positions wrap at twice the block count, run them around a few times */
+    for (int i = 0; i < 20; i++)
+    {
+        bt_app_ringbuf_read_release(rb, count);
+        CHECK(bt_app_ringbuf_write_acquire(rb, &count, 0) != NULL);
+        bt_app_ringbuf_write_commit(rb, 1);
+        CHECK_EQ(bt_app_ringbuf_level(rb), 1);
+        CHECK(bt_app_ringbuf_read_acquire(rb, &count, 0) != NULL);
+        CHECK_EQ(count, 1);
+    }
+
+    bt_app_ringbuf_write_acquire(rb, &count, 0);
+    bt_app_ringbuf_write_commit(rb, 1);
+    bt_app_ringbuf_reset(rb);
+    CHECK_EQ(bt_app_ringbuf_level(rb), 0);
+    bt_app_ringbuf_delete(rb);
+}
+
+static void test_staged_single_task(void)
+{
+    uint32_t count = 0;
+    bt_app_ringbuf_handle_t rb = bt_app_ringbuf_create_staged(32, 4);
+
+    CHECK(rb != NULL);
+    CHECK_EQ(bt_app_ringbuf_block_cnt(rb), 4);
+    CHECK(bt_app_ringbuf_process_acquire(rb, &count, 0) == NULL);
+
+    /* written blocks count as filled, but only reach the consumer once processed */
+    uint8_t *first = bt_app_ringbuf_write_acquire(rb, &count, 0);
+    bt_app_ringbuf_write_commit(rb, 3);
+    CHECK_EQ(bt_app_ringbuf_level(rb), 3);
+    CHECK(bt_app_ringbuf_read_acquire(rb, &count, 0) == NULL);
+    CHECK(bt_app_ringbuf_process_acquire(rb, &count, 0) == first);
+    CHECK_EQ(count, 3);
+    bt_app_ringbuf_process_commit(rb, 2);
+    CHECK(bt_app_ringbuf_read_acquire(rb, &count, 0) == first);
+    CHECK_EQ(count, 2);
+
+    /* room is only made by the consumer */
+    CHECK(bt_app_ringbuf_write_acquire(rb, &count, 0) == first + 3 * 32);
+    CHECK_EQ(count, 1);
+    bt_app_ringbuf_write_commit(rb, 1);
+    CHECK(bt_app_ringbuf_write_acquire(rb, &count, 0) == NULL);
+    bt_app_ringbuf_read_release(rb, 2);
+    CHECK(bt_app_ringbuf_process_acquire(rb, &count, 0) == first + 2 * 32);
+    CHECK_EQ(count, 2);
+    bt_app_ringbuf_process_commit(rb, 2);
+    CHECK(bt_app_ringbuf_read_acquire(rb, &count, 0) == first + 2 * 32);
+    CHECK_EQ(count, 2);
+
+    /* a reset also drops the blocks not processed yet */
+    bt_app_ringbuf_read_release(rb, 2);
+    bt_app_ringbuf_write_acquire(rb, &count, 0);
+    bt_app_ringbuf_write_commit(rb, 1);
+    bt_app_ringbuf_reset(rb);
+    CHECK_EQ(bt_app_ringbuf_level(rb), 0);
+    CHECK(bt_app_ringbuf_process_acquire(rb, &count, 0) == NULL);
+    bt_app_ringbuf_delete(rb);
+}
+
+static void fill_block(uint8_t *block, uint32_t seq)
+{
+    for (size_t i = 0; i < BLOCK_SIZE; i += sizeof(seq))
+    {
+        memcpy(block + i, &seq, sizeof(seq));
+    }
+}
+
+static bool check_block(const uint8_t *block, uint32_t seq)
+{
+    for (size_t i = 0; i < BLOCK_SIZE; i += sizeof(seq))
+    {
+        if (memcmp(block + i, &seq, sizeof(seq)) != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void producer_task(void *arg)
+{
+    stress_t *s = arg;
+    uint32_t seq = 0;
+
+    while (seq < s->blocks)
+    {
+        uint32_t count = 0;
+        /* mostly blocking, now and then a poll that may come back empty */
+        uint8_t *span = bt_app_ringbuf_write_acquire(s->rb, &count, (rand_r(&s->seed) % 8) ? portMAX_DELAY : 0);
+        if (span == NULL)
+        {
+            continue;
+        }
+        uint32_t n = 1 + rand_r(&s->seed) % count;
+        n = (n < s->blocks - seq) ? n : s->blocks - seq;
+        for (uint32_t i = 0; i < n; i++)
+        {
+            fill_block(span + i * BLOCK_SIZE, seq++);
+        }
+        bt_app_ringbuf_write_commit(s->rb, n);
+        if (rand_r(&s->seed) % 4 == 0)
+        {
+            sched_yield();
+        }
+    }
+    xTaskNotifyGive(s->done);
+    vTaskDelete(NULL);
+}
+
+static void stage_task(void *arg)
+{
+    stress_t *s = arg;
+    uint32_t seq = 0;
+
+    while (seq < s->blocks)
+    {
+        uint32_t count = 0;
+        uint8_t *span = bt_app_ringbuf_process_acquire(s->rb, &count, (rand_r(&s->seed) % 8) ? portMAX_DELAY : 0);
+        if (span == NULL)
+        {
+            continue;
+        }
+        const uint32_t n = 1 + rand_r(&s->seed) % count;
+        for (uint32_t i = 0; i < n; i++)
+        {
+            if (!check_block(span + i * BLOCK_SIZE, seq))
+            {
+                s->errors++;
+            }
+            fill_block(span + i * BLOCK_SIZE, PROCESSED | seq++);
+        }
+        bt_app_ringbuf_process_commit(s->rb, n);
+        if (rand_r(&s->seed) % 4 == 0)
+        {
+            sched_yield();
+        }
+    }
+    xTaskNotifyGive(s->done);
+    vTaskDelete(NULL);
+}
+
+static void consumer_task(void *arg)
+{
+    stress_t *s = arg;
+    const uint32_t mark = s->staged ? PROCESSED : 0;
+    uint32_t seq = 0;
+
+    while (seq < s->blocks)
+    {
+        uint32_t count = 0;
+        const uint8_t *span = bt_app_ringbuf_read_acquire(s->rb, &count, (rand_r(&s->seed) % 8) ? portMAX_DELAY : 0);
+        if (span == NULL)
+        {
+            continue;
+        }
+        const uint32_t n = 1 + rand_r(&s->seed) % count;
+        for (uint32_t i = 0; i < n; i++)
+        {
+            if (!check_block(span + i * BLOCK_SIZE, mark | seq))
+            {
+                s->errors++;
+            }
+            seq++;
+        }
+        s->spans++;
+        bt_app_ringbuf_read_release(s->rb, n);
+        if (rand_r(&s->seed) % 4 == 0)
+        {
+            sched_yield();
+        }
+    }
+    xTaskNotifyGive(s->done);
+    vTaskDelete(NULL);
+}
+
+static void test_stress(uint32_t block_cnt, bool staged)
+{
+    stress_t producer = {.blocks = STRESS_BLOCKS, .seed = block_cnt, .staged = staged,
+                         .done = xTaskGetCurrentTaskHandle()};
+    stress_t stage = producer;
+    stress_t consumer = producer;
+    const uint32_t tasks = staged ? 3 : 2;
+
+    producer.rb = stage.rb = consumer.rb = staged ? bt_app_ringbuf_create_staged(BLOCK_SIZE, block_cnt) :
+                                                    bt_app_ringbuf_create(BLOCK_SIZE, block_cnt);
+    stage.seed = block_cnt * 7919;
+    consumer.seed = ~block_cnt;
+
+    const int64_t start = host_time_us();
+    xTaskCreate(producer_task, "producer", 4096, &producer, 5, NULL);
+    if (staged)
+    {
+        xTaskCreate(stage_task, "stage", 4096, &stage, 5, NULL);
+    }
+    xTaskCreate(consumer_task, "consumer", 4096, &consumer, 5, NULL);
+    uint32_t finished = 0;
+    while (finished < tasks)
+    {
+        /* a lost wake-up would hang the tasks */
+        const uint32_t n = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(20000));
+        CHECK(n > 0);
+        if (n == 0)
+        {
+            break;
+        }
+        finished += n;
+    }
+    const int64_t us = host_time_us() - start;
+
+    CHECK_EQ(stage.errors, 0);
+    CHECK_EQ(consumer.errors, 0);
+    CHECK_EQ(bt_app_ringbuf_level(consumer.rb), 0);
+    printf("%2u blocks%s: %u blocks in %u spans, %.0f ns per block\n", block_cnt, staged ? ", staged" : "",
+           STRESS_BLOCKS, consumer.spans, us * 1000.0 / STRESS_BLOCKS);
+    if (finished == tasks)
+    {
+        bt_app_ringbuf_delete(consumer.rb);
+    }
+}
+
+int main(void)
+{
+    test_single_task();
+    test_staged_single_task();
+    test_stress(1, false);
+    test_stress(2, false);
+    test_stress(3, false);
+    test_stress(7, false);
+    test_stress(24, false);
+    test_stress(1, true);
+    test_stress(3, true);
+    test_stress(13, true);
+    return TEST_RESULT();
+}
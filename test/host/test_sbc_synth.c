@@ -0,0 +1,335 @@
+/*
+ * SBC synthesis filterbank against the specification.
+ *
+ * The reference follows section 12.6.4 step by step: the full matrix of 2M
+ * rows, a shift register of 20M values and the U and W vectors. It is run
+ * once in the fixed point of bt_app_sbc_synth.c, whose output must be
+ * bit-exact, and once in double precision, from which it must be less than
+ * a step away. Subband samples are random over their full
+ * range, 18 bits with the fraction, so that the output saturates as well.
+ *
+ * The prototype filters are checked by the analysis filterbank of the
+ * encoder (section 12.5.2.1) followed by the synthesis, which must give the
+ * input back, delayed by 9M + 1 samples, within the near perfect
+ * reconstruction of the filterbank.
+ *
+ * Finally the host cycles per frame are taken from the cycle counter for
+ * each number of subbands and blocks, in stereo. The bitpool only changes
+ * the unpacking and dequantization of the subband samples, not their
+ * synthesis.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bt_app_sbc_synth.h"
+#include "esp_cpu.h"
+#include "test.h"
+
+#define SB_ONE (1 << BT_APP_SBC_SB_FRAC_BITS)
+#define SB_MAX ((1 << 18) - 1)
+#define RANDOM_BLOCKS 4000
+#define TONE_SAMPLES 16384
+#define BENCH_FRAMES 256
+#define BENCH_RUNS 50
+
+/* tables 12.23 and 12.24 */
+static const double proto4[40] = {
+    0.00000000E+00, 5.36548976E-04, 1.49188357E-03, 2.73370904E-03,
+    3.83720193E-03, 3.89205149E-03, 1.86581691E-03, -3.06012286E-03,
+    1.09137620E-02, 2.04385087E-02, 2.88757392E-02, 3.21939290E-02,
+    2.58767811E-02, 6.13245186E-03, -2.88217274E-02, -7.76463494E-02,
+    1.35593274E-01, 1.94987841E-01, 2.46636662E-01, 2.81828203E-01,
+    2.94315332E-01, 2.81828203E-01, 2.46636662E-01, 1.94987841E-01,
+    -1.35593274E-01, -7.76463494E-02, -2.88217274E-02, 6.13245186E-03,
+    2.58767811E-02, 3.21939290E-02, 2.88757392E-02, 2.04385087E-02,
+    -1.09137620E-02, -3.06012286E-03, 1.86581691E-03, 3.89205149E-03,
+    3.83720193E-03, 2.73370904E-03, 1.49188357E-03, 5.36548976E-04
+};
+
+static const double proto8[80] = {
+    0.00000000E+00, 1.56575398E-04, 3.43256425E-04, 5.54620202E-04,
+    8.23919506E-04, 1.13992507E-03, 1.47640169E-03, 1.78371725E-03,
+    2.01182542E-03, 2.10371989E-03, 1.99454554E-03, 1.61656283E-03,
+    9.02154502E-04, -1.78805361E-04, -1.64973098E-03, -3.49717454E-03,
+    5.65949473E-03, 8.02941163E-03, 1.04584443E-02, 1.27472335E-02,
+    1.46525263E-02, 1.59045603E-02, 1.62208471E-02, 1.53184106E-02,
+    1.29371806E-02, 8.85757540E-03, 2.92408442E-03, -4.91578024E-03,
+    -1.46404076E-02, -2.61098752E-02, -3.90751381E-02, -5.31873032E-02,
+    6.79989431E-02, 8.29847578E-02, 9.75753918E-02, 1.11196689E-01,
+    1.23264548E-01, 1.33264415E-01, 1.40753505E-01, 1.45389847E-01,
+    1.46955068E-01, 1.45389847E-01, 1.40753505E-01, 1.33264415E-01,
+    1.23264548E-01, 1.11196689E-01, 9.75753918E-02, 8.29847578E-02,
+    -6.79989431E-02, -5.31873032E-02, -3.90751381E-02, -2.61098752E-02,
+    -1.46404076E-02, -4.91578024E-03, 2.92408442E-03, 8.85757540E-03,
+    1.29371806E-02, 1.53184106E-02, 1.62208471E-02, 1.59045603E-02,
+    1.46525263E-02, 1.27472335E-02, 1.04584443E-02, 8.02941163E-03,
+    -5.65949473E-03, -3.49717454E-03, -1.64973098E-03, -1.78805361E-04,
+    9.02154502E-04, 1.61656283E-03, 1.99454554E-03, 2.10371989E-03,
+    2.01182542E-03, 1.78371725E-03, 1.47640169E-03, 1.13992507E-03,
+    8.23919506E-04, 5.54620202E-04, 3.43256425E-04, 1.56575398E-04
+};
+
+typedef struct {
+    unsigned int m;
+    int32_t matrix[2 * BT_APP_SBC_MAX_SUBBANDS][BT_APP_SBC_MAX_SUBBANDS];   /* Q30 */
+    int32_t window[10 * BT_APP_SBC_MAX_SUBBANDS];                           /* Q30 */
+    int32_t v[20 * BT_APP_SBC_MAX_SUBBANDS];
+    double v_double[20 * BT_APP_SBC_MAX_SUBBANDS];
+} reference_t;
+
+static int32_t sb_samples[RANDOM_BLOCKS * BT_APP_SBC_MAX_SUBBANDS];
+static uint32_t seed = 1;
+
+
+static int32_t random_sb(void)
+{
+    seed = seed * 1664525 + 1013904223;
+    return (int32_t)(seed % (2 * SB_MAX + 1)) - SB_MAX;
+}
+
+static const double *proto(unsigned int m)
+{
+    return (m == 8) ? proto8 : proto4;
+}
+
+static double matrix_coef(unsigned int m, unsigned int k, unsigned int i)
+{
+    return cos((i + 0.5) * (k + m / 2.0) * M_PI / m);
+}
+
+static void reference_init(reference_t *ref, unsigned int m)
+{
+    memset(ref, 0, sizeof(*ref));
+    ref->m = m;
+    for (unsigned int k = 0; k < 2 * m; k++)
+    {
+        for (unsigned int i = 0; i < m; i++)
+        {
+            ref->matrix[k][i] = (int32_t)lround(matrix_coef(m, k, i) * (1 << 30));
+        }
+    }
+    for (unsigned int i = 0; i < 10 * m; i++)
+    {
+        ref->window[i] = (int32_t)lround(-(int)m * proto(m)[i] * (1 << 30));
+    }
+}
+
+static int16_t saturate(int64_t sample)
+{
+    return (sample > INT16_MAX) ? INT16_MAX : (sample < INT16_MIN) ? INT16_MIN : (int16_t)sample;
+}
+
+/* one block, in fixed point into pcm and in double precision into out */
+static void reference_block(reference_t *ref, const int32_t *sb, int16_t *pcm, double *out)
+{
+    const unsigned int m = ref->m;
+    int32_t u[10 * BT_APP_SBC_MAX_SUBBANDS];
+    double u_double[10 * BT_APP_SBC_MAX_SUBBANDS];
+
+    memmove(ref->v + 2 * m, ref->v, 18 * m * sizeof(ref->v[0]));
+    memmove(ref->v_double + 2 * m, ref->v_double, 18 * m * sizeof(ref->v_double[0]));
+    for (unsigned int k = 0; k < 2 * m; k++)
+    {
+        int64_t acc = 0;
+        double sum = 0;
+        for (unsigned int i = 0; i < m; i++)
+        {
+            acc += (int64_t)ref->matrix[k][i] * sb[i];
+            sum += matrix_coef(m, k, i) * sb[i] / SB_ONE;
+        }
+        ref->v[k] = (int32_t)((acc + (INT64_C(1) << 29) - (acc < 0)) >> 30);
+        ref->v_double[k] = sum;
+    }
+    for (unsigned int i = 0; i < 5; i++)
+    {
+        for (unsigned int j = 0; j < m; j++)
+        {
+            u[i * 2 * m + j] = ref->v[i * 4 * m + j];
+            u[i * 2 * m + m + j] = ref->v[i * 4 * m + 3 * m + j];
+            u_double[i * 2 * m + j] = ref->v_double[i * 4 * m + j];
+            u_double[i * 2 * m + m + j] = ref->v_double[i * 4 * m + 3 * m + j];
+        }
+    }
+    for (unsigned int j = 0; j < m; j++)
+    {
+        int64_t acc = 0;
+        double sum = 0;
+        for (unsigned int i = 0; i < 10; i++)
+        {
+            acc += (int64_t)u[j + m * i] * ref->window[j + m * i];
+            sum += u_double[j + m * i] * -(double)m * proto(m)[j + m * i];
+        }
+        pcm[j] = saturate((acc + (INT64_C(1) << 31)) >> 32);
+        out[j] = (sum > INT16_MAX) ? INT16_MAX : (sum < INT16_MIN) ? INT16_MIN : sum;
+    }
+}
+
+static void test_reference(unsigned int m)
+{
+    static reference_t ref;
+    bt_app_sbc_synth_t synth;
+    unsigned int mismatches = 0;
+    double max_error = 0;
+
+    reference_init(&ref, m);
+    CHECK(bt_app_sbc_synth_init(&synth, m));
+    for (unsigned int i = 0; i < RANDOM_BLOCKS * m; i++)
+    {
+        sb_samples[i] = random_sb();
+    }
+    for (unsigned int b = 0; b < RANDOM_BLOCKS; b++)
+    {
+        int16_t expected[BT_APP_SBC_MAX_SUBBANDS];
+        int16_t pcm[BT_APP_SBC_MAX_SUBBANDS];
+        double exact[BT_APP_SBC_MAX_SUBBANDS];
+        reference_block(&ref, sb_samples + b * m, expected, exact);
+        bt_app_sbc_synth_block(&synth, sb_samples + b * m, pcm, 1);
+        for (unsigned int j = 0; j < m; j++)
+        {
+            mismatches += (pcm[j] != expected[j]);
+            max_error = fmax(max_error, fabs(pcm[j] - exact[j]));
+        }
+    }
+    printf("%u subbands: %u of %u samples differ from the fixed-point reference, "
+           "at most %.2f from the exact one\n", m, mismatches, RANDOM_BLOCKS * m, max_error);
+    CHECK_EQ(mismatches, 0);
+    CHECK(max_error < 1.0);
+}
+
+/* analysis filterbank of the encoder in double precision, one block */
+static void analyze(unsigned int m, double *x, const int16_t *in, int32_t *sb)
+{
+    double y[2 * BT_APP_SBC_MAX_SUBBANDS] = {0};
+
+    memmove(x + m, x, 9 * m * sizeof(x[0]));
+    for (unsigned int i = 0; i < m; i++)
+    {
+        x[m - 1 - i] = in[i];
+    }
+    for (unsigned int i = 0; i < 10 * m; i++)
+    {
+        y[i % (2 * m)] += proto(m)[i] * x[i];
+    }
+    for (unsigned int i = 0; i < m; i++)
+    {
+        double s = 0;
+        for (unsigned int k = 0; k < 2 * m; k++)
+        {
+            s += cos((i + 0.5) * (k - m / 2.0) * M_PI / m) * y[k];
+        }
+        sb[i] = (int32_t)lround(s * SB_ONE);
+    }
+}
+
+static void test_reconstruction(unsigned int m)
+{
+    static int16_t in[TONE_SAMPLES];
+    static int16_t out[TONE_SAMPLES];
+    double x[10 * BT_APP_SBC_MAX_SUBBANDS] = {0};
+    bt_app_sbc_synth_t synth;
+
+    /* 997 Hz and 6 kHz at 44.1 kHz, -6 dBFS in all */
+    for (unsigned int n = 0; n < TONE_SAMPLES; n++)
+    {
+        in[n] = (int16_t)lround(10922 * sin(2 * M_PI * 997 / 44100 * n) + 5461 * sin(2 * M_PI * 6000 / 44100 * n));
+    }
+    bt_app_sbc_synth_init(&synth, m);
+    for (unsigned int n = 0; n < TONE_SAMPLES; n += m)
+    {
+        int32_t sb[BT_APP_SBC_MAX_SUBBANDS];
+        analyze(m, x, in + n, sb);
+        bt_app_sbc_synth_block(&synth, sb, out + n, 1);
+    }
+
+    const unsigned int delay = 9 * m + 1;
+    double signal = 0;
+    double noise = 0;
+    for (unsigned int n = 1024; n < TONE_SAMPLES; n++)
+    {
+        signal += (double)in[n - delay] * in[n - delay];
+        noise += ((double)out[n] - in[n - delay]) * ((double)out[n] - in[n - delay]);
+    }
+    const double snr_db = 10 * log10(signal / noise);
+    printf("%u subbands: analysis and synthesis give the input back delayed by %u samples, SNR %.1f dB\n",
+           m, delay, snr_db);
+    CHECK(snr_db > 60);
+}
+
+static void bench(unsigned int m, unsigned int blocks)
+{
+    static reference_t ref[2];
+    static int16_t pcm[BENCH_FRAMES * 16 * BT_APP_SBC_MAX_SUBBANDS * 2];
+    bt_app_sbc_synth_t synth[2];
+    uint32_t best = UINT32_MAX;
+    uint32_t best_ref = UINT32_MAX;
+
+    for (unsigned int i = 0; i < blocks * 2 * m; i++)
+    {
+        sb_samples[i] = random_sb() / 4;
+    }
+    for (unsigned int ch = 0; ch < 2; ch++)
+    {
+        bt_app_sbc_synth_init(&synth[ch], m);
+        reference_init(&ref[ch], m);
+    }
+    for (int run = 0; run < BENCH_RUNS; run++)
+    {
+        uint32_t start = esp_cpu_get_cycle_count();
+        for (unsigned int f = 0; f < BENCH_FRAMES; f++)
+        {
+            int16_t *frame = pcm + f * blocks * m * 2;
+            for (unsigned int b = 0; b < blocks; b++)
+            {
+                for (unsigned int ch = 0; ch < 2; ch++)
+                {
+                    bt_app_sbc_synth_block(&synth[ch], sb_samples + (b * 2 + ch) * m, frame + b * m * 2 + ch, 2);
+                }
+            }
+        }
+        uint32_t cycles = esp_cpu_get_cycle_count() - start;
+        best = (cycles < best) ? cycles : best;
+
+        /* the fixed-point half of the reference only matters here */
+        start = esp_cpu_get_cycle_count();
+        for (unsigned int f = 0; f < BENCH_FRAMES / 16; f++)
+        {
+            for (unsigned int b = 0; b < blocks; b++)
+            {
+                for (unsigned int ch = 0; ch < 2; ch++)
+                {
+                    int16_t out[BT_APP_SBC_MAX_SUBBANDS];
+                    double exact[BT_APP_SBC_MAX_SUBBANDS];
+                    reference_block(&ref[ch], sb_samples + (b * 2 + ch) * m, out, exact);
+                }
+            }
+        }
+        cycles = (esp_cpu_get_cycle_count() - start) * 16;
+        best_ref = (cycles < best_ref) ? cycles : best_ref;
+    }
+    printf("  %u subbands, %2u blocks: %6.0f host cycles per stereo frame, %5.1f per sample (reference %.0f)\n",
+           m, blocks, (double)best / BENCH_FRAMES, (double)best / (BENCH_FRAMES * blocks * m * 2),
+           (double)best_ref / BENCH_FRAMES);
+}
+
+int main(void)
+{
+    bt_app_sbc_synth_t synth;
+
+    CHECK(!bt_app_sbc_synth_init(&synth, 6));
+    test_reference(4);
+    test_reference(8);
+    test_reconstruction(4);
+    test_reconstruction(8);
+
+    printf("synthesis, best of %u runs of %u frames:\n", BENCH_RUNS, BENCH_FRAMES);
+    for (unsigned int m = 4; m <= 8; m += 4)
+    {
+        for (unsigned int blocks = 4; blocks <= 16; blocks += 4)
+        {
+            bench(m, blocks);
+        }
+    }
+    return TEST_RESULT();
+}
@@ -0,0 +1,130 @@
+/*
+ * Event log of the overrun and underrun counters: order, filtering and the
+ * full log on one task, then two writer tasks recording one event type each
+ * while the main task drains. Every event must either be drained, in the
+ * order of its writer, or be counted as lost.
+ */
+
+#include <sched.h>
+#include <stdint.h>
+#include "bt_app_xrun.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "test.h"
+
+#define STRESS_EVENTS 200000
+
+typedef struct {
+    bt_app_xrun_event_t event;
+    TaskHandle_t done;
+} writer_t;
+
+static bt_app_xrun_entry_t entries[BT_APP_XRUN_LOG_LEN];
+
+
+static void test_single_task(void)
+{
+    uint32_t lost = 1;
+
+    CHECK_EQ(bt_app_xrun_drain(entries, BT_APP_XRUN_LOG_LEN, &lost), 0);
+    CHECK_EQ(lost, 0);
+
+    /* DMA buffers sent are only counted, underruns only while active */
+    bt_app_xrun_record(BT_APP_XRUN_RING_FULL);
+    bt_app_xrun_record(BT_APP_XRUN_DMA_SENT);
+    bt_app_xrun_record(BT_APP_XRUN_DMA_UNDERRUN);
+    bt_app_xrun_set_active(true);
+    bt_app_xrun_record(BT_APP_XRUN_DMA_UNDERRUN);
+    bt_app_xrun_record(BT_APP_XRUN_RING_EMPTY);
+    bt_app_xrun_set_active(false);
+
+    /* a short read leaves the rest for the next */
+    CHECK_EQ(bt_app_xrun_drain(entries, 2, &lost), 2);
+    CHECK_EQ(entries[0].event, BT_APP_XRUN_RING_FULL);
+    CHECK_EQ(entries[1].event, BT_APP_XRUN_DMA_UNDERRUN);
+    CHECK(entries[1].ms >= entries[0].ms);
+    CHECK_EQ(bt_app_xrun_drain(entries, BT_APP_XRUN_LOG_LEN, &lost), 1);
+    CHECK_EQ(entries[0].event, BT_APP_XRUN_RING_EMPTY);
+    CHECK_EQ(lost, 0);
+
+    /* a full log drops the newest events */
+    for (int i = 0; i < BT_APP_XRUN_LOG_LEN + 5; i++)
+    {
+        bt_app_xrun_record((i < BT_APP_XRUN_LOG_LEN) ? BT_APP_XRUN_RING_FULL : BT_APP_XRUN_RING_EMPTY);
+    }
+    CHECK_EQ(bt_app_xrun_drain(entries, BT_APP_XRUN_LOG_LEN, &lost), BT_APP_XRUN_LOG_LEN);
+    CHECK_EQ(lost, 5);
+    CHECK_EQ(entries[BT_APP_XRUN_LOG_LEN - 1].event, BT_APP_XRUN_RING_FULL);
+    CHECK_EQ(bt_app_xrun_drain(entries, BT_APP_XRUN_LOG_LEN, &lost), 0);
+    CHECK_EQ(lost, 0);
+}
+
+static void writer_task(void *arg)
+{
+    writer_t *writer = arg;
+
+    for (int i = 0; i < STRESS_EVENTS; i++)
+    {
+        bt_app_xrun_record(writer->event);
+        if (i % 64 == 0)
+        {
+            sched_yield();
+        }
+    }
+    xTaskNotifyGive(writer->done);
+    vTaskDelete(NULL);
+}
+
+static void test_stress(void)
+{
+    writer_t full = {.event = BT_APP_XRUN_RING_FULL, .done = xTaskGetCurrentTaskHandle()};
+    writer_t empty = {.event = BT_APP_XRUN_RING_EMPTY, .done = xTaskGetCurrentTaskHandle()};
+    bt_app_xrun_counter_t before[BT_APP_XRUN_NUM];
+    bt_app_xrun_counter_t after[BT_APP_XRUN_NUM];
+    uint32_t drained[BT_APP_XRUN_NUM] = {0};
+    uint32_t last_ms[BT_APP_XRUN_NUM] = {0};
+    uint32_t lost_total = 0;
+    uint32_t out_of_order = 0;
+    uint32_t finished = 0;
+
+    bt_app_xrun_get(before);
+    xTaskCreate(writer_task, "full", 4096, &full, 5, NULL);
+    xTaskCreate(writer_task, "empty", 4096, &empty, 5, NULL);
+    for (bool last = false; !last;)
+    {
+        /* one more pass after both finished picks up the rest */
+        last = (finished == 2);
+        finished += ulTaskNotifyTake(pdTRUE, 0);
+
+        uint32_t lost = 0;
+        const size_t count = bt_app_xrun_drain(entries, BT_APP_XRUN_LOG_LEN, &lost);
+        lost_total += lost;
+        for (size_t i = 0; i < count; i++)
+        {
+            const bt_app_xrun_event_t event = entries[i].event;
+            out_of_order += (entries[i].ms < last_ms[event]);
+            last_ms[event] = entries[i].ms;
+            drained[event]++;
+        }
+        sched_yield();
+    }
+    bt_app_xrun_get(after);
+
+    CHECK_EQ(after[BT_APP_XRUN_RING_FULL].count - before[BT_APP_XRUN_RING_FULL].count, STRESS_EVENTS);
+    CHECK_EQ(after[BT_APP_XRUN_RING_EMPTY].count - before[BT_APP_XRUN_RING_EMPTY].count, STRESS_EVENTS);
+    CHECK_EQ(drained[BT_APP_XRUN_RING_FULL] + drained[BT_APP_XRUN_RING_EMPTY] + lost_total, 2 * STRESS_EVENTS);
+    CHECK_EQ(drained[BT_APP_XRUN_DMA_UNDERRUN] + drained[BT_APP_XRUN_DMA_SENT], 0);
+    CHECK_EQ(out_of_order, 0);
+    CHECK(drained[BT_APP_XRUN_RING_FULL] > 0 && drained[BT_APP_XRUN_RING_EMPTY] > 0);
+    printf("2 writers, %u events: %u drained, %u lost\n", 2 * STRESS_EVENTS,
+           drained[BT_APP_XRUN_RING_FULL] + drained[BT_APP_XRUN_RING_EMPTY], lost_total);
+}
+
+int main(void)
+{
+    esp_log_level_set("*", ESP_LOG_WARN);
+    test_single_task();
+    test_stress();
+    return TEST_RESULT();
+}